@@ -8,6 +8,7 @@ URL: http://www.gitorious.org/+maemo-tools-developers/maemo-tools/sp-memusage
 Source: %{name}_%{version}.tar.gz
 BuildRoot: %{_tmppath}/%{name}-%{version}-%{release}-build
 BuildRequires: libsp-measure-devel, python
+Requires: python3
 
 %description
   This package provides a collection of memory usage monitoring tools and scripts.
@@ -43,8 +44,12 @@ rm -rf %{buildroot}
 %{_bindir}/mem-smaps-*
 %{_bindir}/mem-dirty-code-pages
 %{_bindir}/run-with-mallinfo
+%{_bindir}/mallinfo-convert
 %{_bindir}/run-with-memusage
+%{_bindir}/mem-proc-capture
 %{_libdir}/mallinfo*
+%{_includedir}/mem-cpu-shm.h
+%{_includedir}/mallinfo-shm.h
 %{_mandir}/man1/mem-cpu-monitor.1.gz
 %{_mandir}/man1/mem-dirty-code-pages.1.gz
 %{_mandir}/man1/mem-monitor.1.gz
@@ -53,6 +58,8 @@ rm -rf %{buildroot}
 %{_mandir}/man1/mem-monitor-smaps.1.gz
 %{_mandir}/man1/mem-smaps-private.1.gz
 %{_mandir}/man1/run-with-mallinfo.1.gz
+%{_mandir}/man1/mallinfo-convert.1.gz
+%{_mandir}/man1/mem-proc-capture.1.gz
 %doc COPYING README
 
 
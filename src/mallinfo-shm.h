@@ -0,0 +1,163 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mallinfo-shm.h
+ * Heap statistics published by mallinfo.so with MALLINFO="shm=1" option.
+ *
+ * The mallinfo library writes the heap statistics of every report into
+ * POSIX shared memory segment /mallinfo-<pid> of the traced process.
+ * Publishing is only memory writes in the traced process. The segment
+ * is guarded by a sequence lock like the mem-cpu-monitor one, so any
+ * number of local processes can map it read-only and copy consistent
+ * samples without blocking the traced process:
+ *
+ *   mallinfo_shm_t* shm = mallinfo_shm_open(pid);
+ *   mallinfo_shm_sample_t sample;
+ *   if (shm && mallinfo_shm_read(shm, &sample) == 0) {
+ *       printf("in use: %llu bytes\n", (unsigned long long)sample.uordblks);
+ *   }
+ *   mallinfo_shm_close(shm);
+ *
+ * The segment is removed when the traced process exits normally. The
+ * segment of a killed process is left in /dev/shm, the pid field tells
+ * the readers which process wrote it.
+ */
+#ifndef MALLINFO_SHM_H
+#define MALLINFO_SHM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MALLINFO_SHM_MAGIC          0x4d494e46u  /* "MINF" */
+#define MALLINFO_SHM_VERSION        1
+
+/* the segment name format, with the traced process identifier */
+#define MALLINFO_SHM_NAME           "/mallinfo-%d"
+
+/* attempts to read a consistent sample before giving up */
+#define MALLINFO_SHM_RETRIES        8
+
+/**
+ * The heap statistics of a mallinfo report, the mallinfo fields in bytes.
+ */
+typedef struct mallinfo_shm_sample_t {
+	/* report time (milliseconds since the process start) */
+	uint64_t time;
+	/* non-mmapped space allocated from system */
+	uint64_t arena;
+	/* space in mmapped regions */
+	uint64_t hblkhd;
+	/* total allocated space */
+	uint64_t uordblks;
+	/* total free space */
+	uint64_t fordblks;
+	/* top-most, releasable space */
+	uint64_t keepcost;
+} mallinfo_shm_sample_t;
+
+/**
+ * The shared memory segment layout.
+ */
+typedef struct mallinfo_shm_t {
+	uint32_t magic;
+	uint32_t version;
+	/* size of the sample structure */
+	uint32_t size;
+	/* sequence lock counter. Odd while the sample is being
+	 * written, zero until the first sample is published */
+	uint32_t seq;
+	/* the traced process identifier */
+	int32_t pid;
+	uint32_t reserved;
+	mallinfo_shm_sample_t sample;
+} mallinfo_shm_t;
+
+
+/**
+ * Maps the heap statistics segment of a process for reading.
+ *
+ * @param[in] pid  the traced process identifier.
+ * @return         the mapped segment or NULL in the case of failure.
+ */
+static inline mallinfo_shm_t*
+mallinfo_shm_open(int pid)
+{
+	char name[32];
+	snprintf(name, sizeof(name), MALLINFO_SHM_NAME, pid);
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1) return NULL;
+	void* addr = mmap(NULL, sizeof(mallinfo_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) return NULL;
+
+	mallinfo_shm_t* shm = (mallinfo_shm_t*)addr;
+	if (shm->magic != MALLINFO_SHM_MAGIC || shm->version != MALLINFO_SHM_VERSION ||
+			shm->size != sizeof(mallinfo_shm_sample_t) || shm->pid != pid) {
+		munmap(addr, sizeof(mallinfo_shm_t));
+		errno = EPROTO;
+		return NULL;
+	}
+	return shm;
+}
+
+/**
+ * Copies the latest published sample.
+ *
+ * The segment is writable by the traced process, which could be stopped
+ * or killed in the middle of a write. The read is retried only a few
+ * times, so the reader never blocks on it.
+ * @param[in] shm      the mapped segment.
+ * @param[out] sample  the sample copy.
+ * @return             0 for success, -EAGAIN if nothing is published yet
+ *                     or no consistent sample could be read.
+ */
+static inline int
+mallinfo_shm_read(const mallinfo_shm_t* shm, mallinfo_shm_sample_t* sample)
+{
+	uint32_t seq1, seq2;
+	int i;
+	for (i = 0; i < MALLINFO_SHM_RETRIES; i++) {
+		if (i) sched_yield();
+		seq1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq1 == 0) return -EAGAIN;
+		if (seq1 & 1) continue;
+		memcpy(sample, &shm->sample, sizeof(mallinfo_shm_sample_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+		if (seq1 == seq2) return 0;
+	}
+	return -EAGAIN;
+}
+
+/**
+ * Unmaps the heap statistics segment.
+ *
+ * @param[in] shm  the mapped segment.
+ */
+static inline void
+mallinfo_shm_close(mallinfo_shm_t* shm)
+{
+	if (shm) munmap(shm, sizeof(mallinfo_shm_t));
+}
+
+#endif
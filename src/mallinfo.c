@@ -21,12 +21,32 @@
  *    memory usage tracking.
  *
  *    To enable tracing you have to set MALLINFO variable:
- *       export MALLINFO="yes"        -- use 5 seconds timeout and SIGALRM
+ *       export MALLINFO="yes"        -- periodic report every 5 seconds
  *       export MALLINFO="signal=10"  -- use SIGUSR1 to generate the report
  *       export MALLINFO="period=10"  -- periodic report for 10 secons
+ *       export MALLINFO="interval=100" -- periodic report every 100 ms
+ *       export MALLINFO="period=10,arenas=1" -- add per-arena report
+ *       export MALLINFO="dir=/tmp,records=1000" -- trace directory and size
+ *       export MALLINFO="period=1,counters=1" -- count allocator calls
+ *       export MALLINFO="period=1,threads=1" -- and per thread with timing
+ *       export MALLINFO="profile=524288" -- sampled heap profile
+ *       export MALLINFO="trim=64M"   -- return free heap to the system
+ *       export MALLINFO="shm=1"      -- publish reports for mem-cpu-monitor
+ *       export MALLINFO="leaks=64k"  -- live large blocks by call site and age
+ *
+ *    The reports are written by a sampler thread, woken up by a timerfd
+ *    for the periodic reports. The signal handler only wakes up the thread
+ *    through an eventfd, so no allocator or stdio calls are made in the
+ *    signal context and no signal is used unless requested.
+ *
+ *    The reports are stored as fixed size binary records into a ring buffer
+ *    file DIR/mallinfo-PID.trace (DIR is $HOME by default), which is
+ *    preallocated and kept mapped, so writing a report makes no system
+ *    calls. When the ring is full, the oldest records are overwritten.
+ *    mallinfo-convert script converts the trace into the CSV format below.
  *
  *    The report format is the following:
- *       time    - time of report since application started
+ *       time    - time of report since application started (seconds)
  *       arena   - size of non-mmapped space allocated from system
  *       ordblks - number of free chunks
  *       smblks  - number of fastbin blocks
@@ -40,8 +60,101 @@
  *       total    - mi.uordblks + mi.fordblks + mi.hblkhd,
  *       sbrk     - sbrk pointer at the specified time
  *
+ *    The values are 64-bit with mallinfo2() (glibc 2.33 and newer), the
+ *    mallinfo() int fields wrap around at 2 GiB and are only good up to
+ *    4 GiB even when read as unsigned.
+ *
+ *    With counters=1 the library interposes malloc, calloc, realloc, free
+ *    and the aligned allocation functions, and counts the calls, the bytes
+ *    (usable size) allocated and freed, and the allocations in power of
+ *    two size classes. Every thread updates its own cache line aligned
+ *    counters without locking and the sampler sums them up for the report.
+ *    Without the option the functions just call the C-library ones.
+ *
+ *    With threads=1 the counters of every live thread are also written
+ *    into the trace after the totals of each report, with the thread ID,
+ *    the estimated frees of the blocks allocated by another thread and the
+ *    estimated time spent in the allocation and free calls. Every
+ *    MI_TIME_RATE-th call of a thread is timed, and the allocating thread
+ *    of one block address in 2^MI_OWNER_SHIFT is kept in a hash table
+ *    like the heap profile live blocks, so the free of a sampled block
+ *    looks it up. mallinfo-convert -t converts the per-thread records.
+ *
+ *    With profile=BYTES the interposed functions take a backtrace of about
+ *    one allocation per BYTES allocated. The distance to the next sample
+ *    is drawn from an exponential distribution with BYTES mean, as in
+ *    tcmalloc, so the sampling is not biased by the allocation pattern.
+ *    The live sampled blocks are kept in a lock-free hash table keyed by
+ *    pointer and the stacks in another one with their allocated and
+ *    in-use sample counts and bytes. The profile is written in the pprof
+ *    legacy heap format (heap_v2, pprof scales the samples back) into
+ *    DIR/mallinfo-PID.NNNN.heap on every report signal, every
+ *    profile_period=SECONDS and at exit:
+ *       pprof --text program mallinfo-1234.0001.heap
+ *
+ *    With leaks=SIZE (k, M and G suffixes accepted) every live block of
+ *    SIZE or more bytes is tracked in a lock-free hash table keyed by
+ *    pointer, in an anonymous mapping, with its size, allocation time and
+ *    the return address of the allocation call. The live bytes and blocks
+ *    per call site and age (< 1 s, < 10 s, < 1 min, < 10 min, < 1 h and
+ *    older) are written into DIR/mallinfo-PID.NNNN.leaks on every report
+ *    signal, every leaks_period=SECONDS (60 by default) and at exit. A
+ *    call site whose old blocks keep growing from report to report leaks.
+ *
+ *    With trim=SIZE (k, M and G suffixes accepted) the sampler thread
+ *    calls malloc_trim() when the free heap (fordblks, which includes the
+ *    releasable top of the heap, keepcost) has exceeded SIZE in all the
+ *    periodic reports for trim_hold=SECONDS (10 by default), and at most
+ *    once in trim_interval=SECONDS (60 by default), so that a transient
+ *    free peak reused soon by the application isn't returned to the
+ *    system only to be faulted in again. The trimmed pages are still
+ *    counted as free heap, so after a trim the RSS has to grow by SIZE
+ *    from its lowest value since the trim before the next one. The RSS
+ *    before and after each trim is logged to stderr.
+ *
+ *    The allocator is detected at load time. If jemalloc (mallctl) or
+ *    tcmalloc (MallocExtension_GetNumericProperty) is found, its statistics
+ *    are reported instead of mallinfo, which only knows the C-library heap,
+ *    in the same trace with the allocator flag in the header:
+ *       jemalloc - allocated, active, resident, retained, mapped and
+ *                  metadata bytes, and per arena with arenas=1 the active,
+ *                  dirty, muzzy, mapped, retained, small and large bytes
+ *       tcmalloc - allocated, heap size, page heap free and unmapped bytes,
+ *                  central, transfer and thread cache free bytes
+ *    The interposed functions call the next allocator in the symbol lookup
+ *    order, so the application keeps using the allocator it was built or
+ *    preloaded with.
+ *
+ *    With shm=1 the totals of every report are also written into POSIX
+ *    shared memory segment /mallinfo-PID (see mallinfo-shm.h), which
+ *    mem-cpu-monitor heap columns read. Publishing is only memory writes.
+ *
+ *    The per-arena report is converted from the same trace and is parsed
+ *    from malloc_info() output, one line per arena and report time:
+ *       time       - time of report since application started
+ *       arena      - arena number, 0 is the main (sbrk) arena
+ *       fastblks   - number of free fastbin blocks
+ *       fastfree   - space in free fastbin blocks
+ *       freeblks   - number of other free chunks
+ *       free       - space in other free chunks
+ *       system     - space allocated from system for the arena
+ *       maxsystem  - maximum space allocated from system for the arena
+ *       aspace     - address space reserved for the arena
+ *
  * History:
  *
+ * 18-Oct-2026
+ * - 64-bit values with mallinfo2(), full sbrk pointer and per-arena report.
+ * - Sampler thread with timerfd period instead of SIGALRM handler.
+ * - Binary records in mmap'd ring trace file, configurable directory.
+ * - Optional allocation call, byte and size class counters.
+ * - Optional sampled heap profile in pprof format.
+ * - Optional malloc_trim() policy for sustained free heap.
+ * - Optional shared memory export of the report totals.
+ * - jemalloc and tcmalloc statistics, calls to the next allocator.
+ * - Optional live large block tracking by call site and age.
+ * - Optional per-thread counters, remote frees and allocator call time.
+ *
  * 20-Dec-2005 Leonid Moiseichuk
  * - Added environment variable MALLINFO analysis and working for signal.
  *
@@ -57,8 +170,20 @@
 #define _GNU_SOURCE
 
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <execinfo.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
 #include <malloc.h>
+#include <stdint.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -66,16 +191,21 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "mallinfo-shm.h"
+
 /* ========================================================================= *
  * General settings.
  * ========================================================================= */
 
 #define TOOL_NAME    "mallinfo"
-#define TOOL_VERS    "0.2.0"
+#define TOOL_VERS    "0.3.0"
 #define TOOL_FILE    "%s/mallinfo-%d.trace"
 #define TOOL_VAR     "MALLINFO"
-#define TOOL_SIGNAL  SIGALRM
-#define TOOL_PERIOD  5     /* reporting time in seconds */
+#define TOOL_PERIOD  5000  /* reporting time in milliseconds */
+#define TOOL_RECORDS 32768 /* trace ring size in records (8 MB) */
+#define TOOL_TRIM_HOLD     10  /* seconds of free heap before trimming */
+#define TOOL_TRIM_INTERVAL 60  /* minimal seconds between trims        */
+#define TOOL_LEAKS_PERIOD  60  /* seconds between live block reports   */
 
 #define TOOL_LOGO    1
 
@@ -83,172 +213,2356 @@
  * Definitions.
  * ========================================================================= */
 
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define MI_STRUCT        mallinfo2
+#define MI_FIELD(field)  (field)
+#else
+#define MI_STRUCT        mallinfo
+/* int fields wrapped past 2 GiB are still right up to 4 GiB as unsigned */
+#define MI_FIELD(field)  ((size_t)(unsigned)(field))
+#endif
+
+/* mallinfo values independent of the available mallinfo call */
+typedef struct
+{
+   size_t arena;
+   size_t ordblks;
+   size_t smblks;
+   size_t hblks;
+   size_t hblkhd;
+   size_t usmblks;
+   size_t fsmblks;
+   size_t uordblks;
+   size_t fordblks;
+   size_t keepcost;
+} mi_info_t;
+
+/* trace file header, the layout is read by mallinfo-convert */
+#define TRACE_MAGIC    "MALLINFO"
+#define TRACE_VERSION  3
+#define TRACE_FIELDS   32
+
+/* trace header flags */
+#define TRACE_COUNTERS 1   /* the totals have allocation counters */
+#define TRACE_JEMALLOC 2   /* the values are jemalloc statistics  */
+#define TRACE_TCMALLOC 4   /* the values are tcmalloc statistics  */
+#define TRACE_THREADS  8   /* per-thread records are written      */
+
+/* arena field of the per-thread record of a counters slot */
+#define TRACE_THREAD(slot)  (-2 - (int)(slot))
+
+/* the allocators with known statistics */
+enum
+{
+   MI_GLIBC,
+   MI_JEMALLOC,
+   MI_TCMALLOC
+};
+
+/* jemalloc "arena.<i>.purge" index for all arenas, MALLCTL_ARENAS_ALL */
+#define MI_JEMALLOC_ARENAS_ALL  4096
+
+/* allocations served before the next allocator is resolved */
+#define MI_BOOTSTRAP_SIZE  4096
+
+/* allocation size classes: <= 16, <= 32, ... <= 256k and larger */
+#define MI_HIST_BUCKETS  16
+
+/* threads with their own counters, the others share atomic counters */
+#define MI_MAX_THREADS   1024
+
+/* every MI_TIME_RATE-th allocator call of a thread is timed, and the
+   owner of one block address in 2^MI_OWNER_SHIFT is tracked */
+#define MI_TIME_RATE     32
+#define MI_OWNER_SHIFT   6
+#define MI_OWNER_SLOTS   65536
+
+/* heap profile file, stack depth and hash table sizes (powers of two) */
+#define MI_PROFILE_FILE  "%s/mallinfo-%d.%04u.heap"
+#define MI_STACK_DEPTH   32
+#define MI_STACK_SLOTS   16384
+#define MI_LIVE_SLOTS    65536
+#define MI_PROBES        64          /* maximal hash table probe length */
+
+/* live block report file, tracked blocks and call sites table sizes */
+#define MI_LEAKS_FILE    "%s/mallinfo-%d.%04u.leaks"
+#define MI_LEAK_SLOTS    1048576
+#define MI_LEAK_SITES    4096
+
+/* live block age buckets: < 1 s, < 10 s, < 1 min, < 10 min, < 1 h, older */
+#define MI_AGE_BUCKETS   6
+
+typedef struct
+{
+   char     magic[8];
+   uint32_t version;
+   uint32_t header_size;
+   uint32_t record_size;
+   uint32_t capacity;    /* ring size in records                         */
+   uint64_t written;     /* records written, the next goes to written % capacity */
+   uint32_t pid;
+   uint32_t flags;       /* TRACE_* flags */
+   uint32_t reserved[6];
+} mi_trace_header_t;
+
+/* trace record, the values are mallinfo fields followed by sbrk pointer
+   and the mi_counters_t fields for the totals, the mi_arena_t fields for
+   an arena, or the thread identifier and the mi_counters_t fields up to
+   free_ns for a thread */
+typedef struct
+{
+   uint32_t time;        /* milliseconds since application start */
+   int32_t  arena;       /* arena number, -1 for the totals      */
+   uint64_t values[TRACE_FIELDS];
+} mi_trace_record_t;
+
+/* allocation counters of a thread, written only by the owner thread */
+typedef struct
+{
+   uint64_t allocs;
+   uint64_t frees;
+   uint64_t reallocs;
+   uint64_t alloc_bytes;
+   uint64_t free_bytes;
+   uint64_t hist[MI_HIST_BUCKETS];
+   uint64_t remote_frees; /* estimated frees of other threads' blocks      */
+   uint64_t alloc_ns;     /* estimated time in the allocation calls        */
+   uint64_t free_ns;      /* estimated time in the free calls              */
+   pid_t    tid;          /* the owner thread, 0 for a released slot       */
+   int      owned;
+} __attribute__((aligned(64))) mi_counters_t;
+
+/* allocation call stack of the heap profile, ready when depth is set */
+typedef struct
+{
+   uint64_t hash;        /* 0 for an unused slot */
+   int      depth;
+   void*    pcs[MI_STACK_DEPTH];
+   uint64_t alloc_count; /* sampled allocations and their requested bytes */
+   uint64_t alloc_bytes;
+   uint64_t inuse_count; /* sampled allocations not freed yet */
+   uint64_t inuse_bytes;
+} mi_stack_t;
+
+/* live sampled or tracked block, ptr is 0 for an unused slot */
+typedef struct
+{
+   uintptr_t ptr;
+   size_t    size;
+   union
+   {
+      unsigned stack;    /* heap profile stack index                */
+      unsigned owner;    /* counters slot of the allocating thread  */
+   };
+   unsigned  time;       /* tracked block allocation time in ms     */
+   void*     caller;     /* tracked block allocation return address */
+} mi_live_t;
+
+/* live blocks hash table with linear probing. The blocks are added and
+   removed under the lock, and the removal shifts the following blocks
+   back instead of leaving removed slots behind. The frees of the blocks
+   not in the table, the common case, only read the slots, and retry if
+   the sequence counter shows a removal in progress or done meanwhile */
+typedef struct
+{
+   mi_live_t* slots;
+   unsigned   size;      /* power of two */
+   int        lock;
+   unsigned   seq;       /* odd while the slots are shifted */
+} mi_table_t;
+
+/* live tracked blocks of a call site by age */
+typedef struct
+{
+   void*    caller;      /* NULL for an unused slot */
+   uint64_t count[MI_AGE_BUCKETS];
+   uint64_t bytes[MI_AGE_BUCKETS];
+} mi_site_t;
+
+/* malloc_info statistics of one arena */
+typedef struct
+{
+   int    nr;
+   size_t fastblks;
+   size_t fastfree;
+   size_t freeblks;
+   size_t free;
+   size_t system;
+   size_t maxsystem;
+   size_t aspace;
+} mi_arena_t;
+
 /* ========================================================================= *
  * Local data.
  * ========================================================================= */
 
-static time_t  s_epoch = 0;   /* Time of application launch */
+static struct timespec s_epoch; /* Time of application launch */
 static char    s_path[256];   /* Path for storing report    */
+static int     s_arenas = 0;  /* Per-arena records are written */
+static mi_info_t s_last;      /* statistics of the latest report */
+static unsigned  s_last_time; /* time of the latest report in ms */
+
+static size_t   s_trim = 0;          /* free heap threshold for trimming  */
+static unsigned s_trim_hold;         /* free heap hold time before trim, ms */
+static unsigned s_trim_interval;     /* minimal time between trims, ms    */
+static unsigned s_trim_since = 0;    /* free heap exceeded threshold at, ms + 1 */
+static unsigned s_trim_last = 0;     /* latest trim at, ms + 1            */
+static unsigned long s_trim_rss = 0; /* lowest RSS since the latest trim, kB */
 
-static time_t  s_period = 0;  /* Period of reporting          */
-static int     s_signal = 0;  /* Default signal for reporting */
+static mallinfo_shm_t* s_shm = NULL; /* published latest report totals  */
+static char     s_shm_name[32];      /* name of the shared memory segment */
+
+static mi_trace_header_t* s_trace = NULL;   /* mapped trace file */
+static mi_trace_record_t* s_records = NULL; /* trace ring        */
+
+static unsigned s_period = 0;  /* Period of reporting in ms     */
+static int     s_signal = 0;  /* Signal requesting a report   */
+
+static int       s_timer = -1; /* timerfd for periodic reports          */
+static int       s_event = -1; /* eventfd for requested reports and exit */
+static pthread_t s_thread;     /* sampler thread                        */
+static volatile sig_atomic_t s_stop = 0; /* sampler thread exit request */
+
+static int           s_counting = 0;  /* allocation calls are counted    */
+static pthread_key_t s_counters_key;  /* releases the slot at thread exit */
+static mi_counters_t s_counters[MI_MAX_THREADS]; /* per-thread counters   */
+static mi_counters_t s_shared;        /* counters of the other threads    */
+static unsigned      s_counters_used = 0; /* slots taken so far           */
+
+static int        s_threads = 0;     /* per-thread statistics are written */
+static mi_table_t s_owners;          /* sampled blocks and their owners  */
+
+static int         s_profiling = 0;  /* allocations are sampled          */
+static unsigned    s_sample_rate;    /* mean bytes between samples       */
+static unsigned    s_profile_period; /* heap profile period in seconds   */
+static int         s_profile_timer = -1; /* timerfd for the heap profiles */
+static unsigned    s_profiles = 0;   /* heap profiles written so far     */
+static char        s_dir[192];      /* directory for the heap profiles  */
+static mi_stack_t* s_stacks = NULL;  /* allocation stacks hash table     */
+static mi_table_t  s_live;           /* live sampled blocks hash table   */
+static uint64_t    s_dropped = 0;    /* samples lost to full hash tables */
+
+static int        s_tracking = 0;    /* large blocks are tracked         */
+static size_t     s_leak_min;        /* smallest tracked block size      */
+static unsigned   s_leak_period;     /* live block report period in seconds */
+static int        s_leak_timer = -1; /* timerfd for the live block reports */
+static unsigned   s_leak_reports = 0; /* live block reports written so far */
+static mi_table_t s_leaks;           /* live tracked blocks hash table   */
+static mi_site_t* s_sites = NULL;    /* call sites of a live block report */
+static uint64_t   s_leak_dropped = 0; /* blocks not tracked, table full  */
+
+/* counters of the current thread, initial-exec model doesn't allocate */
+static __thread mi_counters_t* t_counters __attribute__((tls_model("initial-exec")));
+
+/* allocator calls of the thread to the next timed one */
+static __thread int t_time_left __attribute__((tls_model("initial-exec")));
+
+/* bytes to the next sample, random state and recursion guard of the thread */
+static __thread int64_t  t_sample_left __attribute__((tls_model("initial-exec")));
+static __thread uint64_t t_random __attribute__((tls_model("initial-exec")));
+static __thread int      t_sampling __attribute__((tls_model("initial-exec")));
+
+/* the next allocator in the symbol lookup order, called by the interposed
+   functions: jemalloc or tcmalloc if the application uses them, otherwise
+   the C-library */
+typedef struct
+{
+   void*  (*malloc)(size_t size);
+   void*  (*calloc)(size_t nmemb, size_t size);
+   void*  (*realloc)(void* ptr, size_t size);
+   void   (*free)(void* ptr);
+   void*  (*memalign)(size_t alignment, size_t size);
+   size_t (*usable_size)(void* ptr);
+} mi_next_t;
+
+/* malloc is published last, the others are set when it is */
+static mi_next_t      s_next;
+static pthread_once_t s_resolve_once = PTHREAD_ONCE_INIT;
+static char   s_bootstrap[MI_BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t s_bootstrap_used = 0;
+
+/* dlsym() may allocate in the thread resolving the next allocator */
+static __thread int t_resolving __attribute__((tls_model("initial-exec")));
+
+/* the allocator statistics interfaces found at load time */
+static int s_allocator = MI_GLIBC;
+static int (*s_mallctl)(const char* name, void* oldp, size_t* oldlenp, void* newp, size_t newlen);
+static int (*s_tc_property)(const char* name, size_t* value);
+static void (*s_tc_release)(void);
 
 /* ========================================================================= *
  * Local methods.
  * ========================================================================= */
 
 /* ------------------------------------------------------------------------- *
- * mi_get -- find the specified option in the configuration string and get it.
+ * mi_find, mi_get -- find the specified option in the configuration string and get it.
  * parameters: configuration, option name, default value.
  * returns: new or default option value.
  * ------------------------------------------------------------------------- */
+static const char* mi_find(const char* config, const char* opt)
+{
+   const size_t len = strlen(opt);
+   const char*  ptr = config;
+
+   /* the option must be at the start or after ',' and followed by '=' */
+   while ( (ptr = strstr(ptr, opt)) )
+   {
+      if ((ptr == config || ',' == ptr[-1]) && '=' == ptr[len])
+         return ptr + len + 1;
+      ptr += len;
+   }
+   return NULL;
+} /* mi_find */
+
 static unsigned mi_get(const char* config, const char* opt, unsigned def)
 {
-   const char* ptr = strstr(config, opt);
-   return (ptr ? (unsigned)strtoul(ptr + strlen(opt) + 1, NULL, 0) : def);
+   const char* ptr = mi_find(config, opt);
+   return (ptr ? (unsigned)strtoul(ptr, NULL, 0) : def);
 } /* mi_get */
 
 /* ------------------------------------------------------------------------- *
- * mi_dump -- Create the file and dump trace information into it.
- * parameters: singal number. 0 means that we shall not create timer any more.
+ * mi_get_size -- find the specified size option with k, M or G suffix.
+ * parameters: configuration, option name, default value.
+ * returns: new or default option value in bytes.
+ * ------------------------------------------------------------------------- */
+static size_t mi_get_size(const char* config, const char* opt, size_t def)
+{
+   const char* ptr = mi_find(config, opt);
+   char*       end;
+   size_t      value;
+
+   if ( !ptr )
+      return def;
+   value = (size_t)strtoull(ptr, &end, 0);
+   switch (*end)
+   {
+      case 'g': case 'G':
+         value <<= 10;
+         /* fall through */
+      case 'm': case 'M':
+         value <<= 10;
+         /* fall through */
+      case 'k': case 'K':
+         value <<= 10;
+         break;
+   }
+   return value;
+} /* mi_get_size */
+
+/* ------------------------------------------------------------------------- *
+ * mi_get_str -- find the specified string option in the configuration.
+ * parameters: configuration, option name, default value, buffer and size.
  * returns: none.
  * ------------------------------------------------------------------------- */
+static void mi_get_str(const char* config, const char* opt, const char* def, char* buf, size_t size)
+{
+   const char* ptr = mi_find(config, opt);
+
+   if ( ptr )
+      snprintf(buf, size, "%.*s", (int)strcspn(ptr, ","), ptr);
+   else
+      snprintf(buf, size, "%s", def ? def : ".");
+} /* mi_get_str */
 
-static void mi_dump(int signo)
+/* ------------------------------------------------------------------------- *
+ * mi_trace_open -- create the trace file and map it.
+ * parameters: ring size in records.
+ * returns: 0 if successful.
+ * ------------------------------------------------------------------------- */
+static int mi_trace_open(unsigned capacity)
 {
-   /* Got the tracing information first */
-   static time_t pred = 0;
-   const time_t    tm = time(NULL);
+   const size_t size = sizeof(mi_trace_header_t) + (size_t)capacity * sizeof(mi_trace_record_t);
+   void*        addr;
+   int          fd;
 
-   /* Check that at least 1 second passed from the time of the previous call */
-   if (pred != tm)
+   if ( !capacity )
+   {
+      errno = EINVAL;
+      return -1;
+   }
+   fd = open(s_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0)
+      return -1;
+   /* allocate the blocks now, so a full filesystem can't fail the writes */
+   errno = posix_fallocate(fd, 0, size);
+   if (errno != 0 && ftruncate(fd, size) != 0)
    {
-      /* Information about memory status */
-      const unsigned        bk = (unsigned)sbrk(0);
-      const struct mallinfo mi = mallinfo();
+      close(fd);
+      return -1;
+   }
+   addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (MAP_FAILED == addr)
+      return -1;
 
-      /* File to print */
-      FILE* file = fopen(s_path, "a");
+   s_trace = (mi_trace_header_t*)addr;
+   s_records = (mi_trace_record_t*)(s_trace + 1);
+   memcpy(s_trace->magic, TRACE_MAGIC, sizeof(s_trace->magic));
+   s_trace->version = TRACE_VERSION;
+   s_trace->header_size = sizeof(mi_trace_header_t);
+   s_trace->record_size = sizeof(mi_trace_record_t);
+   s_trace->capacity = capacity;
+   s_trace->written = 0;
+   s_trace->pid = getpid();
+   return 0;
+} /* mi_trace_open */
 
-      /* Dump header: check the file is opened correctly and it is not new */
-      if (NULL == file || 0 == ftell(file))
-      {
-         if ( !file )
-            file = stderr;
-         fprintf(file,"time,arena,ordblks,smblks,hblks,hblkhd,usmblks,fsmblks,uordblks,fordblks,keepcost,total,sbrk\n");
-      }
+/* ------------------------------------------------------------------------- *
+ * mi_trace_write, mi_trace_commit -- fill and commit the next trace record.
+ * parameters: milliseconds since application start, arena number or -1.
+ * returns: the record to fill before calling mi_trace_commit().
+ * ------------------------------------------------------------------------- */
+static mi_trace_record_t* mi_trace_write(unsigned elapsed, int arena)
+{
+   mi_trace_record_t* record = &s_records[s_trace->written % s_trace->capacity];
 
-      /* Dump the number of allocated blocks */
-      fprintf(file,"%u,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,%i,0x%08x\n",
-               (unsigned)(tm - s_epoch),
-               mi.arena,
-               mi.ordblks,
-               mi.smblks,
-               mi.hblks,
-               mi.hblkhd,
-               mi.usmblks,
-               mi.fsmblks,
-               mi.uordblks,
-               mi.fordblks,
-               mi.keepcost,
-               mi.uordblks + mi.fordblks + mi.hblkhd,
-               bk
-            );
-
-      /* Close file if it not stderr */
-      fflush(file);
-      if (file != stderr)
-         fclose(file);
-   }
-
-   /* Setup new alarm if it necessary */
-   if (signo && s_period)
-   {
-      alarm(s_period);
-      pred = tm;
-   }
-} /* mi_trace_dump */
+   memset(record, 0, sizeof(*record));
+   record->time = elapsed;
+   record->arena = arena;
+   return record;
+} /* mi_trace_write */
 
-/* ========================================================================= *
- * initializer and finalizer that allowed static linking.
- * ========================================================================= */
+static void mi_trace_commit(void)
+{
+   /* a reader of a live trace sees only the completed records */
+   __atomic_store_n(&s_trace->written, s_trace->written + 1, __ATOMIC_RELEASE);
+} /* mi_trace_commit */
 
-static void mi_init(void) __attribute__((constructor));
-static void mi_fini(void) __attribute__((destructor));
+/* ------------------------------------------------------------------------- *
+ * mi_shm_open -- create and map the shared memory segment for the totals.
+ * parameters: none.
+ * returns: 0 if successful.
+ * ------------------------------------------------------------------------- */
+static int mi_shm_open(void)
+{
+   void* addr;
+   int   fd;
 
- /* ------------------------------------------------------------------------- *
- * mi_init -- this function shall be called by Loader when library is loaded.
+   snprintf(s_shm_name, sizeof(s_shm_name), MALLINFO_SHM_NAME, getpid());
+   fd = shm_open(s_shm_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0)
+      return -1;
+   if (ftruncate(fd, sizeof(mallinfo_shm_t)) != 0)
+   {
+      close(fd);
+      shm_unlink(s_shm_name);
+      return -1;
+   }
+   addr = mmap(NULL, sizeof(mallinfo_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (MAP_FAILED == addr)
+   {
+      shm_unlink(s_shm_name);
+      return -1;
+   }
+
+   s_shm = (mallinfo_shm_t*)addr;
+   s_shm->magic = MALLINFO_SHM_MAGIC;
+   s_shm->version = MALLINFO_SHM_VERSION;
+   s_shm->size = sizeof(mallinfo_shm_sample_t);
+   s_shm->pid = getpid();
+   return 0;
+} /* mi_shm_open */
+
+/* ------------------------------------------------------------------------- *
+ * mi_shm_publish -- write the report totals under the sequence lock.
+ * parameters: milliseconds since application start, statistics.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_shm_publish(unsigned elapsed, const mi_info_t* mi)
+{
+   const uint32_t seq = __atomic_load_n(&s_shm->seq, __ATOMIC_RELAXED);
+
+   /* odd sequence while writing, the readers retry */
+   __atomic_store_n(&s_shm->seq, seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   s_shm->sample.time = elapsed;
+   s_shm->sample.arena = mi->arena;
+   s_shm->sample.hblkhd = mi->hblkhd;
+   s_shm->sample.uordblks = mi->uordblks;
+   s_shm->sample.fordblks = mi->fordblks;
+   s_shm->sample.keepcost = mi->keepcost;
+   __atomic_store_n(&s_shm->seq, seq + 2, __ATOMIC_RELEASE);
+} /* mi_shm_publish */
+
+/* ------------------------------------------------------------------------- *
+ * mi_detect -- find the statistics interface of the used allocator.
  * parameters: none.
+ * returns: MI_GLIBC, MI_JEMALLOC or MI_TCMALLOC.
+ * ------------------------------------------------------------------------- */
+static int mi_detect(void)
+{
+   *(void**)&s_mallctl = dlsym(RTLD_DEFAULT, "mallctl");
+   if ( s_mallctl )
+      return MI_JEMALLOC;
+   *(void**)&s_tc_property = dlsym(RTLD_DEFAULT, "MallocExtension_GetNumericProperty");
+   if ( s_tc_property )
+   {
+      *(void**)&s_tc_release = dlsym(RTLD_DEFAULT, "MallocExtension_ReleaseFreeMemory");
+      return MI_TCMALLOC;
+   }
+   return MI_GLIBC;
+} /* mi_detect */
+
+/* ------------------------------------------------------------------------- *
+ * mi_je_size, mi_tc_size -- read a jemalloc or tcmalloc statistic.
+ * parameters: statistic name.
+ * returns: the value, 0 if not available.
+ * ------------------------------------------------------------------------- */
+static size_t mi_je_size(const char* name)
+{
+   size_t value = 0;
+   size_t len = sizeof(value);
+
+   return (s_mallctl(name, &value, &len, NULL, 0) == 0 ? value : 0);
+} /* mi_je_size */
+
+static size_t mi_tc_size(const char* name)
+{
+   size_t value = 0;
+
+   return (s_tc_property(name, &value) ? value : 0);
+} /* mi_tc_size */
+
+/* ------------------------------------------------------------------------- *
+ * mi_read_jemalloc -- get jemalloc statistics.
+ * parameters: mallinfo equivalents to fill, trace values to fill.
  * returns: none.
  * ------------------------------------------------------------------------- */
+static void mi_read_jemalloc(mi_info_t* info, uint64_t* values)
+{
+   uint64_t epoch = 1;
+   size_t   len = sizeof(epoch);
+   size_t   heap;
 
-static void mi_init(void)
+   /* the statistics are a snapshot updated by the epoch write */
+   s_mallctl("epoch", &epoch, &len, &epoch, len);
+   values[0] = mi_je_size("stats.allocated");
+   values[1] = mi_je_size("stats.active");
+   values[2] = mi_je_size("stats.resident");
+   values[3] = mi_je_size("stats.retained");
+   values[4] = mi_je_size("stats.mapped");
+   values[5] = mi_je_size("stats.metadata");
+
+   /* the resident heap pages not allocated are the free heap */
+   heap = values[2] > values[5] ? values[2] - values[5] : 0;
+   memset(info, 0, sizeof(*info));
+   info->arena = heap;
+   info->uordblks = values[0];
+   info->fordblks = heap > values[0] ? heap - values[0] : 0;
+} /* mi_read_jemalloc */
+
+/* ------------------------------------------------------------------------- *
+ * mi_read_tcmalloc -- get tcmalloc statistics.
+ * parameters: mallinfo equivalents to fill, trace values to fill.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_read_tcmalloc(mi_info_t* info, uint64_t* values)
 {
-   const char* value = getenv(TOOL_VAR);
+   size_t heap;
 
-   if (value && *value)
-   {
-      /* Variables for storing signal and period */
-      const unsigned signum = mi_get(value, "signal", 0);
-      const unsigned period = mi_get(value, "period", 0);
+   values[0] = mi_tc_size("generic.current_allocated_bytes");
+   values[1] = mi_tc_size("generic.heap_size");
+   values[2] = mi_tc_size("tcmalloc.pageheap_free_bytes");
+   values[3] = mi_tc_size("tcmalloc.pageheap_unmapped_bytes");
+   values[4] = mi_tc_size("tcmalloc.central_cache_free_bytes");
+   values[5] = mi_tc_size("tcmalloc.transfer_cache_free_bytes");
+   values[6] = mi_tc_size("tcmalloc.thread_cache_free_bytes");
 
-      /* Initialize all variables first */
-      s_epoch = time(NULL);
-      snprintf(s_path, sizeof(s_path), TOOL_FILE, getenv("HOME"), getpid());
+   /* the unmapped pages are not resident */
+   heap = values[1] > values[3] ? values[1] - values[3] : 0;
+   memset(info, 0, sizeof(*info));
+   info->arena = heap;
+   info->uordblks = values[0];
+   info->fordblks = heap > values[0] ? heap - values[0] : 0;
+   info->keepcost = values[2];
+} /* mi_read_tcmalloc */
 
-      /* Setting the working values according to passed */
-      if ( period )
+/* ------------------------------------------------------------------------- *
+ * mi_dump_jemalloc_arenas -- dump per-arena records of jemalloc.
+ * parameters: milliseconds since application start.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_dump_jemalloc_arenas(unsigned elapsed)
+{
+   static const char* const names[] = { "pactive", "pdirty", "pmuzzy", "mapped", "retained",
+                                        "small.allocated", "large.allocated" };
+   const size_t page = mi_je_size("arenas.page");
+   unsigned     narenas = 0;
+   size_t       len = sizeof(narenas);
+   unsigned     i;
+   unsigned     j;
+
+   s_mallctl("arenas.narenas", &narenas, &len, NULL, 0);
+   for (i = 0; i < narenas; i++)
+   {
+      mi_trace_record_t* record;
+      uint64_t           values[7];
+      char               name[64];
+
+      for (j = 0; j < sizeof(names) / sizeof(names[0]); j++)
       {
-         /* The period is set -> should be used the default signal */
-         s_period = period;
-         s_signal = TOOL_SIGNAL;
+         snprintf(name, sizeof(name), "stats.arenas.%u.%s", i, names[j]);
+         values[j] = mi_je_size(name);
       }
-      else if ( signum )
+      /* the arenas not used by any thread yet have no memory */
+      if ( !values[3] )
+         continue;
+      record = mi_trace_write(elapsed, (int)i);
+      /* the page counts in bytes */
+      record->values[0] = values[0] * page;
+      record->values[1] = values[1] * page;
+      record->values[2] = values[2] * page;
+      record->values[3] = values[3];
+      record->values[4] = values[4];
+      record->values[5] = values[5];
+      record->values[6] = values[6];
+      mi_trace_commit();
+   }
+} /* mi_dump_jemalloc_arenas */
+
+/* ------------------------------------------------------------------------- *
+ * mi_release -- return the free heap to the system.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_release(void)
+{
+   char name[32];
+
+   switch (s_allocator)
+   {
+      case MI_JEMALLOC:
+         snprintf(name, sizeof(name), "arena.%d.purge", MI_JEMALLOC_ARENAS_ALL);
+         s_mallctl(name, NULL, NULL, NULL, 0);
+         break;
+      case MI_TCMALLOC:
+         if ( s_tc_release )
+            s_tc_release();
+         break;
+      default:
+         malloc_trim(0);
+         break;
+   }
+} /* mi_release */
+
+/* ------------------------------------------------------------------------- *
+ * mi_read -- get the malloc statistics, with mallinfo2 when available.
+ * parameters: statistics to fill.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_read(mi_info_t* info)
+{
+   const struct MI_STRUCT mi = MI_STRUCT();
+
+   info->arena    = MI_FIELD(mi.arena);
+   info->ordblks  = MI_FIELD(mi.ordblks);
+   info->smblks   = MI_FIELD(mi.smblks);
+   info->hblks    = MI_FIELD(mi.hblks);
+   info->hblkhd   = MI_FIELD(mi.hblkhd);
+   info->usmblks  = MI_FIELD(mi.usmblks);
+   info->fsmblks  = MI_FIELD(mi.fsmblks);
+   info->uordblks = MI_FIELD(mi.uordblks);
+   info->fordblks = MI_FIELD(mi.fordblks);
+   info->keepcost = MI_FIELD(mi.keepcost);
+} /* mi_read */
+
+/* ------------------------------------------------------------------------- *
+ * mi_dump_arenas -- parse malloc_info output and dump per-arena records.
+ * parameters: milliseconds since application start.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_dump_arenas(unsigned elapsed)
+{
+   char*  text = NULL;
+   size_t size = 0;
+   FILE*  xml = open_memstream(&text, &size);
+
+   if ( !xml )
+      return;
+   malloc_info(0, xml);
+   fclose(xml);
+
+   /* the arenas are listed as <heap nr="N"> elements followed by the totals,
+      every line matches only one of the formats */
+   {
+      mi_arena_t arena;
+      int        in_heap = 0;
+      int        nr;
+      char*      save = NULL;
+      char*      line;
+
+      for (line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
       {
-         /* The signal is set -> should be event-driven reporting */
-         s_period = 0;
-         s_signal = (int)signum;
+         if (sscanf(line, "<heap nr=\"%d\">", &nr) == 1)
+         {
+            memset(&arena, 0, sizeof(arena));
+            arena.nr = nr;
+            in_heap = 1;
+            continue;
+         }
+         if ( !in_heap )
+            continue;
+
+         sscanf(line, "<total type=\"fast\" count=\"%zu\" size=\"%zu\"/>", &arena.fastblks, &arena.fastfree);
+         sscanf(line, "<total type=\"rest\" count=\"%zu\" size=\"%zu\"/>", &arena.freeblks, &arena.free);
+         sscanf(line, "<system type=\"current\" size=\"%zu\"/>", &arena.system);
+         sscanf(line, "<system type=\"max\" size=\"%zu\"/>", &arena.maxsystem);
+         sscanf(line, "<aspace type=\"total\" size=\"%zu\"/>", &arena.aspace);
+
+         if ( !strcmp(line, "</heap>") )
+         {
+            mi_trace_record_t* record = mi_trace_write(elapsed, arena.nr);
+
+            record->values[0] = arena.fastblks;
+            record->values[1] = arena.fastfree;
+            record->values[2] = arena.freeblks;
+            record->values[3] = arena.free;
+            record->values[4] = arena.system;
+            record->values[5] = arena.maxsystem;
+            record->values[6] = arena.aspace;
+            mi_trace_commit();
+            in_heap = 0;
+         }
       }
-      else
+   }
+
+   free(text);
+} /* mi_dump_arenas */
+
+/* ------------------------------------------------------------------------- *
+ * mi_counters_release -- release the counters slot of an exiting thread.
+ * parameters: the counters.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_counters_release(void* arg)
+{
+   mi_counters_t* counters = (mi_counters_t*)arg;
+
+   /* the counts stay in the slot and the next owner continues from them.
+      The allocations of the later thread specific data destructors go to
+      the shared counters instead of taking a slot which isn't released */
+   t_counters = &s_shared;
+   if (counters != &s_shared)
+   {
+      __atomic_store_n(&counters->tid, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&counters->owned, 0, __ATOMIC_RELEASE);
+   }
+} /* mi_counters_release */
+
+/* ------------------------------------------------------------------------- *
+ * mi_counters_attach -- take a counters slot for the current thread.
+ * parameters: none.
+ * returns: the thread counters.
+ * ------------------------------------------------------------------------- */
+static mi_counters_t* mi_counters_attach(void)
+{
+   mi_counters_t* counters = &s_shared;
+   unsigned       used;
+   unsigned       i;
+   int            free;
+
+   /* reuse a slot released by an exited thread, or take a new one. A new
+      slot is claimed with the same exchange, as the other threads may
+      find it free before it is marked owned */
+   do
+   {
+      used = __atomic_load_n(&s_counters_used, __ATOMIC_ACQUIRE);
+      for (i = 0; i < used && i < MI_MAX_THREADS; i++)
       {
-         /* No period or signal set but variable is exists -> using defaults */
-         s_period = TOOL_PERIOD;
-         s_signal = TOOL_SIGNAL;
+         free = 0;
+         if (__atomic_compare_exchange_n(&s_counters[i].owned, &free, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+         {
+            counters = &s_counters[i];
+            break;
+         }
       }
+      if (counters != &s_shared)
+         break;
+      i = __atomic_fetch_add(&s_counters_used, 1, __ATOMIC_ACQ_REL);
+      if (i >= MI_MAX_THREADS)
+         break;
+      free = 0;
+      if (__atomic_compare_exchange_n(&s_counters[i].owned, &free, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+         counters = &s_counters[i];
+   } while (counters == &s_shared);
 
-#if TOOL_LOGO
-      fprintf(stderr, "%s version %s build %s %s\n", TOOL_NAME, TOOL_VERS, __DATE__, __TIME__);
-      fprintf(stderr, "(c) 2005 Nokia\n\n");
+   if (counters != &s_shared)
+      __atomic_store_n(&counters->tid, (pid_t)syscall(SYS_gettid), __ATOMIC_RELAXED);
+   t_counters = counters;
+   pthread_setspecific(s_counters_key, counters);
+   return counters;
+} /* mi_counters_attach */
 
-      fprintf(stderr, "detected variable %s with value '%s'\n", TOOL_VAR, value);
-      fprintf(stderr, "signal %d (%s) is used for reporting\n", s_signal, strsignal(s_signal));
-      fprintf(stderr, "report will be created every %u seconds\n", (unsigned)s_period);
-      fprintf(stderr, "report file %s\n", s_path);
-#endif
+/* ------------------------------------------------------------------------- *
+ * mi_counters_self -- get the counters of the current thread.
+ * parameters: none.
+ * returns: the thread counters.
+ * ------------------------------------------------------------------------- */
+static inline mi_counters_t* mi_counters_self(void)
+{
+   mi_counters_t* counters = t_counters;
 
-      signal(s_signal, mi_dump);
-      /* We should report first line if periodic reports are switched on */
-      if ( s_period )
-         mi_dump(s_signal);
+   return (counters ? counters : mi_counters_attach());
+} /* mi_counters_self */
+
+/* ------------------------------------------------------------------------- *
+ * mi_counters_slot -- get the slot number of counters.
+ * parameters: the counters.
+ * returns: the slot, MI_MAX_THREADS for the shared counters.
+ * ------------------------------------------------------------------------- */
+static inline unsigned mi_counters_slot(const mi_counters_t* counters)
+{
+   return (counters == &s_shared ? MI_MAX_THREADS : (unsigned)(counters - s_counters));
+} /* mi_counters_slot */
+
+/* ------------------------------------------------------------------------- *
+ * mi_count -- count an allocator call in the current thread counters.
+ * parameters: allocations, frees and reallocations done, bytes allocated
+ *             and freed, requested size for the size class histogram.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+
+/* adds to a counter, atomically only in the shared counters */
+#define MI_ADD(counters, field, n) \
+   ((counters) == &s_shared ? (void)__atomic_fetch_add(&(counters)->field, (n), __ATOMIC_RELAXED) : \
+      __atomic_store_n(&(counters)->field, (counters)->field + (n), __ATOMIC_RELAXED))
+
+static void mi_count(unsigned allocs, unsigned frees, unsigned reallocs,
+                     size_t alloc_bytes, size_t free_bytes, size_t size)
+{
+   mi_counters_t* counters = mi_counters_self();
+
+   if ( allocs )
+      MI_ADD(counters, allocs, allocs);
+   if ( frees )
+      MI_ADD(counters, frees, frees);
+   if ( reallocs )
+      MI_ADD(counters, reallocs, reallocs);
+   if ( alloc_bytes )
+      MI_ADD(counters, alloc_bytes, alloc_bytes);
+   if ( free_bytes )
+      MI_ADD(counters, free_bytes, free_bytes);
+   if (allocs || reallocs)
+   {
+      /* size class k holds sizes up to 2^(k+4) */
+      unsigned bucket = size <= 16 ? 0 : (unsigned)(64 - __builtin_clzll(size - 1)) - 4;
+      if (bucket >= MI_HIST_BUCKETS)
+         bucket = MI_HIST_BUCKETS - 1;
+      MI_ADD(counters, hist[bucket], 1);
    }
-} /* mi_init */
+} /* mi_count */
 
 /* ------------------------------------------------------------------------- *
- * mi_fini -- this function shall be called by Loader when library is unloaded.
- * parameters: none.
+ * mi_counters_sum -- sum up the counters of all threads.
+ * parameters: the values to set, as in the trace record.
  * returns: none.
  * ------------------------------------------------------------------------- */
+static void mi_counters_sum(uint64_t* values)
+{
+   unsigned used = __atomic_load_n(&s_counters_used, __ATOMIC_ACQUIRE);
+   unsigned i;
+   unsigned j;
 
-static void mi_fini(void)
+   if (used > MI_MAX_THREADS)
+      used = MI_MAX_THREADS;
+   for (i = 0; i <= used; i++)
+   {
+      /* the shared counters are summed last */
+      const mi_counters_t* counters = (i < used ? &s_counters[i] : &s_shared);
+
+      values[0] += __atomic_load_n(&counters->allocs, __ATOMIC_RELAXED);
+      values[1] += __atomic_load_n(&counters->frees, __ATOMIC_RELAXED);
+      values[2] += __atomic_load_n(&counters->reallocs, __ATOMIC_RELAXED);
+      values[3] += __atomic_load_n(&counters->alloc_bytes, __ATOMIC_RELAXED);
+      values[4] += __atomic_load_n(&counters->free_bytes, __ATOMIC_RELAXED);
+      for (j = 0; j < MI_HIST_BUCKETS; j++)
+         values[5 + j] += __atomic_load_n(&counters->hist[j], __ATOMIC_RELAXED);
+   }
+} /* mi_counters_sum */
+
+/* ------------------------------------------------------------------------- *
+ * mi_live_hash -- get the first live blocks table slot for a pointer.
+ * parameters: the pointer, the table size (power of two).
+ * returns: the slot index.
+ * ------------------------------------------------------------------------- */
+static inline unsigned mi_live_hash(uintptr_t ptr, unsigned slots)
 {
-   /* We should report the last line if periodic reports are used */
-   if ( s_period )
-      mi_dump(0);
-#if TOOL_LOGO
-   if ( s_period || s_signal )
-      fprintf(stderr, "\n%s finalization completed\n", TOOL_NAME);
-#endif
-} /* mi_fini */
+   return (unsigned)(((ptr >> 4) * 0x9e3779b97f4a7c15ULL) >> 32) & (slots - 1);
+} /* mi_live_hash */
+
+/* ------------------------------------------------------------------------- *
+ * mi_table_open -- allocate a live blocks hash table.
+ * parameters: the table and its size (power of two).
+ * returns: 0 if successful.
+ * ------------------------------------------------------------------------- */
+static int mi_table_open(mi_table_t* table, unsigned size)
+{
+   /* anonymous mapping, only the used pages get memory */
+   table->slots = mmap(NULL, size * sizeof(mi_live_t), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   table->size = size;
+   return (MAP_FAILED == table->slots ? -1 : 0);
+} /* mi_table_open */
+
+/* ------------------------------------------------------------------------- *
+ * mi_table_lock, mi_table_unlock -- serialize the table changes.
+ * parameters: the table.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_table_lock(mi_table_t* table)
+{
+   while ( __atomic_exchange_n(&table->lock, 1, __ATOMIC_ACQUIRE) )
+      while ( __atomic_load_n(&table->lock, __ATOMIC_RELAXED) )
+         sched_yield();
+} /* mi_table_lock */
+
+static void mi_table_unlock(mi_table_t* table)
+{
+   __atomic_store_n(&table->lock, 0, __ATOMIC_RELEASE);
+} /* mi_table_unlock */
+
+/* ------------------------------------------------------------------------- *
+ * mi_table_index -- find the slot of a block.
+ * parameters: the table and the block.
+ * returns: the slot index or -1 if the block is not in the table.
+ * ------------------------------------------------------------------------- */
+static int mi_table_index(const mi_table_t* table, void* ptr)
+{
+   const unsigned hash = mi_live_hash((uintptr_t)ptr, table->size);
+   unsigned       i;
+
+   for (i = 0; i < MI_PROBES; i++)
+   {
+      const unsigned  index = (hash + i) & (table->size - 1);
+      const uintptr_t found = __atomic_load_n(&table->slots[index].ptr, __ATOMIC_RELAXED);
+
+      if (0 == found)
+         return -1;
+      if (found == (uintptr_t)ptr)
+         return (int)index;
+   }
+   return -1;
+} /* mi_table_index */
+
+/* ------------------------------------------------------------------------- *
+ * mi_table_add -- add a new block.
+ * parameters: the table and the block, with its pointer and values.
+ * returns: 0 if added, -1 if the probed slots are taken.
+ * ------------------------------------------------------------------------- */
+static int mi_table_add(mi_table_t* table, const mi_live_t* live)
+{
+   const unsigned hash = mi_live_hash(live->ptr, table->size);
+   unsigned       i;
+   int            rc = -1;
+
+   mi_table_lock(table);
+   for (i = 0; i < MI_PROBES; i++)
+   {
+      mi_live_t* slot = &table->slots[(hash + i) & (table->size - 1)];
+
+      if ( !slot->ptr )
+      {
+         /* the readers see the values set when they see the pointer */
+         slot->size = live->size;
+         slot->stack = live->stack;
+         slot->time = live->time;
+         slot->caller = live->caller;
+         __atomic_store_n(&slot->ptr, live->ptr, __ATOMIC_RELEASE);
+         rc = 0;
+         break;
+      }
+   }
+   mi_table_unlock(table);
+   return rc;
+} /* mi_table_add */
+
+/* ------------------------------------------------------------------------- *
+ * mi_table_remove -- remove a block if it is in the table.
+ * parameters: the table, the block and where to copy its values or NULL.
+ * returns: 1 if the block was removed, 0 if it was not in the table.
+ * ------------------------------------------------------------------------- */
+static int mi_table_remove(mi_table_t* table, void* ptr, mi_live_t* removed)
+{
+   const unsigned mask = table->size - 1;
+   unsigned       seq;
+   unsigned       hole;
+   unsigned       next;
+   int            index;
+
+   /* only the freeing thread removes the block, so once it is found it
+      stays in the table, maybe shifted back, until removed below */
+   do
+   {
+      while ((seq = __atomic_load_n(&table->seq, __ATOMIC_ACQUIRE)) & 1)
+         sched_yield();
+      index = mi_table_index(table, ptr);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   } while (index < 0 && seq != __atomic_load_n(&table->seq, __ATOMIC_RELAXED));
+   if (index < 0)
+      return 0;
+
+   mi_table_lock(table);
+   index = mi_table_index(table, ptr);
+   if ( removed )
+      *removed = table->slots[index];
+
+   /* move the following blocks of the probe sequence into the hole if the
+      hole is between their first slot and their current one */
+   __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   hole = (unsigned)index;
+   __atomic_store_n(&table->slots[hole].ptr, 0, __ATOMIC_RELAXED);
+   for (next = (hole + 1) & mask; table->slots[next].ptr; next = (next + 1) & mask)
+   {
+      const unsigned home = mi_live_hash(table->slots[next].ptr, table->size);
+
+      if (((next - home) & mask) >= ((next - hole) & mask))
+      {
+         mi_live_t* slot = &table->slots[hole];
+
+         slot->size = table->slots[next].size;
+         slot->stack = table->slots[next].stack;
+         slot->time = table->slots[next].time;
+         slot->caller = table->slots[next].caller;
+         __atomic_store_n(&slot->ptr, table->slots[next].ptr, __ATOMIC_RELEASE);
+         __atomic_store_n(&table->slots[next].ptr, 0, __ATOMIC_RELAXED);
+         hole = next;
+      }
+   }
+   __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELEASE);
+   mi_table_unlock(table);
+   return 1;
+} /* mi_table_remove */
+
+/* ------------------------------------------------------------------------- *
+ * mi_profile_open -- allocate the heap profiler hash tables.
+ * parameters: none.
+ * returns: 0 if successful.
+ * ------------------------------------------------------------------------- */
+static int mi_profile_open(void)
+{
+   /* anonymous mappings, only the used pages get memory */
+   s_stacks = mmap(NULL, MI_STACK_SLOTS * sizeof(mi_stack_t), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (MAP_FAILED == s_stacks || mi_table_open(&s_live, MI_LIVE_SLOTS) != 0)
+      return -1;
+   /* the first backtrace() call loads the unwinder, which allocates */
+   {
+      void* pcs[2];
+      backtrace(pcs, 2);
+   }
+   return 0;
+} /* mi_profile_open */
+
+/* ------------------------------------------------------------------------- *
+ * mi_sample_interval -- draw the bytes to the next sample.
+ * parameters: none.
+ * returns: exponentially distributed interval with s_sample_rate mean.
+ * ------------------------------------------------------------------------- */
+static int64_t mi_sample_interval(void)
+{
+   double u;
+
+   /* xorshift64, seeded from the thread local address for every thread */
+   if ( !t_random )
+      t_random = ((uintptr_t)&t_random * 0x9e3779b97f4a7c15ULL) | 1;
+   t_random ^= t_random << 13;
+   t_random ^= t_random >> 7;
+   t_random ^= t_random << 17;
+   u = ((t_random >> 11) + 1) * (1.0 / 9007199254740992.0); /* (0, 1] */
+   return (int64_t)(-log(u) * s_sample_rate) + 1;
+} /* mi_sample_interval */
+
+/* ------------------------------------------------------------------------- *
+ * mi_stack_find -- find or add the allocation stack.
+ * parameters: program counters and their number.
+ * returns: the stack index or -1 if the table is full.
+ * ------------------------------------------------------------------------- */
+static int mi_stack_find(void* const* pcs, int depth)
+{
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   unsigned i;
+   int      d;
+
+   for (d = 0; d < depth; d++)
+      hash = (hash ^ (uintptr_t)pcs[d]) * 0x100000001b3ULL;
+   hash |= 1;
+
+   for (i = 0; i < MI_PROBES; i++)
+   {
+      const unsigned index = (unsigned)(hash + i) & (MI_STACK_SLOTS - 1);
+      mi_stack_t*    stack = &s_stacks[index];
+      uint64_t       found = __atomic_load_n(&stack->hash, __ATOMIC_ACQUIRE);
+
+      if (0 == found && __atomic_compare_exchange_n(&stack->hash, &found, hash, 0,
+                                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      {
+         memcpy(stack->pcs, pcs, depth * sizeof(void*));
+         __atomic_store_n(&stack->depth, depth, __ATOMIC_RELEASE);
+         return (int)index;
+      }
+      if (found != hash)
+         continue;
+      /* the stack may be still copied by the thread which added it */
+      while ( !__atomic_load_n(&stack->depth, __ATOMIC_ACQUIRE) )
+         sched_yield();
+      if (stack->depth == depth && !memcmp(stack->pcs, pcs, depth * sizeof(void*)))
+         return (int)index;
+   }
+   return -1;
+} /* mi_stack_find */
+
+/* ------------------------------------------------------------------------- *
+ * mi_sample -- record a sampled allocation.
+ * parameters: the allocated block and the requested size.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void __attribute__((noinline)) mi_sample(void* ptr, size_t size)
+{
+   void*     pcs[MI_STACK_DEPTH + 1];
+   int       depth;
+   int       stack;
+   mi_live_t live;
+
+   /* the first frame is this function */
+   depth = backtrace(pcs, MI_STACK_DEPTH + 1) - 1;
+   memset(&live, 0, sizeof(live));
+   live.ptr = (uintptr_t)ptr;
+   live.size = size;
+   if (depth <= 0 || (stack = mi_stack_find(pcs + 1, depth)) < 0 ||
+       (live.stack = (unsigned)stack, mi_table_add(&s_live, &live) != 0))
+   {
+      __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+      return;
+   }
+
+   __atomic_fetch_add(&s_stacks[stack].alloc_count, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&s_stacks[stack].alloc_bytes, size, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&s_stacks[stack].inuse_count, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&s_stacks[stack].inuse_bytes, size, __ATOMIC_RELAXED);
+} /* mi_sample */
+
+/* ------------------------------------------------------------------------- *
+ * mi_allocated -- count down the bytes to the next sample.
+ * parameters: the allocated block and the requested size.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static inline void mi_allocated(void* ptr, size_t size)
+{
+   if ((t_sample_left -= (int64_t)size) > 0)
+      return;
+   /* the first allocation of a thread only starts its countdown, and the
+      allocations of backtrace() and the reports are not sampled */
+   if (t_random && !t_sampling)
+   {
+      t_sampling = 1;
+      mi_sample(ptr, size);
+      t_sampling = 0;
+   }
+   t_sample_left = mi_sample_interval();
+} /* mi_allocated */
+
+/* ------------------------------------------------------------------------- *
+ * mi_unsample -- remove a block from the live sampled blocks if it is there.
+ * parameters: the block to be freed, where to copy its values.
+ * returns: 1 if the block was sampled.
+ * ------------------------------------------------------------------------- */
+static int mi_unsample(void* ptr, mi_live_t* live)
+{
+   mi_stack_t* stack;
+
+   if ( !mi_table_remove(&s_live, ptr, live) )
+      return 0;
+   stack = &s_stacks[live->stack];
+   __atomic_fetch_sub(&stack->inuse_count, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_sub(&stack->inuse_bytes, live->size, __ATOMIC_RELAXED);
+   return 1;
+} /* mi_unsample */
+
+/* ------------------------------------------------------------------------- *
+ * mi_resample -- put back a sampled block which was not freed after all.
+ * parameters: the values from mi_unsample().
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_resample(const mi_live_t* live)
+{
+   mi_stack_t* stack = &s_stacks[live->stack];
+
+   if (mi_table_add(&s_live, live) != 0)
+   {
+      __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+      return;
+   }
+   __atomic_fetch_add(&stack->inuse_count, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&stack->inuse_bytes, live->size, __ATOMIC_RELAXED);
+} /* mi_resample */
+
+/* ------------------------------------------------------------------------- *
+ * mi_profile_dump -- write the heap profile in pprof legacy format.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_profile_dump(void)
+{
+   uint64_t totals[4] = { 0, 0, 0, 0 };
+   char     path[256];
+   char     buf[4096];
+   FILE*    fp;
+   unsigned i;
+   int      d;
+   int      fd;
+   ssize_t  len;
+
+   snprintf(path, sizeof(path), MI_PROFILE_FILE, s_dir, getpid(), ++s_profiles);
+   t_sampling = 1;
+   fp = fopen(path, "w");
+   if ( !fp )
+   {
+      t_sampling = 0;
+      return;
+   }
+
+   for (i = 0; i < MI_STACK_SLOTS; i++)
+   {
+      if ( __atomic_load_n(&s_stacks[i].depth, __ATOMIC_ACQUIRE) )
+      {
+         totals[0] += __atomic_load_n(&s_stacks[i].inuse_count, __ATOMIC_RELAXED);
+         totals[1] += __atomic_load_n(&s_stacks[i].inuse_bytes, __ATOMIC_RELAXED);
+         totals[2] += __atomic_load_n(&s_stacks[i].alloc_count, __ATOMIC_RELAXED);
+         totals[3] += __atomic_load_n(&s_stacks[i].alloc_bytes, __ATOMIC_RELAXED);
+      }
+   }
+   fprintf(fp, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%u\n",
+           (unsigned long long)totals[0], (unsigned long long)totals[1],
+           (unsigned long long)totals[2], (unsigned long long)totals[3], s_sample_rate);
+
+   for (i = 0; i < MI_STACK_SLOTS; i++)
+   {
+      const mi_stack_t* stack = &s_stacks[i];
+      const int         depth = __atomic_load_n(&stack->depth, __ATOMIC_ACQUIRE);
+
+      if ( !depth )
+         continue;
+      fprintf(fp, "%llu: %llu [%llu: %llu] @",
+              (unsigned long long)__atomic_load_n(&stack->inuse_count, __ATOMIC_RELAXED),
+              (unsigned long long)__atomic_load_n(&stack->inuse_bytes, __ATOMIC_RELAXED),
+              (unsigned long long)__atomic_load_n(&stack->alloc_count, __ATOMIC_RELAXED),
+              (unsigned long long)__atomic_load_n(&stack->alloc_bytes, __ATOMIC_RELAXED));
+      for (d = 0; d < depth; d++)
+         fprintf(fp, " %p", stack->pcs[d]);
+      fputc('\n', fp);
+   }
+
+   /* pprof symbolizes the addresses with the mappings */
+   fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+   fflush(fp);
+   fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+   if (fd >= 0)
+   {
+      while ((len = read(fd, buf, sizeof(buf))) > 0)
+         fwrite(buf, 1, len, fp);
+      close(fd);
+   }
+   fclose(fp);
+   t_sampling = 0;
+
+#if TOOL_LOGO
+   if ( __atomic_load_n(&s_dropped, __ATOMIC_RELAXED) )
+      fprintf(stderr, "%s: %llu samples dropped, hash tables full\n", TOOL_NAME,
+              (unsigned long long)__atomic_load_n(&s_dropped, __ATOMIC_RELAXED));
+#endif
+} /* mi_profile_dump */
+
+/* ------------------------------------------------------------------------- *
+ * mi_elapsed -- get the time since application start.
+ * parameters: none.
+ * returns: elapsed time in milliseconds.
+ * ------------------------------------------------------------------------- */
+static unsigned mi_elapsed(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (unsigned)((ts.tv_sec - s_epoch.tv_sec) * 1000 + (ts.tv_nsec - s_epoch.tv_nsec) / 1000000);
+} /* mi_elapsed */
+
+/* ------------------------------------------------------------------------- *
+ * mi_leaks_open -- allocate the live block tracker tables.
+ * parameters: none.
+ * returns: 0 if successful.
+ * ------------------------------------------------------------------------- */
+static int mi_leaks_open(void)
+{
+   /* anonymous mappings, only the used pages get memory */
+   s_sites = mmap(NULL, MI_LEAK_SITES * sizeof(mi_site_t), PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   return (MAP_FAILED == s_sites || mi_table_open(&s_leaks, MI_LEAK_SLOTS) != 0 ? -1 : 0);
+} /* mi_leaks_open */
+
+/* ------------------------------------------------------------------------- *
+ * mi_track -- add a large block to the live tracked blocks.
+ * parameters: the allocated block, the requested size and the return
+ *             address of the allocation call.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_track(void* ptr, size_t size, void* caller)
+{
+   mi_live_t live;
+
+   memset(&live, 0, sizeof(live));
+   live.ptr = (uintptr_t)ptr;
+   live.size = size;
+   live.time = mi_elapsed();
+   live.caller = caller;
+   if (mi_table_add(&s_leaks, &live) != 0)
+      __atomic_fetch_add(&s_leak_dropped, 1, __ATOMIC_RELAXED);
+} /* mi_track */
+
+/* ------------------------------------------------------------------------- *
+ * mi_untrack -- remove a block from the live tracked blocks if it is there.
+ * parameters: the block to be freed, where to copy its values.
+ * returns: 1 if the block was tracked.
+ * ------------------------------------------------------------------------- */
+static int mi_untrack(void* ptr, mi_live_t* live)
+{
+   /* a block smaller than the threshold was requested smaller too, so the
+      lookup is done only for the blocks which can be tracked */
+   return (s_next.usable_size(ptr) >= s_leak_min && mi_table_remove(&s_leaks, ptr, live));
+} /* mi_untrack */
+
+/* ------------------------------------------------------------------------- *
+ * mi_site_find -- find or add the call site of a live block report.
+ * parameters: the return address of the allocation call.
+ * returns: the call site or NULL if the table is full.
+ * ------------------------------------------------------------------------- */
+static mi_site_t* mi_site_find(void* caller)
+{
+   const unsigned hash = mi_live_hash((uintptr_t)caller, MI_LEAK_SITES);
+   unsigned       i;
+
+   for (i = 0; i < MI_PROBES; i++)
+   {
+      mi_site_t* site = &s_sites[(hash + i) & (MI_LEAK_SITES - 1)];
+
+      if ( !site->caller )
+         site->caller = caller;
+      if (site->caller == caller)
+         return site;
+   }
+   return NULL;
+} /* mi_site_find */
+
+/* ------------------------------------------------------------------------- *
+ * mi_site_bytes -- get the live bytes of a call site.
+ * parameters: the call site.
+ * returns: the bytes of all ages.
+ * ------------------------------------------------------------------------- */
+static uint64_t mi_site_bytes(const mi_site_t* site)
+{
+   uint64_t bytes = 0;
+   int      i;
+
+   for (i = 0; i < MI_AGE_BUCKETS; i++)
+      bytes += site->bytes[i];
+   return bytes;
+} /* mi_site_bytes */
+
+/* ------------------------------------------------------------------------- *
+ * mi_site_compare -- qsort() comparison putting the largest sites first.
+ * parameters: the call sites.
+ * returns: the comparison result.
+ * ------------------------------------------------------------------------- */
+static int mi_site_compare(const void* a, const void* b)
+{
+   const uint64_t bytes_a = mi_site_bytes((const mi_site_t*)a);
+   const uint64_t bytes_b = mi_site_bytes((const mi_site_t*)b);
+
+   return (bytes_a < bytes_b) - (bytes_a > bytes_b);
+} /* mi_site_compare */
+
+/* ------------------------------------------------------------------------- *
+ * mi_site_write -- write a call site line of a live block report.
+ * parameters: the report file, the call site, its name if it is not an
+ *             address.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_site_write(FILE* fp, const mi_site_t* site, const char* name)
+{
+   uint64_t count = 0;
+   Dl_info  info;
+   int      i;
+
+   for (i = 0; i < MI_AGE_BUCKETS; i++)
+      count += site->count[i];
+   fprintf(fp, "%12llu %8llu", (unsigned long long)mi_site_bytes(site), (unsigned long long)count);
+   for (i = 0; i < MI_AGE_BUCKETS; i++)
+      fprintf(fp, " %11llu", (unsigned long long)site->bytes[i]);
+
+   if ( name )
+      fprintf(fp, "  %s\n", name);
+   else if (dladdr(site->caller, &info) && info.dli_fname)
+   {
+      /* the file offset is for addr2line, the symbol only if exported */
+      fprintf(fp, "  %p", site->caller);
+      if ( info.dli_sname )
+         fprintf(fp, " %s+%#lx", info.dli_sname, (unsigned long)((char*)site->caller - (char*)info.dli_saddr));
+      fprintf(fp, " (%s+%#lx)\n", info.dli_fname, (unsigned long)((char*)site->caller - (char*)info.dli_fbase));
+   }
+   else
+      fprintf(fp, "  %p\n", site->caller);
+} /* mi_site_write */
+
+/* ------------------------------------------------------------------------- *
+ * mi_leaks_dump -- write the live tracked blocks by call site and age.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_leaks_dump(void)
+{
+   /* age bucket limits in ms, the last bucket has the older blocks */
+   static const unsigned limits[MI_AGE_BUCKETS - 1] = { 1000, 10000, 60000, 600000, 3600000 };
+   static const char*    names[MI_AGE_BUCKETS] = { "<1s", "<10s", "<1min", "<10min", "<1h", ">=1h" };
+   const unsigned tm = mi_elapsed();
+   mi_site_t      total;
+   mi_site_t      other;
+   char           path[256];
+   FILE*          fp;
+   unsigned       used = 0;
+   unsigned       i;
+   int            age;
+
+   memset(s_sites, 0, MI_LEAK_SITES * sizeof(mi_site_t));
+   memset(&total, 0, sizeof(total));
+   memset(&other, 0, sizeof(other));
+
+   /* the blocks are neither added nor shifted while they are counted */
+   mi_table_lock(&s_leaks);
+   for (i = 0; i < MI_LEAK_SLOTS; i++)
+   {
+      const mi_live_t* live = &s_leaks.slots[i];
+      const size_t     size = live->size;
+      mi_site_t*       site;
+      int              elapsed;
+
+      if ( !live->ptr )
+         continue;
+      /* the blocks allocated after the report time are the youngest */
+      elapsed = (int)(tm - live->time);
+      for (age = 0; age < MI_AGE_BUCKETS - 1; age++)
+         if (elapsed < (int)limits[age])
+            break;
+      if ( !(site = mi_site_find(live->caller)) )
+         site = &other;
+      site->count[age]++;
+      site->bytes[age] += size;
+      total.count[age]++;
+      total.bytes[age] += size;
+   }
+   mi_table_unlock(&s_leaks);
+
+   /* the used sites to the start of the table, the largest first */
+   for (i = 0; i < MI_LEAK_SITES; i++)
+      if ( s_sites[i].caller )
+         s_sites[used++] = s_sites[i];
+   qsort(s_sites, used, sizeof(mi_site_t), mi_site_compare);
+
+   snprintf(path, sizeof(path), MI_LEAKS_FILE, s_dir, getpid(), ++s_leak_reports);
+   fp = fopen(path, "w");
+   if ( !fp )
+      return;
+   fprintf(fp, "# live blocks of %zu bytes or more at %u.%03u s, %llu blocks not tracked\n",
+           s_leak_min, tm / 1000, tm % 1000,
+           (unsigned long long)__atomic_load_n(&s_leak_dropped, __ATOMIC_RELAXED));
+   fprintf(fp, "#%11s %8s", "bytes", "blocks");
+   for (age = 0; age < MI_AGE_BUCKETS; age++)
+      fprintf(fp, " %11s", names[age]);
+   fprintf(fp, "  %s\n", "caller");
+   mi_site_write(fp, &total, "total");
+   for (i = 0; i < used; i++)
+      mi_site_write(fp, &s_sites[i], NULL);
+   if ( mi_site_bytes(&other) )
+      mi_site_write(fp, &other, "other");
+   fclose(fp);
+} /* mi_leaks_dump */
+
+/* ------------------------------------------------------------------------- *
+ * mi_owners_open -- allocate the sampled block owners hash table.
+ * parameters: none.
+ * returns: 0 if successful.
+ * ------------------------------------------------------------------------- */
+static int mi_owners_open(void)
+{
+   return mi_table_open(&s_owners, MI_OWNER_SLOTS);
+} /* mi_owners_open */
+
+/* ------------------------------------------------------------------------- *
+ * mi_owner_sampled -- check if the owner of a block address is tracked.
+ * parameters: the block.
+ * returns: non-zero for one address in 2^MI_OWNER_SHIFT.
+ * ------------------------------------------------------------------------- */
+static inline int mi_owner_sampled(void* ptr)
+{
+   /* the top bits of the hash, the table slot is taken from the middle */
+   return !((((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL) >> (64 - MI_OWNER_SHIFT));
+} /* mi_owner_sampled */
+
+/* ------------------------------------------------------------------------- *
+ * mi_own -- record the allocating thread of a sampled block.
+ * parameters: the allocated block.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_own(void* ptr)
+{
+   mi_live_t live;
+
+   if ( !mi_owner_sampled(ptr) )
+      return;
+   /* a block not recorded is not counted when it is freed */
+   memset(&live, 0, sizeof(live));
+   live.ptr = (uintptr_t)ptr;
+   live.owner = mi_counters_slot(mi_counters_self());
+   mi_table_add(&s_owners, &live);
+} /* mi_own */
+
+/* ------------------------------------------------------------------------- *
+ * mi_disown -- remove a sampled block from the owners table.
+ * parameters: the block to be freed, where to copy its owner.
+ * returns: 1 if the owner of the block was recorded.
+ * ------------------------------------------------------------------------- */
+static int mi_disown(void* ptr, mi_live_t* live)
+{
+   return (mi_owner_sampled(ptr) && mi_table_remove(&s_owners, ptr, live));
+} /* mi_disown */
+
+/* ------------------------------------------------------------------------- *
+ * mi_freed -- count the free of a sampled block allocated by another thread.
+ * parameters: the owner from mi_disown().
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_freed(const mi_live_t* live)
+{
+   mi_counters_t* counters = mi_counters_self();
+
+   /* the threads beyond the slots share the counters and one owner */
+   if (live->owner != mi_counters_slot(counters))
+      MI_ADD(counters, remote_frees, 1u << MI_OWNER_SHIFT);
+} /* mi_freed */
+
+/* ------------------------------------------------------------------------- *
+ * mi_now -- get the monotonic clock.
+ * parameters: none.
+ * returns: the time in nanoseconds.
+ * ------------------------------------------------------------------------- */
+static inline uint64_t mi_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* mi_now */
+
+/* ------------------------------------------------------------------------- *
+ * mi_clock_start, mi_clock_stop -- time every MI_TIME_RATE-th allocator
+ *           call of the thread.
+ * parameters: mi_clock_stop takes the start time and non-zero for a free.
+ * returns: mi_clock_start returns the start time or 0 if the call is not
+ *          timed.
+ * ------------------------------------------------------------------------- */
+static inline uint64_t mi_clock_start(void)
+{
+   if (!s_threads || --t_time_left > 0)
+      return 0;
+   t_time_left = MI_TIME_RATE;
+   return mi_now();
+} /* mi_clock_start */
+
+static void mi_clock_stop(uint64_t start, int free)
+{
+   const uint64_t ns = (mi_now() - start) * MI_TIME_RATE;
+   mi_counters_t* counters = mi_counters_self();
+
+   if ( free )
+      MI_ADD(counters, free_ns, ns);
+   else
+      MI_ADD(counters, alloc_ns, ns);
+} /* mi_clock_stop */
+
+/* ------------------------------------------------------------------------- *
+ * mi_dump_thread -- write the counters of a thread into the trace.
+ * parameters: milliseconds since application start, the counters slot
+ *             (MI_MAX_THREADS for the shared counters) and its counters.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_dump_thread(unsigned elapsed, unsigned slot, const mi_counters_t* counters)
+{
+   mi_trace_record_t* record = mi_trace_write(elapsed, TRACE_THREAD(slot));
+
+   record->values[0] = (uint64_t)__atomic_load_n(&counters->tid, __ATOMIC_RELAXED);
+   record->values[1] = __atomic_load_n(&counters->allocs, __ATOMIC_RELAXED);
+   record->values[2] = __atomic_load_n(&counters->frees, __ATOMIC_RELAXED);
+   record->values[3] = __atomic_load_n(&counters->reallocs, __ATOMIC_RELAXED);
+   record->values[4] = __atomic_load_n(&counters->alloc_bytes, __ATOMIC_RELAXED);
+   record->values[5] = __atomic_load_n(&counters->free_bytes, __ATOMIC_RELAXED);
+   record->values[6] = __atomic_load_n(&counters->remote_frees, __ATOMIC_RELAXED);
+   record->values[7] = __atomic_load_n(&counters->alloc_ns, __ATOMIC_RELAXED);
+   record->values[8] = __atomic_load_n(&counters->free_ns, __ATOMIC_RELAXED);
+   mi_trace_commit();
+} /* mi_dump_thread */
+
+/* ------------------------------------------------------------------------- *
+ * mi_dump_threads -- write the counters of every thread into the trace.
+ * parameters: milliseconds since application start.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_dump_threads(unsigned elapsed)
+{
+   const unsigned used = __atomic_load_n(&s_counters_used, __ATOMIC_ACQUIRE);
+   unsigned       i;
+
+   /* a released slot is written again when a new thread takes it */
+   for (i = 0; i < used && i < MI_MAX_THREADS; i++)
+      if ( __atomic_load_n(&s_counters[i].owned, __ATOMIC_ACQUIRE) )
+         mi_dump_thread(elapsed, i, &s_counters[i]);
+   if (used > MI_MAX_THREADS)
+      mi_dump_thread(elapsed, MI_MAX_THREADS, &s_shared);
+} /* mi_dump_threads */
+
+/* ------------------------------------------------------------------------- *
+ * mi_dump -- Dump trace information into the trace ring.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+
+static void mi_dump(void)
+{
+   /* Got the tracing information first */
+   const unsigned     tm = mi_elapsed();
+   const uintptr_t    bk = (uintptr_t)sbrk(0);
+   mi_info_t          mi;
+   mi_trace_record_t* record;
+
+   record = mi_trace_write(tm, -1);
+   switch (s_allocator)
+   {
+      case MI_JEMALLOC:
+         mi_read_jemalloc(&mi, record->values);
+         break;
+      case MI_TCMALLOC:
+         mi_read_tcmalloc(&mi, record->values);
+         break;
+      default:
+         mi_read(&mi);
+         record->values[0] = mi.arena;
+         record->values[1] = mi.ordblks;
+         record->values[2] = mi.smblks;
+         record->values[3] = mi.hblks;
+         record->values[4] = mi.hblkhd;
+         record->values[5] = mi.usmblks;
+         record->values[6] = mi.fsmblks;
+         record->values[7] = mi.uordblks;
+         record->values[8] = mi.fordblks;
+         record->values[9] = mi.keepcost;
+         break;
+   }
+   record->values[10] = bk;
+   s_last = mi;
+   s_last_time = tm;
+   if ( s_counting )
+      mi_counters_sum(&record->values[11]);
+   mi_trace_commit();
+
+   if ( s_shm )
+      mi_shm_publish(tm, &mi);
+
+   if ( s_threads )
+      mi_dump_threads(tm);
+   if (s_arenas && MI_JEMALLOC == s_allocator)
+      mi_dump_jemalloc_arenas(tm);
+   else if (s_arenas && MI_GLIBC == s_allocator)
+      mi_dump_arenas(tm);
+} /* mi_dump */
+
+/* ------------------------------------------------------------------------- *
+ * mi_rss -- get the resident memory of the process.
+ * parameters: none.
+ * returns: resident memory in kB, 0 if not available.
+ * ------------------------------------------------------------------------- */
+
+static unsigned long mi_rss(void)
+{
+   unsigned long size = 0;
+   unsigned long resident = 0;
+   FILE*         fp = fopen("/proc/self/statm", "r");
+
+   if ( !fp )
+      return 0;
+   if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+      resident = 0;
+   fclose(fp);
+   return resident * (sysconf(_SC_PAGESIZE) / 1024);
+} /* mi_rss */
+
+/* ------------------------------------------------------------------------- *
+ * mi_trim -- trim the heap if the latest reports had too much free memory,
+ *           purge jemalloc arenas or release tcmalloc page heap.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+
+static void mi_trim(void)
+{
+   const unsigned tm = s_last_time;
+   unsigned long  before;
+   unsigned long  after;
+   unsigned long  rss = 0;
+
+   if (s_last.fordblks < s_trim)
+   {
+      s_trim_since = 0;
+      return;
+   }
+   /* the trimmed pages are still counted as free heap, so after a trim only
+      the RSS growth can be resident free heap. RSS can drop also for other
+      reasons (freed mmapped blocks), so the baseline follows it down */
+   if ( s_trim_rss )
+   {
+      rss = mi_rss();
+      if (rss < s_trim_rss)
+         s_trim_rss = rss;
+      if (rss < s_trim_rss + (s_trim >> 10))
+      {
+         s_trim_since = 0;
+         return;
+      }
+   }
+   /* the times are stored +1, so 0 means not set */
+   if ( !s_trim_since )
+      s_trim_since = tm + 1;
+   if (tm + 1 - s_trim_since < s_trim_hold)
+      return;
+   if (s_trim_last && tm + 1 - s_trim_last < s_trim_interval)
+      return;
+
+   before = rss ? rss : mi_rss();
+   mi_release();
+   after = mi_rss();
+   s_trim_rss = after;
+   s_trim_last = mi_elapsed() + 1;
+   s_trim_since = 0;
+
+#if TOOL_LOGO
+   fprintf(stderr, "%s: trimmed at %u.%03u, free heap %zu kB, keepcost %zu kB, RSS %lu -> %lu kB (%ld kB returned)\n",
+           TOOL_NAME, tm / 1000, tm % 1000, s_last.fordblks >> 10, s_last.keepcost >> 10,
+           before, after, (long)before - (long)after);
+#endif
+} /* mi_trim */
+
+/* ------------------------------------------------------------------------- *
+ * mi_request -- signal handler requesting a report from the sampler thread.
+ * parameters: signal number.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+
+static void mi_request(int signo)
+{
+   /* only async-signal-safe calls here, the report is written by the thread */
+   const int      saved = errno;
+   const uint64_t one = 1;
+   ssize_t        rc;
+
+   (void)signo;
+   rc = write(s_event, &one, sizeof(one));
+   (void)rc;
+   errno = saved;
+} /* mi_request */
+
+/* ------------------------------------------------------------------------- *
+ * mi_sampler -- sampler thread writing the periodic and requested reports.
+ * parameters: unused.
+ * returns: NULL.
+ * ------------------------------------------------------------------------- */
+
+static void* mi_sampler(void* arg)
+{
+   struct pollfd fds[4];
+   uint64_t      count;
+
+   (void)arg;
+   fds[0].fd = s_event;
+   fds[0].events = POLLIN;
+   fds[1].fd = s_timer;     /* poll ignores the negative descriptors */
+   fds[1].events = POLLIN;
+   fds[2].fd = s_profile_timer;
+   fds[2].events = POLLIN;
+   fds[3].fd = s_leak_timer;
+   fds[3].events = POLLIN;
+
+   while ( !s_stop )
+   {
+      if (poll(fds, 4, -1) < 0)
+      {
+         if (EINTR == errno)
+            continue;
+         break;
+      }
+      /* reading resets the counters, missed timer expirations give one report */
+      if ((fds[0].revents & POLLIN) && read(s_event, &count, sizeof(count)) > 0 && !s_stop)
+      {
+         mi_dump();
+         if ( s_profiling )
+            mi_profile_dump();
+         if ( s_tracking )
+            mi_leaks_dump();
+      }
+      else if ((fds[1].revents & POLLIN) && read(s_timer, &count, sizeof(count)) > 0)
+      {
+         mi_dump();
+         if ( s_trim )
+            mi_trim();
+      }
+      if ((fds[2].revents & POLLIN) && read(s_profile_timer, &count, sizeof(count)) > 0)
+         mi_profile_dump();
+      if ((fds[3].revents & POLLIN) && read(s_leak_timer, &count, sizeof(count)) > 0)
+         mi_leaks_dump();
+   }
+   return NULL;
+} /* mi_sampler */
+
+/* ------------------------------------------------------------------------- *
+ * mi_timer -- create a periodic timer.
+ * parameters: the period in milliseconds.
+ * returns: the timerfd or -1 in the case of failure.
+ * ------------------------------------------------------------------------- */
+
+static int mi_timer(unsigned period)
+{
+   struct itimerspec spec;
+   const int         fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+   if (fd < 0)
+      return -1;
+   spec.it_interval.tv_sec = period / 1000;
+   spec.it_interval.tv_nsec = (period % 1000) * 1000000;
+   spec.it_value = spec.it_interval;
+   timerfd_settime(fd, 0, &spec, NULL);
+   return fd;
+} /* mi_timer */
+
+/* ------------------------------------------------------------------------- *
+ * mi_start -- create the timers and start the sampler thread.
+ * parameters: none.
+ * returns: 0 if the thread was started.
+ * ------------------------------------------------------------------------- */
+
+static int mi_start(void)
+{
+   sigset_t set;
+   sigset_t old;
+   int      rc;
+
+   s_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (s_event < 0)
+      return -1;
+
+   if (s_period && (s_timer = mi_timer(s_period)) < 0)
+      return -1;
+   if (s_profiling && s_profile_period && (s_profile_timer = mi_timer(s_profile_period * 1000)) < 0)
+      return -1;
+   if (s_tracking && s_leak_period && (s_leak_timer = mi_timer(s_leak_period * 1000)) < 0)
+      return -1;
+
+   /* the thread blocks all signals, so they are still delivered to the
+      application threads as before */
+   sigfillset(&set);
+   pthread_sigmask(SIG_SETMASK, &set, &old);
+   rc = pthread_create(&s_thread, NULL, mi_sampler, NULL);
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+   if (rc != 0)
+      return -1;
+
+   if ( s_signal )
+      signal(s_signal, mi_request);
+   return 0;
+} /* mi_start */
+
+/* ========================================================================= *
+ * initializer and finalizer that allowed static linking.
+ * ========================================================================= */
+
+static void mi_init(void) __attribute__((constructor));
+static void mi_fini(void) __attribute__((destructor));
+
+/* ------------------------------------------------------------------------- *
+ * mi_atfork_child -- drop the reporting state inherited by a forked child.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+
+static void mi_atfork_child(void)
+{
+   /* the child has no sampler thread, and the trace ring and the shared
+      memory segment are the parent's, so the child doesn't report, and it
+      doesn't write the profiles of the parent's blocks at exit */
+   s_period = 0;
+   s_signal = 0;
+   s_profiling = 0;
+   s_tracking = 0;
+   s_threads = 0;
+   if ( s_shm )
+   {
+      /* only unmapped, the segment stays for the parent */
+      munmap(s_shm, sizeof(mallinfo_shm_t));
+      s_shm = NULL;
+   }
+   if ( s_trace )
+   {
+      munmap(s_trace, sizeof(mi_trace_header_t) + (size_t)s_trace->capacity * sizeof(mi_trace_record_t));
+      s_trace = NULL;
+      s_records = NULL;
+   }
+} /* mi_atfork_child */
+
+ /* ------------------------------------------------------------------------- *
+ * mi_init -- this function shall be called by Loader when library is loaded.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+
+static void mi_init(void)
+{
+   const char* value = getenv(TOOL_VAR);
+
+   if (value && *value)
+   {
+      /* Variables for storing signal and period */
+      const unsigned signum = mi_get(value, "signal", 0);
+      const unsigned period = mi_get(value, "period", 0);
+      const unsigned interval = mi_get(value, "interval", 0);
+      const unsigned records = mi_get(value, "records", TOOL_RECORDS);
+      const unsigned counters = mi_get(value, "counters", 0);
+      const unsigned shm = mi_get(value, "shm", 0);
+      const unsigned threads = mi_get(value, "threads", 0);
+
+      /* Initialize all variables first */
+      clock_gettime(CLOCK_MONOTONIC, &s_epoch);
+      mi_get_str(value, "dir", getenv("HOME"), s_dir, sizeof(s_dir));
+      snprintf(s_path, sizeof(s_path), TOOL_FILE, s_dir, getpid());
+      s_sample_rate = mi_get(value, "profile", 0);
+      s_profile_period = mi_get(value, "profile_period", 0);
+      s_leak_min = mi_get_size(value, "leaks", 0);
+      s_leak_period = mi_get(value, "leaks_period", TOOL_LEAKS_PERIOD);
+      s_allocator = mi_detect();
+      s_trim = mi_get_size(value, "trim", 0);
+      s_trim_hold = mi_get(value, "trim_hold", TOOL_TRIM_HOLD) * 1000;
+      s_trim_interval = mi_get(value, "trim_interval", TOOL_TRIM_INTERVAL) * 1000;
+      s_arenas = (int)mi_get(value, "arenas", 0);
+
+      /* Setting the working values according to passed */
+      if ( interval )
+         s_period = interval;
+      else if ( period )
+         s_period = period * 1000;
+      else if ( !signum )
+      {
+         /* No period or signal set but variable is exists -> using defaults */
+         s_period = TOOL_PERIOD;
+      }
+      s_signal = (int)signum;
+
+#if TOOL_LOGO
+      fprintf(stderr, "%s version %s build %s %s\n", TOOL_NAME, TOOL_VERS, __DATE__, __TIME__);
+      fprintf(stderr, "(c) 2005 Nokia\n\n");
+
+      fprintf(stderr, "detected variable %s with value '%s'\n", TOOL_VAR, value);
+      if ( s_signal )
+         fprintf(stderr, "signal %d (%s) is used for reporting\n", s_signal, strsignal(s_signal));
+      if ( s_period )
+         fprintf(stderr, "report will be created every %u ms\n", s_period);
+      fprintf(stderr, "report file %s (%u records)\n", s_path, records);
+      if (s_allocator != MI_GLIBC)
+         fprintf(stderr, "%s statistics are reported\n", MI_JEMALLOC == s_allocator ? "jemalloc" : "tcmalloc");
+      if ( s_arenas )
+         fprintf(stderr, "per-arena reports are enabled\n");
+      if (counters || threads)
+         fprintf(stderr, "allocation calls are counted%s\n", threads ? " per thread" : "");
+      if ( s_sample_rate )
+         fprintf(stderr, "heap profile sampled every %u bytes\n", s_sample_rate);
+      if ( s_leak_min )
+         fprintf(stderr, "live blocks of %zu bytes or more tracked\n", s_leak_min);
+      if ( shm )
+         fprintf(stderr, "reports published in shared memory /mallinfo-%d\n", getpid());
+      if ( s_trim )
+         fprintf(stderr, "heap trimmed when %zu kB free for %u s, at most every %u s\n",
+                 s_trim >> 10, s_trim_hold / 1000, s_trim_interval / 1000);
+#endif
+
+      if (mi_trace_open(records) != 0)
+      {
+         fprintf(stderr, "%s: failed to create %s (%s)\n", TOOL_NAME, s_path, strerror(errno));
+         s_period = 0;
+         s_signal = 0;
+         return;
+      }
+      pthread_atfork(NULL, NULL, mi_atfork_child);
+      if (MI_JEMALLOC == s_allocator)
+         s_trace->flags |= TRACE_JEMALLOC;
+      else if (MI_TCMALLOC == s_allocator)
+         s_trace->flags |= TRACE_TCMALLOC;
+      /* counting is switched on only when the thread slots can be released */
+      if ((counters || threads) && pthread_key_create(&s_counters_key, mi_counters_release) == 0)
+      {
+         s_trace->flags |= TRACE_COUNTERS;
+         __atomic_store_n(&s_counting, 1, __ATOMIC_RELEASE);
+         if (threads && mi_owners_open() == 0)
+         {
+            s_trace->flags |= TRACE_THREADS;
+            __atomic_store_n(&s_threads, 1, __ATOMIC_RELEASE);
+         }
+      }
+      if (shm && mi_shm_open() != 0)
+         fprintf(stderr, "%s: failed to create shared memory %s (%s)\n", TOOL_NAME, s_shm_name, strerror(errno));
+      if (s_sample_rate && mi_profile_open() == 0)
+         __atomic_store_n(&s_profiling, 1, __ATOMIC_RELEASE);
+      if (s_leak_min && mi_leaks_open() == 0)
+         __atomic_store_n(&s_tracking, 1, __ATOMIC_RELEASE);
+      if (mi_start() != 0)
+      {
+         fprintf(stderr, "%s: failed to start sampler thread (%s)\n", TOOL_NAME, strerror(errno));
+         s_period = 0;
+         s_signal = 0;
+         return;
+      }
+      /* We should report first line if periodic reports are switched on */
+      if ( s_period )
+         mi_dump();
+   }
+} /* mi_init */
+
+/* ------------------------------------------------------------------------- *
+ * mi_fini -- this function shall be called by Loader when library is unloaded.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+
+static void mi_fini(void)
+{
+   if ( s_period || s_signal )
+   {
+      const uint64_t one = 1;
+
+      /* the requests arriving after this are ignored by the exiting thread */
+      s_stop = 1;
+      if (write(s_event, &one, sizeof(one)) > 0)
+         pthread_join(s_thread, NULL);
+   }
+   /* We should report the last line if periodic reports are used */
+   if ( s_period )
+      mi_dump();
+   if ( s_profiling )
+      mi_profile_dump();
+   if ( s_tracking )
+      mi_leaks_dump();
+   if ( s_shm )
+   {
+      munmap(s_shm, sizeof(mallinfo_shm_t));
+      shm_unlink(s_shm_name);
+      s_shm = NULL;
+   }
+   if ( s_trace )
+   {
+      munmap(s_trace, sizeof(mi_trace_header_t) + (size_t)s_trace->capacity * sizeof(mi_trace_record_t));
+      s_trace = NULL;
+   }
+#if TOOL_LOGO
+   if ( s_period || s_signal )
+      fprintf(stderr, "\n%s finalization completed\n", TOOL_NAME);
+#endif
+} /* mi_fini */
+
+/* ========================================================================= *
+ * Interposed allocator functions, counting the calls with counters=1,
+ * timing them and tracking the block owners with threads=1, sampling the
+ * allocations with profile=BYTES and tracking the large blocks with
+ * leaks=SIZE.
+ * ========================================================================= */
+
+/* ------------------------------------------------------------------------- *
+ * mi_resolve -- find the next allocator functions, called once.
+ * parameters: none.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static void mi_resolve(void)
+{
+   mi_next_t next;
+   void*     (*next_malloc)(size_t size);
+
+   t_resolving = 1;
+   *(void**)&next.malloc = dlsym(RTLD_NEXT, "malloc");
+   *(void**)&next.calloc = dlsym(RTLD_NEXT, "calloc");
+   *(void**)&next.realloc = dlsym(RTLD_NEXT, "realloc");
+   *(void**)&next.free = dlsym(RTLD_NEXT, "free");
+   *(void**)&next.memalign = dlsym(RTLD_NEXT, "memalign");
+   *(void**)&next.usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+   t_resolving = 0;
+   if (!next.malloc || !next.calloc || !next.realloc || !next.free ||
+       !next.memalign || !next.usable_size)
+   {
+      static const char msg[] = TOOL_NAME ": allocator functions not found\n";
+      ssize_t rc = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+      (void)rc;
+      abort();
+   }
+
+   /* the threads which see malloc set see the other functions too */
+   next_malloc = next.malloc;
+   next.malloc = NULL;
+   s_next = next;
+   __atomic_store_n(&s_next.malloc, next_malloc, __ATOMIC_RELEASE);
+} /* mi_resolve */
+
+/* ------------------------------------------------------------------------- *
+ * mi_bootstrap -- allocate from the static buffer while resolving.
+ * parameters: size.
+ * returns: zeroed block, the size is stored before it.
+ * ------------------------------------------------------------------------- */
+static void* mi_bootstrap(size_t size)
+{
+   size_t need;
+   size_t used;
+   char*  ptr;
+
+   if (size > sizeof(s_bootstrap))
+      return NULL;
+   need = 16 + ((size + 15) & ~(size_t)15);
+   used = __atomic_fetch_add(&s_bootstrap_used, need, __ATOMIC_RELAXED);
+   if (used + need > sizeof(s_bootstrap))
+      return NULL;
+   ptr = s_bootstrap + used;
+   *(size_t*)ptr = size;
+   return ptr + 16;
+} /* mi_bootstrap */
+
+#define MI_IS_BOOTSTRAP(ptr) \
+   ((char*)(ptr) >= s_bootstrap && (char*)(ptr) < s_bootstrap + sizeof(s_bootstrap))
+
+/* resolves the next allocator, or serves the allocations of dlsym(), the
+   other threads wait in pthread_once() until the functions are set */
+#define MI_RESOLVE(size) \
+   if ( !__atomic_load_n(&s_next.malloc, __ATOMIC_ACQUIRE) ) \
+   { \
+      if ( t_resolving ) \
+         return mi_bootstrap(size); \
+      pthread_once(&s_resolve_once, mi_resolve); \
+   }
+
+/* ------------------------------------------------------------------------- *
+ * mi_alloc_hook -- account a new block.
+ * parameters: the allocated block, the requested size and the return
+ *             address of the allocation call.
+ * returns: none.
+ * ------------------------------------------------------------------------- */
+static inline void mi_alloc_hook(void* ptr, size_t size, void* caller)
+{
+   if ( !ptr )
+      return;
+   if ( s_counting )
+      mi_count(1, 0, 0, s_next.usable_size(ptr), 0, size);
+   if ( s_profiling )
+      mi_allocated(ptr, size);
+   if (s_tracking && size >= s_leak_min)
+      mi_track(ptr, size, caller);
+   if ( s_threads )
+      mi_own(ptr);
+} /* mi_alloc_hook */
+
+/* ------------------------------------------------------------------------- *
+ * mi_malloc, mi_memalign -- allocate for the interposed functions.
+ * parameters: the allocation arguments and the return address of the
+ *             application call.
+ * returns: the allocated block.
+ * ------------------------------------------------------------------------- */
+static inline __attribute__((always_inline)) void* mi_malloc(size_t size, void* caller)
+{
+   uint64_t start;
+   void*    ptr;
+
+   MI_RESOLVE(size);
+   start = mi_clock_start();
+   ptr = s_next.malloc(size);
+   if ( start )
+      mi_clock_stop(start, 0);
+   mi_alloc_hook(ptr, size, caller);
+   return ptr;
+} /* mi_malloc */
+
+static inline __attribute__((always_inline)) void* mi_memalign(size_t alignment, size_t size, void* caller)
+{
+   uint64_t start;
+   void*    ptr;
+
+   MI_RESOLVE(size);
+   start = mi_clock_start();
+   ptr = s_next.memalign(alignment, size);
+   if ( start )
+      mi_clock_stop(start, 0);
+   mi_alloc_hook(ptr, size, caller);
+   return ptr;
+} /* mi_memalign */
+
+void* malloc(size_t size)
+{
+   return mi_malloc(size, __builtin_return_address(0));
+} /* malloc */
+
+void* calloc(size_t nmemb, size_t size)
+{
+   uint64_t start;
+   void*    ptr;
+
+   MI_RESOLVE(nmemb * size);
+   start = mi_clock_start();
+   ptr = s_next.calloc(nmemb, size);
+   if ( start )
+      mi_clock_stop(start, 0);
+   mi_alloc_hook(ptr, nmemb * size, __builtin_return_address(0));
+   return ptr;
+} /* calloc */
+
+void* realloc(void* ptr, size_t size)
+{
+   mi_live_t sampled;
+   mi_live_t tracked;
+   mi_live_t owned;
+   int       was_sampled = 0;
+   int       was_tracked = 0;
+   int       was_owned = 0;
+   uint64_t  start;
+   size_t    old;
+   void*     res;
+
+   MI_RESOLVE(size);
+   if ( !ptr )
+      return mi_malloc(size, __builtin_return_address(0));
+   if ( MI_IS_BOOTSTRAP(ptr) )
+   {
+      /* the bootstrap blocks are never freed */
+      old = ((size_t*)ptr)[-2];
+      res = mi_malloc(size, __builtin_return_address(0));
+      if ( res )
+         memcpy(res, ptr, old < size ? old : size);
+      return res;
+   }
+   if (!s_counting && !s_profiling && !s_tracking)
+      return s_next.realloc(ptr, size);
+
+   /* the old block must leave the tables before another thread can get
+      its address, and is put back if it is not freed after all */
+   old = s_next.usable_size(ptr);
+   if ( s_profiling )
+      was_sampled = mi_unsample(ptr, &sampled);
+   if ( s_tracking )
+      was_tracked = mi_untrack(ptr, &tracked);
+   if ( s_threads )
+      was_owned = mi_disown(ptr, &owned);
+   start = mi_clock_start();
+   res = s_next.realloc(ptr, size);
+   if ( start )
+      mi_clock_stop(start, 0);
+   if (!res && size)
+   {
+      if ( was_sampled )
+         mi_resample(&sampled);
+      if (was_tracked && mi_table_add(&s_leaks, &tracked) != 0)
+         __atomic_fetch_add(&s_leak_dropped, 1, __ATOMIC_RELAXED);
+      if ( was_owned )
+         mi_table_add(&s_owners, &owned);
+      return NULL;
+   }
+   if ( was_owned )
+      mi_freed(&owned);
+   if ( s_counting )
+   {
+      if ( res )
+         mi_count(0, 0, 1, s_next.usable_size(res), old, size);
+      else if ( !size )
+         mi_count(0, 1, 0, 0, old, 0);   /* realloc(ptr, 0) frees the block */
+   }
+   if (s_profiling && res)
+      mi_allocated(res, size);
+   if (s_tracking && res && size >= s_leak_min)
+      mi_track(res, size, __builtin_return_address(0));
+   if (s_threads && res)
+      mi_own(res);
+   return res;
+} /* realloc */
+
+void free(void* ptr)
+{
+   mi_live_t live;
+   uint64_t  start;
+
+   if (!ptr || MI_IS_BOOTSTRAP(ptr))
+      return;
+   if ( s_counting )
+      mi_count(0, 1, 0, 0, s_next.usable_size(ptr), 0);
+   if ( s_profiling )
+      mi_unsample(ptr, &live);
+   if ( s_tracking )
+      mi_untrack(ptr, &live);
+   if (s_threads && mi_disown(ptr, &live))
+      mi_freed(&live);
+   start = mi_clock_start();
+   s_next.free(ptr);
+   if ( start )
+      mi_clock_stop(start, 1);
+} /* free */
+
+void* memalign(size_t alignment, size_t size)
+{
+   return mi_memalign(alignment, size, __builtin_return_address(0));
+} /* memalign */
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+   return mi_memalign(alignment, size, __builtin_return_address(0));
+} /* aligned_alloc */
+
+int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+   void* ptr;
+
+   if (alignment % sizeof(void*) || (alignment & (alignment - 1)) || !alignment)
+      return EINVAL;
+   ptr = mi_memalign(alignment, size, __builtin_return_address(0));
+   if ( !ptr )
+      return ENOMEM;
+   *memptr = ptr;
+   return 0;
+} /* posix_memalign */
+
+void* valloc(size_t size)
+{
+   return mi_memalign(sysconf(_SC_PAGESIZE), size, __builtin_return_address(0));
+} /* valloc */
+
+void* pvalloc(size_t size)
+{
+   const size_t page = sysconf(_SC_PAGESIZE);
+
+   return mi_memalign(page, (size + page - 1) & ~(page - 1), __builtin_return_address(0));
+} /* pvalloc */
+
+size_t malloc_usable_size(void* ptr)
+{
+   if ( !ptr )
+      return 0;
+   if ( MI_IS_BOOTSTRAP(ptr) )
+      return ((size_t*)ptr)[-2];
+   if ( !__atomic_load_n(&s_next.malloc, __ATOMIC_ACQUIRE) )
+      pthread_once(&s_resolve_once, mi_resolve);
+   return s_next.usable_size(ptr);
+} /* malloc_usable_size */
 
 /* ========================================================================= *
  *                    No more code in file mallinfo.c                        *
@@ -56,6 +56,7 @@
 #define _GNU_SOURCE
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -73,10 +74,25 @@
 #include <dirent.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <spawn.h>
+#include <wordexp.h>
 
 #include <sp_measure.h>
 
 #include "sp_report.h"
+#include "mem-cpu-shm.h"
+#include "mem-cpu-proc.h"
+#include "mem-cpu-trend.h"
+#include "mem-cpu-tree.h"
+#include "mem-cpu-startup.h"
+#include "mem-cpu-replay.h"
+#include "proc-root.h"
+#include "mem-cpu-overhead.h"
+#include "mem-cpu-sysstat.h"
+#include "mem-cpu-perf.h"
+#include "mem-cpu-taskstats.h"
+#include "mallinfo-shm.h"
 
 
 static const char progname[] = "mem-cpu-monitor";
@@ -124,11 +140,30 @@ static bool colors = true;
 
 #define HEADER_TITLE_TIMESTAMP   "time:"
 
+/* default leak trend detection window in hours */
+#define DEFAULT_TREND_WINDOW     1.0
+/* slope t-statistic needed for reporting a leak trend */
+#define TREND_TSTAT_THRESHOLD    3.0
+
+/* default startup profiling window (ms) and sampling interval (ms) */
+#define DEFAULT_STARTUP_WINDOW   5000
+#define DEFAULT_STARTUP_INTERVAL 5
+#define MAX_STARTUP_INTERVAL     10
+
 // Die gracefully when we get interrupted with Ctrl-C. Makes it easier to see
 // memory leaks with Valgrind.
 static volatile sig_atomic_t quit = 0;
+
+// Startup profile of the first --exec application, updated also by SIGCHLD handler.
+static startup_t startup;
 static void quit_app(int sig) { (void)sig; if (quit++) _exit(1); }
 
+/* self-overhead measurement of the sampling loop phases, if enabled */
+#define OVERHEAD_BEGIN(app_data, phase) \
+	if ((app_data)->overhead) overhead_begin((app_data)->overhead, phase)
+#define OVERHEAD_END(app_data, phase) \
+	if ((app_data)->overhead) overhead_end((app_data)->overhead, phase)
+
 /* a mark to print for process data when process is not available */
 #define NO_DATA    "n/a"
 
@@ -178,8 +213,35 @@ usage()
 		"     -n, --name=NAME       Monitor processes starting with name NAME.\n"
 		"     -N, --name-created=NAME   Monitor processes created with name NAME.\n"
 		"     -h, --help            Display this help.\n"
-		"     -x, --exec=CMD        Executes and starts monitoring the CMD command line.\n"
+		"     -x, --exec=CMD        Executes and starts monitoring the CMD command line. Variables, ~ and\n"
+		"                           globs are expanded as in shell, but | & ; < > ( ) { } must be quoted.\n"
 		"     -G, --cgroup=NAME     Monitors memory.memsw.usage_in_bytes for root or pointed cgroup e.g. applications.\n"
+		"         --shm=NAME        Publish every sample into POSIX shared memory segment NAME (see mem-cpu-shm.h).\n"
+		"         --leak-trend[=HOURS]   Detect steady growth of process dirty memory, PSS, file descriptor,\n"
+		"                           thread and memory mapping counts over HOURS long window (default %.0f).\n"
+		"         --tree            Include all descendants of the monitored processes into aggregated tree columns.\n"
+		"         --tree-details=FILE    Write per-process breakdown of the trees to FILE in CSV format.\n"
+		"         --startup[=SECONDS[,MSEC]]   Sample memory usage of the --exec application every MSEC\n"
+		"                           (1-%d, default %d) milliseconds during the first SECONDS (default %d)\n"
+		"                           and report the peak usage and resource usage at exit.\n"
+		"         --record=FILE     Write every sample into binary recording FILE.\n"
+		"         --replay=FILE     Replay recorded run (binary recording or text report) applying\n"
+		"                           the -m, -c, -M, -C thresholds and -i interval aggregation.\n"
+		"         --proc-root=DIR   Read /proc and /sys files from DIR/proc and DIR/sys instead (also\n"
+		"                           %s environment variable), for example a synthetic fixture.\n"
+		"                           mem-proc-capture archive snapshots are processed at full speed.\n"
+		"         --overhead        Show the monitor CPU time per sampling phase, system calls, kilobytes\n"
+		"                           read and tick lateness of the previous tick, and summarize them at exit.\n"
+		"         --columns=LIST    Comma separated process columns, appended to the defaults if LIST\n"
+		"                           starts with '+': clean, dirty, change, cpu (default), pss, uss, rss,\n"
+		"                           swap, anon, file, shmem, vmsize, vmhwm, threads, fds, minflt,\n"
+		"                           majflt, io, syscio, cancelled, sched, delay, perf, numa, heap. Only\n"
+		"                           the data needed by the columns is collected.\n"
+		"         --system-io       Show system page-in/out and physical disk read/write rates.\n"
+		"         --vmstat          Show system page fault, swap, reclaim scan/steal (kswapd and direct),\n"
+		"                           compaction stall, OOM kill and refault rates from /proc/vmstat.\n"
+		"         --numa            Show used and free memory of each NUMA node and NUMA allocation\n"
+		"                           hit, miss and foreign rates.\n"
 		"\n"
 		"Examples:\n"
 		"\n"
@@ -192,8 +254,9 @@ usage()
 		"   Monitor PIDS 1234 and 5678 with default interval:\n"
 		"        %s -p 1234 -p 5678\n"
 		"\n",
-		progname, progname, DEFAULT_SLEEP_INTERVAL / 1000000, progname, progname,
-		progname, progname);
+		progname, progname, DEFAULT_SLEEP_INTERVAL / 1000000, progname, DEFAULT_TREND_WINDOW,
+		MAX_STARTUP_INTERVAL, DEFAULT_STARTUP_INTERVAL, DEFAULT_STARTUP_WINDOW / 1000,
+		PROC_ROOT_ENV, progname, progname, progname);
 }
 
 static const struct option long_opts[] = {
@@ -211,6 +274,19 @@ static const struct option long_opts[] = {
 	{"name-created", 1, 0, 'N'},
 	{"exec", 1, 0, 'x'},
 	{"cgroup", 1, 0, 'G'},
+	{"shm", 1, 0, 1003},
+	{"leak-trend", 2, 0, 1004},
+	{"tree", 0, 0, 1005},
+	{"tree-details", 1, 0, 1006},
+	{"startup", 2, 0, 1007},
+	{"record", 1, 0, 1008},
+	{"replay", 1, 0, 1009},
+	{"proc-root", 1, 0, 1010},
+	{"overhead", 0, 0, 1011},
+	{"columns", 1, 0, 1012},
+	{"system-io", 0, 0, 1013},
+	{"vmstat", 0, 0, 1014},
+	{"numa", 0, 0, 1015},
 	{0,0,0,0}
 };
 
@@ -223,6 +299,142 @@ typedef struct proc_name_t {
 } proc_name_t;
 
 
+/**
+ * Leak trend monitored process values.
+ */
+enum {
+	TREND_DIRTY,
+	TREND_PSS,
+	TREND_FDS,
+	TREND_THREADS,
+	TREND_MAPS,
+	TREND_COUNT
+};
+
+static const struct {
+	/* value name for alerts */
+	const char* name;
+	/* value unit for alerts */
+	const char* unit;
+	/* value tag for the leak column */
+	char tag;
+} trend_values[TREND_COUNT] = {
+	[TREND_DIRTY]   = {"dirty memory", "kB", 'D'},
+	[TREND_PSS]     = {"PSS", "kB", 'P'},
+	[TREND_FDS]     = {"file descriptors", "", 'F'},
+	[TREND_THREADS] = {"threads", "", 'T'},
+	[TREND_MAPS]    = {"memory mappings", "", 'M'},
+};
+
+/**
+ * The per-process collectors other than libsp-measure and /proc/<pid>/.
+ */
+enum {
+	/* perf_event software counters */
+	PROC_COLLECTOR_PERF = 1 << 0,
+	/* per-thread scheduler statistics */
+	PROC_COLLECTOR_SCHEDSTAT = 1 << 1,
+	/* taskstats delay accounting */
+	PROC_COLLECTOR_TASKSTATS = 1 << 2,
+	/* per NUMA node resident memory from numa_maps */
+	PROC_COLLECTOR_NUMA = 1 << 3,
+	/* heap statistics published by mallinfo.so */
+	PROC_COLLECTOR_HEAP = 1 << 4,
+};
+
+/**
+ * Selectable process column.
+ */
+typedef struct proc_column_t {
+	/* the column name in --columns specification */
+	const char* name;
+	/* the column title and width, NULL title for a column per NUMA node */
+	const char* title;
+	int width;
+	sp_report_cell_write_fn write;
+	/* the libsp-measure (SNAPSHOT_PROC_*) and /proc/<pid>/ (PROC_STAT_*)
+	 * data sources needed by the column */
+	int snapshot_flags;
+	int stat_flags;
+	/* the other collectors needed by the column (PROC_COLLECTOR_*) */
+	int collectors;
+} proc_column_t;
+
+/* maximum number of the selected process columns */
+#define MAX_PROC_COLUMNS    32
+
+/* the default process columns */
+#define DEFAULT_PROC_COLUMNS   "clean,dirty,change,cpu"
+
+/**
+ * System statistics rate column data.
+ */
+typedef struct sys_stat_column_t {
+	const struct app_data_t* app_data;
+	/* the counter offset in sys_stat_t */
+	size_t offset;
+} sys_stat_column_t;
+
+/* the system vmstat rate columns */
+static const struct {
+	const char* title;
+	int width;
+	size_t offset;
+} vmstat_columns[] = {
+	{"flt:", 7, offsetof(sys_stat_t, pgfault)},
+	{"majflt:", 7, offsetof(sys_stat_t, pgmajfault)},
+	{"swpin:", 7, offsetof(sys_stat_t, pswpin)},
+	{"swpout:", 7, offsetof(sys_stat_t, pswpout)},
+	{"scan-k:", 7, offsetof(sys_stat_t, pgscan_kswapd)},
+	{"scan-d:", 7, offsetof(sys_stat_t, pgscan_direct)},
+	{"steal-k:", 8, offsetof(sys_stat_t, pgsteal_kswapd)},
+	{"steal-d:", 8, offsetof(sys_stat_t, pgsteal_direct)},
+	{"compact:", 8, offsetof(sys_stat_t, compact_stall)},
+	{"oom:", 4, offsetof(sys_stat_t, oom_kill)},
+	{"refault:", 8, offsetof(sys_stat_t, workingset_refault)},
+};
+
+#define VMSTAT_COLUMN_COUNT   (int)(sizeof(vmstat_columns) / sizeof(vmstat_columns[0]))
+
+/* the system NUMA allocation rate columns */
+static const struct {
+	const char* title;
+	int width;
+	size_t offset;
+} numa_columns[] = {
+	{"hit:", 8, offsetof(sys_stat_t, numa_hit)},
+	{"miss:", 7, offsetof(sys_stat_t, numa_miss)},
+	{"foreign:", 8, offsetof(sys_stat_t, numa_foreign)},
+};
+
+#define NUMA_COLUMN_COUNT   (int)(sizeof(numa_columns) / sizeof(numa_columns[0]))
+
+/**
+ * NUMA node column data.
+ */
+typedef struct node_column_t {
+	/* the application or process data */
+	const void* data;
+	int node;
+} node_column_t;
+
+/* interval of the per-process numa_maps reads (ms). Generating the file
+ * walks the whole process address space, so it's not read on every
+ * update with short intervals */
+#define NUMA_MAPS_INTERVAL   10000
+
+/* interval of the attempts to open the mallinfo.so heap statistics
+ * segment of a process which hasn't published one (ms) */
+#define HEAP_SHM_INTERVAL    5000
+
+/**
+ * Self-overhead phase column data.
+ */
+typedef struct overhead_column_t {
+	const overhead_t* overhead;
+	int phase;
+} overhead_column_t;
+
 /**
  * Process data structure.
  *
@@ -244,6 +456,58 @@ typedef struct proc_data_t {
 
 	int resource_flags;
 
+	/* leak trend detection */
+	trend_t trend[TREND_COUNT];
+	/* bitmask of the values growing with high confidence */
+	int trend_growing;
+
+	/* the latest /proc/<pid>/ statistics for the selected columns and
+	 * the statistics at the previous report, for the rate columns */
+	proc_stat_t stat;
+	proc_stat_t stat_prev;
+	/* /proc/<pid>/io kept open between updates, -1 if not opened and
+	 * -2 if not accessible */
+	int io_fd;
+
+	/* perf_event software counters, the latest and the previous report
+	 * values. The state is 0 if not attached, 1 if attached and -1 if
+	 * attaching failed */
+	proc_perf_t perf;
+	int perf_state;
+
+	/* accumulated per-thread scheduler statistics */
+	proc_schedstat_t schedstat;
+
+	/* the delays of the exited child processes */
+	taskstats_delays_t exited_delays;
+
+	/* resident memory per NUMA node (kB), the updates left until the
+	 * next numa_maps read and the per node column data */
+	int numa_nodes[SYS_STAT_MAX_NODES];
+	int numa_countdown;
+	node_column_t numa_columns[SYS_STAT_MAX_NODES];
+
+	/* mallinfo.so heap statistics segment, NULL if not opened, the
+	 * latest sample and the updates left until the next open attempt */
+	mallinfo_shm_t* heap_shm;
+	mallinfo_shm_sample_t heap;
+	bool heap_valid;
+	int heap_countdown;
+
+	long long perf_values[PROC_PERF_COUNT];
+	long long perf_values_prev[PROC_PERF_COUNT];
+
+	/* process tree, when monitoring descendants */
+	proc_tree_t* tree;
+	/* tree CPU time at the previous and latest snapshot */
+	unsigned long long tree_cpu1;
+	unsigned long long tree_cpu2;
+
+	/* CPU ticks and private dirty memory change since the last report
+	 * at the previous sample, for the per-sample changes */
+	int sample_cpu_ticks;
+	int sample_mem_change;
+
 	sp_report_header_t* header;
 
 	struct app_data_t* app_data;
@@ -263,6 +527,9 @@ typedef struct cgroup_data_t {
 	char* name;
 	const char* path;
 
+	/* used memory change since the last report at the previous sample */
+	int sample_mem_change;
+
 	struct cgroup_data_t* next;
 } cgroup_data_t;
 
@@ -282,6 +549,20 @@ typedef struct app_data_t {
 	sp_measure_sys_data_t* sys_data1;
 	sp_measure_sys_data_t* sys_data2;
 
+	/* additional system statistics snapshots, like sys_data */
+	int sys_stat_flags;
+	bool system_io;
+	bool system_vmstat;
+	sys_stat_column_t vmstat_columns[VMSTAT_COLUMN_COUNT];
+	bool system_numa;
+	sys_stat_column_t numa_columns[NUMA_COLUMN_COUNT];
+	node_column_t node_columns[SYS_STAT_MAX_NODES];
+	/* number of NUMA nodes for the system and process NUMA columns */
+	int node_count;
+	sys_stat_t sys_stat[2];
+	sys_stat_t* sys_stat1;
+	sys_stat_t* sys_stat2;
+
 	proc_data_t* proc_list;
 	int proc_count;
 
@@ -300,6 +581,52 @@ typedef struct app_data_t {
 
 	/* cgroup data */
 	cgroup_data_t* cgroups;
+
+	/* leak trend detection window in hours, 0 if disabled */
+	double trend_window;
+
+	/* process tree monitoring */
+	bool tree_mode;
+	FILE* tree_details;
+
+	/* startup profiling window and sampling interval (ms), 0 if disabled */
+	int startup_window;
+	int startup_interval;
+
+	/* shared memory snapshot publishing */
+	char* shm_name;
+	mem_cpu_shm_t* shm;
+
+	/* binary recording */
+	char* record_path;
+	FILE* record;
+	/* recorded run to replay */
+	char* replay_path;
+
+	/* the latest sample for shared memory and recording */
+	mem_cpu_shm_sample_t* sample;
+	uint64_t tick;
+	/* the system changes since the last report at the previous sample:
+	 * CPU ticks, the CPU usage and frequency weighted with the ticks and
+	 * used memory change, for the per-sample changes */
+	int sample_ticks;
+	long long sample_cpu_usage;
+	long long sample_cpu_freq;
+	int sample_mem_change;
+
+	/* the selected process columns */
+	const proc_column_t* columns[MAX_PROC_COLUMNS];
+	int column_count;
+	/* the process data sources needed by the columns and other options */
+	int proc_snapshot_flags;
+	int proc_stat_flags;
+	int proc_collectors;
+	/* taskstats connection for the delay columns, NULL if not used */
+	taskstats_t* taskstats;
+
+	/* self-overhead statistics, NULL if disabled */
+	overhead_t* overhead;
+	overhead_column_t overhead_columns[OVERHEAD_PHASE_COUNT];
 } app_data_t;
 
 /* function declarations */
@@ -512,6 +839,203 @@ write_sys_cpu_freq(char* buffer, int size, void* args)
 	return sizeof(NO_DATA) - 1;
 }
 
+/**
+ * Gets the time between the system snapshots.
+ *
+ * @param[in] self   the application data.
+ * @return           the interval in milliseconds.
+ */
+static int
+app_data_get_interval(const app_data_t* self)
+{
+	int interval = FIELD_SYS_TIMESTAMP(self->sys_data2) - FIELD_SYS_TIMESTAMP(self->sys_data1);
+	/* the timestamps are milliseconds since midnight */
+	if (interval < 0) interval += 24 * 60 * 60 * 1000;
+	return interval;
+}
+
+/**
+ * Writes counter change rate per second.
+ *
+ * @param[in] value1    the counter value in the previous snapshot.
+ * @param[in] value2    the counter value in the latest snapshot.
+ * @param[in] interval  the time between the snapshots (msecs).
+ * @param[in] divisor   the counter unit divisor.
+ */
+static int
+write_rate(char* buffer, int size, long long value1, long long value2, int interval, int divisor)
+{
+	/* a counter could also be reset, when a device is removed */
+	if (value1 < 0 || value2 < value1 || interval <= 0) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%lld", ((value2 - value1) * 1000 / interval + divisor / 2) / divisor);
+}
+
+/**
+ * Writes system page-in rate (kB/s).
+ */
+int
+write_sys_io_pgpgin(char* buffer, int size, void* args)
+{
+	app_data_t* data = (app_data_t*)args;
+	return write_rate(buffer, size, data->sys_stat1->pgpgin, data->sys_stat2->pgpgin, app_data_get_interval(data), 1);
+}
+
+/**
+ * Writes system page-out rate (kB/s).
+ */
+int
+write_sys_io_pgpgout(char* buffer, int size, void* args)
+{
+	app_data_t* data = (app_data_t*)args;
+	return write_rate(buffer, size, data->sys_stat1->pgpgout, data->sys_stat2->pgpgout, app_data_get_interval(data), 1);
+}
+
+/**
+ * Writes physical disk read rate (kB/s).
+ */
+int
+write_sys_io_disk_read(char* buffer, int size, void* args)
+{
+	app_data_t* data = (app_data_t*)args;
+	return write_rate(buffer, size, data->sys_stat1->disk_read_sectors, data->sys_stat2->disk_read_sectors,
+			app_data_get_interval(data), 2);
+}
+
+/**
+ * Writes physical disk write rate (kB/s).
+ */
+int
+write_sys_io_disk_write(char* buffer, int size, void* args)
+{
+	app_data_t* data = (app_data_t*)args;
+	return write_rate(buffer, size, data->sys_stat1->disk_write_sectors, data->sys_stat2->disk_write_sectors,
+			app_data_get_interval(data), 2);
+}
+
+/**
+ * Writes physical disk read operation rate (ops/s).
+ */
+int
+write_sys_io_disk_reads(char* buffer, int size, void* args)
+{
+	app_data_t* data = (app_data_t*)args;
+	return write_rate(buffer, size, data->sys_stat1->disk_reads, data->sys_stat2->disk_reads, app_data_get_interval(data), 1);
+}
+
+/**
+ * Writes physical disk write operation rate (ops/s).
+ */
+int
+write_sys_io_disk_writes(char* buffer, int size, void* args)
+{
+	app_data_t* data = (app_data_t*)args;
+	return write_rate(buffer, size, data->sys_stat1->disk_writes, data->sys_stat2->disk_writes, app_data_get_interval(data), 1);
+}
+
+/**
+ * Writes system vmstat counter rate (events or pages per second).
+ */
+int
+write_sys_stat_rate(char* buffer, int size, void* args)
+{
+	sys_stat_column_t* column = (sys_stat_column_t*)args;
+	const app_data_t* data = column->app_data;
+	return write_rate(buffer, size, *(const long long*)((const char*)data->sys_stat1 + column->offset),
+			*(const long long*)((const char*)data->sys_stat2 + column->offset), app_data_get_interval(data), 1);
+}
+
+/**
+ * Writes used memory of a NUMA node (kB).
+ */
+int
+write_sys_node_used(char* buffer, int size, void* args)
+{
+	node_column_t* column = (node_column_t*)args;
+	const app_data_t* data = (const app_data_t*)column->data;
+	int total = data->sys_stat2->node_total[column->node];
+	int free = data->sys_stat2->node_free[column->node];
+	if (total == SYS_STAT_UNDEFINED || free == SYS_STAT_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%d", total - free);
+}
+
+/**
+ * Writes free memory of a NUMA node (kB).
+ */
+int
+write_sys_node_free(char* buffer, int size, void* args)
+{
+	node_column_t* column = (node_column_t*)args;
+	const app_data_t* data = (const app_data_t*)column->data;
+	int free = data->sys_stat2->node_free[column->node];
+	if (free == SYS_STAT_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%d", free);
+}
+
+/**
+ * Writes monitor CPU time of a phase during the previous tick (usec).
+ */
+int
+write_overhead_phase(char* buffer, int size, void* args)
+{
+	overhead_column_t* column = (overhead_column_t*)args;
+	if (!column->overhead->ticks) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%llu", column->overhead->phases[column->phase].tick_cpu / 1000);
+}
+
+/**
+ * Writes monitor read, write and open calls during the previous tick.
+ */
+int
+write_overhead_syscalls(char* buffer, int size, void* args)
+{
+	overhead_t* overhead = (overhead_t*)args;
+	if (!overhead->ticks || overhead->io_fd < 0) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%llu", overhead->syscalls.tick);
+}
+
+/**
+ * Writes kilobytes read by the monitor during the previous tick.
+ */
+int
+write_overhead_read(char* buffer, int size, void* args)
+{
+	overhead_t* overhead = (overhead_t*)args;
+	if (!overhead->ticks || overhead->io_fd < 0) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%llu", (overhead->bytes_read.tick + 512) / 1024);
+}
+
+/**
+ * Writes the previous tick lateness versus the schedule (usec).
+ */
+int
+write_overhead_lateness(char* buffer, int size, void* args)
+{
+	overhead_t* overhead = (overhead_t*)args;
+	if (!overhead->ticks) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%llu", overhead->lateness.tick);
+}
+
 /**
  * Writes process private clean memory size (Kb).
  */
@@ -571,769 +1095,2626 @@ write_proc_cpu_usage(char* buffer, int size, void* args)
 	return snprintf(buffer, size + 1, "%5.1f%%", total_ticks ? (float)proc_ticks * 100 / total_ticks : 0);
 }
 
-/*
- * End of writer functions.
- */
-
-
-/*
- * Executes expression and checks the return value for warnings/errors
+/**
+ * Writes tags of the process values that are steadily growing.
  */
-#define CHECK_SNAPSHOT_RC(expression, text, ...) { \
-	int __rc = expression; \
-	if (__rc < 0) { \
-		fprintf(stderr, "ERROR: " text " Aborting.\n", __VA_ARGS__);\
-		exit(-1);\
-	}\
-	if (__rc > 0) { \
-		fprintf(stderr, "Warning: " text " Some data might be absent.\n", __VA_ARGS__);\
-	}\
+int
+write_proc_leak_trend(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	int i, len = 0;
+	for (i = 0; i < TREND_COUNT && len < size; i++) {
+		if (proc->trend_growing & (1 << i)) {
+			buffer[len++] = trend_values[i].tag;
+		}
+	}
+	if (!len) buffer[len++] = '-';
+	buffer[len] = '\0';
+	return len;
 }
 
 /**
- * Initializes system snapshots.
- *
- * @param self[in]   application data.
- * @return           0 for success.
+ * Writes process statistics value.
  */
 static int
-app_data_init_sys_snapshots(app_data_t* self)
+write_proc_stat_value(char* buffer, int size, long long value)
 {
-	int rc = 0;
-
-	CHECK_SNAPSHOT_RC(sp_measure_init_sys_data(&self->sys_data[0], self->resource_flags, NULL),
-			"system /proc/ data snapshot initialization returned (%x).", rc |= __rc);
-
-	CHECK_SNAPSHOT_RC(sp_measure_init_sys_data(&self->sys_data[1], 0, &self->sys_data[0]),
-			"system /proc/ data snapshot initialization returned (%x).", rc |= __rc);
-
-	/* initialize cgroups */
-	cgroup_data_t* cgroup = self->cgroups;
-	while (cgroup) {
-		cgroup_init(cgroup);
-		cgroup = cgroup->next;
+	if (value == PROC_STAT_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
 	}
+	return snprintf(buffer, size + 1, "%lld", value);
+}
 
-	/* take initial system snapshot */
-	CHECK_SNAPSHOT_RC(sp_measure_get_sys_data(&self->sys_data[0], self->resource_flags, NULL),
-			"System resource usage initial snapshot returned (%x).", rc = __rc);
+/**
+ * Writes process proportional set size (kB).
+ */
+int
+write_proc_pss(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.pss);
+}
 
-	if (rc & SNAPSHOT_SYS_MEM_WATERMARK) {
-		fprintf(stderr, "Note: (Maemo) kernel memory limits not found.\n");
+/**
+ * Writes process unique set size, the private clean and dirty memory (kB).
+ */
+int
+write_proc_uss(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	if (proc->stat.private_clean == PROC_STAT_UNDEFINED || proc->stat.private_dirty == PROC_STAT_UNDEFINED) {
+		return write_proc_stat_value(buffer, size, PROC_STAT_UNDEFINED);
 	}
+	return write_proc_stat_value(buffer, size, proc->stat.private_clean + proc->stat.private_dirty);
+}
 
-	self->resource_flags &= (~rc);
-
-	self->sys_data1 = &self->sys_data[0];
-	self->sys_data2 = &self->sys_data[1];
+/**
+ * Writes process resident set size (kB).
+ */
+int
+write_proc_rss(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.rss);
+}
 
-	return rc;
+/**
+ * Writes process swapped out memory (kB).
+ */
+int
+write_proc_swap(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.swap);
 }
 
 /**
- * Creates system information headers(columns).
- *
- * @param self[in]   application data.
- * @return           0 for success.
+ * Writes process resident anonymous memory (kB).
  */
-static int
-app_data_create_header(app_data_t* self)
+int
+write_proc_anon(char* buffer, int size, void* args)
 {
-	memset(&self->root_header, 0, sizeof(sp_report_header_t));
-	/* timestamp header */
-	if (sp_report_header_add_child(&self->root_header, HEADER_TITLE_TIMESTAMP, 12, SP_REPORT_ALIGN_CENTER, write_sys_timestamp, (void*)self) == NULL) return -ENOMEM;
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.rss_anon);
+}
 
-	/* watermarks header if necessary */
-	if (self->resource_flags & SNAPSHOT_SYS_MEM_WATERMARK) {
-		self->watermark_header = sp_report_header_add_child(&self->root_header, "BL", 2, SP_REPORT_ALIGN_CENTER, write_sys_mem_watermark, (void*)self);
-		if (self->watermark_header == NULL) return -ENOMEM;
-	}
+/**
+ * Writes process resident file backed memory (kB).
+ */
+int
+write_proc_file(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.rss_file);
+}
 
-	/* memory header containing used system memory and it's change from the previous snapshot columns */
-	sp_report_header_t* mem_header = sp_report_header_add_child(&self->root_header, "system memory", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
-	if (mem_header == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(mem_header, "used:", 10, SP_REPORT_ALIGN_RIGHT, write_sys_mem_used, (void*)self) == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(mem_header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_sys_mem_change, (void*)self) == NULL) return -ENOMEM;
-
-	/* cgroups headers */
-	cgroup_data_t* cgroup = self->cgroups;
-	int index = 1;
-	while (cgroup) {
-		char group_title[512];
-		snprintf(group_title, sizeof(group_title), "[%s]", strrchr(cgroup->path, '/') + 1);
-		sp_report_header_t* cgroup_header = sp_report_header_add_child(&self->root_header, group_title, 0, SP_REPORT_ALIGN_CENTER, NULL, NULL);
-		if (cgroup_header == NULL) return -ENOMEM;
-		if (colors) {
-			hlight_t* hlight = &hlight_cgroup[(index++) & 1];
-			sp_report_header_set_color(cgroup_header, hlight->set, hlight->clear);
-		}
-	    if (sp_report_header_add_child(cgroup_header, "used:", 10, SP_REPORT_ALIGN_RIGHT, write_sys_mem_cgroup_used, (void*)cgroup) == NULL) return -ENOMEM;
-	    if (sp_report_header_add_child(cgroup_header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_sys_mem_cgroup_change, (void*)cgroup) == NULL) return -ENOMEM;
-		cgroup = cgroup->next;
-	}
-
-	/* cpu header containing cpu usage and average frequency columns */
-	sp_report_header_t* cpu_header = sp_report_header_add_child(&self->root_header, "system CPU", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
-	if (cpu_header == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(cpu_header, "%:", 6, SP_REPORT_ALIGN_RIGHT, write_sys_cpu_usage, (void*)self) == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(cpu_header, "MHz:", 5, SP_REPORT_ALIGN_RIGHT, write_sys_cpu_freq, (void*)self) == NULL) return -ENOMEM;
+/**
+ * Writes process resident shared memory (kB).
+ */
+int
+write_proc_shmem(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.rss_shmem);
+}
 
+/**
+ * Writes process virtual memory size (kB).
+ */
+int
+write_proc_vmsize(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.vm_size);
+}
 
-	/* create headers for monitored processes */
-	proc_data_t* proc = self->proc_list;
-	index = 0;
-	while (proc) {
-		proc_data_create_header(proc, self, index++);
-		proc = proc->next;
-	}
+/**
+ * Writes process resident set size high water mark (kB).
+ */
+int
+write_proc_vmhwm(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.vm_hwm);
+}
 
-	return 0;
+/**
+ * Writes process thread count.
+ */
+int
+write_proc_threads(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.threads);
 }
 
 /**
- * Initializes application data.
- *
- * @param self[in]   application data.
- * @return           0 for success.
+ * Writes process open file descriptor count.
  */
-static int
-app_data_init(app_data_t* self)
+int
+write_proc_fds(char* buffer, int size, void* args)
 {
-	int rc;
-	if ( (rc = app_data_init_sys_snapshots(self)) < 0) return rc;
-	if ( (rc = app_data_create_header(self)) != 0) return rc;
-	return 0;
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.fds);
 }
 
+/**
+ * Writes process minor page fault count.
+ */
+int
+write_proc_minflt(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.minflt);
+}
 
 /**
- * Initializes timestamp printing options.
- *
- * This function checks if the millisecond part of timestamps should be
- * printed and makes necessary header adjustments.
- * The timestamps are printed only when the decimal part of update interval
- * is specified.
- * @param self
- * @return
+ * Writes process major page fault count.
  */
-static int
-app_data_init_timestamps(app_data_t* self)
+int
+write_proc_majflt(char* buffer, int size, void* args)
 {
-	self->timestamp_print_msecs = self->sleep_interval % 1000000;
-	if (!self->timestamp_print_msecs) {
-		sp_report_header_set_title(self->root_header.child, HEADER_TITLE_TIMESTAMP, 8, SP_REPORT_ALIGN_RIGHT);
-	}
-	return 0;
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_stat_value(buffer, size, proc->stat.majflt);
 }
 
 /**
- * Releases application data resources allocated by app_data_init() function/
+ * Writes process I/O counter rate per second.
  *
- * @param self[in]   application data.
- * @return           0 for success.
+ * @param[in] proc     the process data.
+ * @param[in] offset   the counter offset in proc_stat_t.
+ * @param[in] divisor  the counter unit divisor.
  */
 static int
-app_data_release(app_data_t* self)
+write_proc_io_rate(char* buffer, int size, const proc_data_t* proc, size_t offset, int divisor)
 {
-	sp_measure_free_sys_data(&self->sys_data[0]);
-	sp_measure_free_sys_data(&self->sys_data[1]);
-
-	sp_report_header_free(self->root_header.child);
-	self->root_header.child = NULL;
-
-	/* free monitored process names */
-	int i;
-	for (i = 0; i < self->name_index; i++) {
-		free(self->name_list[i].name);
-	}
+	long long value1 = *(const long long*)((const char*)&proc->stat_prev + offset);
+	long long value2 = *(const long long*)((const char*)&proc->stat + offset);
+	return write_rate(buffer, size, value1, value2, app_data_get_interval(proc->app_data), divisor);
+}
 
-	/* free cgroup data */
-	cgroup_data_t* cgroup = self->cgroups;
-	while (cgroup) {
-		cgroup_data_t* next = cgroup->next;
-		cgroup_free(cgroup);
-		cgroup = next;
-	}
+/**
+ * Writes process storage read rate (kB/s).
+ */
+int
+write_proc_io_read(char* buffer, int size, void* args)
+{
+	return write_proc_io_rate(buffer, size, (proc_data_t*)args, offsetof(proc_stat_t, read_bytes), 1024);
+}
 
+/**
+ * Writes process storage write rate (kB/s).
+ */
+int
+write_proc_io_write(char* buffer, int size, void* args)
+{
+	return write_proc_io_rate(buffer, size, (proc_data_t*)args, offsetof(proc_stat_t, write_bytes), 1024);
+}
 
+/**
+ * Writes process read system call rate (calls/s).
+ */
+int
+write_proc_io_syscr(char* buffer, int size, void* args)
+{
+	return write_proc_io_rate(buffer, size, (proc_data_t*)args, offsetof(proc_stat_t, syscr), 1);
+}
 
-	return 0;
+/**
+ * Writes process write system call rate (calls/s).
+ */
+int
+write_proc_io_syscw(char* buffer, int size, void* args)
+{
+	return write_proc_io_rate(buffer, size, (proc_data_t*)args, offsetof(proc_stat_t, syscw), 1);
 }
 
 /**
- * Formats process header title.
- *
- * @param[in] proc     the process data structure.
- * @param[out] buffer  the output buffer.
- * @param[in] size     the output buffer size.
- * @return             the number of characters written into output buffer
- *                     not counting the trailing '\0' character.
+ * Writes process cancelled write rate, the dirty page cache truncated
+ * before write-back (kB/s).
  */
-static int
-proc_data_format_title(const proc_data_t* proc, char* buffer, int size)
+int
+write_proc_io_cancelled(char* buffer, int size, void* args)
 {
-	return snprintf(buffer, size, "PID %d %s", FIELD_PROC_PID(proc->data1), PROCESS_NAME(proc->data1));
+	return write_proc_io_rate(buffer, size, (proc_data_t*)args, offsetof(proc_stat_t, cancelled_write_bytes), 1024);
 }
 
 /**
- * Creates process data structure.
+ * Writes process perf_event software counter rate per second.
  *
- * This function creates process data structure, initializes its snapshots and
- * creates output header.
- * @param pproc[out]    the created process data structure.
- * @param pid[in]       the process identifier.
- * @param app_data[in]  a reference to application data.
- * @return              0 for success.
+ * @param[in] proc     the process data.
+ * @param[in] counter  the counter index (PROC_PERF_*).
  */
 static int
-proc_data_create(proc_data_t** pproc, int pid, app_data_t* app_data)
+write_proc_perf_rate(char* buffer, int size, const proc_data_t* proc, int counter)
 {
-	int rc = 0;
-	*pproc = (proc_data_t*)malloc(sizeof(proc_data_t));
-	proc_data_t* proc = *pproc;
-	if (proc == NULL) return -ENOMEM;
-
-	proc->header = NULL;
-	proc->next = NULL;
-	proc->app_data = app_data;
-	proc->resource_flags = SNAPSHOT_PROC;
-	*proc->cmdline = '\0';
-
-	/* initialize process snapshots */
-	CHECK_SNAPSHOT_RC(sp_measure_init_proc_data(&proc->data[0], pid, SNAPSHOT_PROC, NULL),
-			"proc /proc/<pid>/ data snapshot initialization returned (%d).", rc |= __rc);
+	return write_rate(buffer, size, proc->perf_values_prev[counter], proc->perf_values[counter],
+			app_data_get_interval(proc->app_data), 1);
+}
 
-	CHECK_SNAPSHOT_RC(sp_measure_init_proc_data(&proc->data[1], 0, 0, &proc->data[0]),
-			"proc /proc/<pid>/ data snapshot initialization returned (%d).", rc |= __rc);
+/**
+ * Writes process page fault rate (faults/s).
+ */
+int
+write_proc_perf_faults(char* buffer, int size, void* args)
+{
+	return write_proc_perf_rate(buffer, size, (proc_data_t*)args, PROC_PERF_PAGE_FAULTS);
+}
 
-	proc->data1 = &proc->data[0];
-	proc->data2 = &proc->data[1];
+/**
+ * Writes process major page fault rate (faults/s).
+ */
+int
+write_proc_perf_major_faults(char* buffer, int size, void* args)
+{
+	return write_proc_perf_rate(buffer, size, (proc_data_t*)args, PROC_PERF_MAJOR_FAULTS);
+}
 
-	CHECK_SNAPSHOT_RC(sp_measure_get_proc_data(proc->data1, proc->resource_flags, NULL),
-			"proc /proc/<pid>/ data snapshot returned (%d).", rc |= __rc);
-	proc->resource_flags &= (~rc);
+/**
+ * Writes process context switch rate (switches/s).
+ */
+int
+write_proc_perf_context_switches(char* buffer, int size, void* args)
+{
+	return write_proc_perf_rate(buffer, size, (proc_data_t*)args, PROC_PERF_CONTEXT_SWITCHES);
+}
 
-	return rc;
+/**
+ * Writes process CPU migration rate (migrations/s).
+ */
+int
+write_proc_perf_cpu_migrations(char* buffer, int size, void* args)
+{
+	return write_proc_perf_rate(buffer, size, (proc_data_t*)args, PROC_PERF_CPU_MIGRATIONS);
 }
 
 /**
- * Create report header for the specified process.
+ * Writes scheduler or delay time as percentage of the interval.
  *
- * @param[in] proc      the process data.
- * @param[in] app_data  the application data.
- * @param[in] index     the process index in app_data process list.
+ * @param[in] proc    the process data.
+ * @param[in] value1  the time at the previous report (ns).
+ * @param[in] value2  the latest time (ns).
  */
 static int
-proc_data_create_header(proc_data_t* proc, app_data_t* app_data, int index)
+write_proc_time_usage(char* buffer, int size, const proc_data_t* proc, long long value1, long long value2)
 {
-	char buffer[256];
-	proc_data_format_title(proc, buffer, sizeof(buffer));
-	proc->header = sp_report_header_add_child(&app_data->root_header, buffer, 30, SP_REPORT_ALIGN_LEFT, NULL, NULL);
-	if (proc->header == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(proc->header, "clean:", 8, SP_REPORT_ALIGN_RIGHT, write_proc_mem_clean, (void*)proc) == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(proc->header, "dirty:", 8, SP_REPORT_ALIGN_RIGHT, write_proc_mem_dirty, (void*)proc) == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(proc->header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_proc_mem_change, (void*)proc) == NULL) return -ENOMEM;
-	if (sp_report_header_add_child(proc->header, "CPU-%:", 7, SP_REPORT_ALIGN_RIGHT, write_proc_cpu_usage, (void*)proc) == NULL) return -ENOMEM;
-
-	/* set process column color if necessary */
-	if (colors && !(index & 1)) {
-		sp_report_header_set_color(proc->header, COLOR_PROCESS, COLOR_CLEAR);
+	int interval = app_data_get_interval(proc->app_data);
+	if (value1 == PROC_STAT_UNDEFINED || value2 == PROC_STAT_UNDEFINED || value2 < value1 || interval <= 0) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
 	}
+	/* interval is in milliseconds, the times in nanoseconds */
+	return snprintf(buffer, size + 1, "%.1f%%", (value2 - value1) / (interval * 10000.0));
+}
 
-	proc->has_data = true;
-	return 0;
+/**
+ * Writes process on-CPU time percentage from scheduler statistics.
+ */
+int
+write_proc_sched_run(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_time_usage(buffer, size, proc, proc->stat_prev.run_time, proc->stat.run_time);
 }
 
 /**
- * Fress process data structure.
- *
- * This structure frees process data resources allocated by proc_data_create() function
- * together with the process data structure itself.
- *
- * @param proc[in]  the process data.
- * @return          0 for success.
+ * Writes process run queue wait time percentage, the time the threads
+ * were runnable but waited for a CPU.
  */
-static int
-proc_data_free(proc_data_t* proc)
+int
+write_proc_sched_wait(char* buffer, int size, void* args)
 {
-	if (proc) {
-		sp_measure_free_proc_data(&proc->data[0]);
-		sp_measure_free_proc_data(&proc->data[1]);
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_time_usage(buffer, size, proc, proc->stat_prev.wait_time, proc->stat.wait_time);
+}
 
-		sp_report_header_remove(&proc->app_data->root_header, proc->header);
-		sp_report_header_free(proc->header);
+/**
+ * Writes process block I/O delay percentage.
+ */
+int
+write_proc_delay_blkio(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_time_usage(buffer, size, proc, proc->stat_prev.blkio_delay, proc->stat.blkio_delay);
+}
 
-		free(proc);
-	}
-	return 0;
+/**
+ * Writes process swap-in delay percentage.
+ */
+int
+write_proc_delay_swapin(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_time_usage(buffer, size, proc, proc->stat_prev.swapin_delay, proc->stat.swapin_delay);
+}
+
+/**
+ * Writes process direct reclaim (free pages) delay percentage.
+ */
+int
+write_proc_delay_freepages(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_time_usage(buffer, size, proc, proc->stat_prev.freepages_delay, proc->stat.freepages_delay);
+}
+
+/**
+ * Writes process thrashing delay percentage.
+ */
+int
+write_proc_delay_thrashing(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_time_usage(buffer, size, proc, proc->stat_prev.thrashing_delay, proc->stat.thrashing_delay);
+}
+
+/**
+ * Writes process resident memory on a NUMA node (kB).
+ */
+int
+write_proc_numa_node(char* buffer, int size, void* args)
+{
+	node_column_t* column = (node_column_t*)args;
+	const proc_data_t* proc = (const proc_data_t*)column->data;
+	return write_proc_stat_value(buffer, size, proc->numa_nodes[column->node]);
+}
+
+/**
+ * Writes process heap size from mallinfo.so statistics (kB).
+ *
+ * @param[in] proc   the process data.
+ * @param[in] value  the mallinfo value (bytes).
+ */
+static int
+write_proc_heap_value(char* buffer, int size, const proc_data_t* proc, uint64_t value)
+{
+	if (!proc->heap_valid) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%llu", (unsigned long long)(value >> 10));
+}
+
+/**
+ * Writes process allocated heap (kB).
+ */
+int
+write_proc_heap_used(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_heap_value(buffer, size, proc, proc->heap.uordblks);
+}
+
+/**
+ * Writes process free heap (kB).
+ */
+int
+write_proc_heap_free(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_heap_value(buffer, size, proc, proc->heap.fordblks);
+}
+
+/**
+ * Writes process heap arenas size, not including mmapped blocks (kB).
+ */
+int
+write_proc_heap_arena(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_heap_value(buffer, size, proc, proc->heap.arena);
+}
+
+/**
+ * Writes process heap mmapped blocks size (kB).
+ */
+int
+write_proc_heap_mmap(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	return write_proc_heap_value(buffer, size, proc, proc->heap.hblkhd);
+}
+
+/**
+ * Writes process heap fragmentation, the free heap percentage of the arenas.
+ */
+int
+write_proc_heap_frag(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	if (!proc->heap_valid || !proc->heap.arena) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%.1f%%", proc->heap.fordblks * 100.0 / proc->heap.arena);
+}
+
+/* the selectable process columns, a name can select several columns */
+static const proc_column_t proc_columns[] = {
+	{"clean", "clean:", 8, write_proc_mem_clean, SNAPSHOT_PROC_MEM_USAGE, 0, 0},
+	{"dirty", "dirty:", 8, write_proc_mem_dirty, SNAPSHOT_PROC_MEM_USAGE, 0, 0},
+	{"change", "change:", 8, write_proc_mem_change, SNAPSHOT_PROC_MEM_USAGE, 0, 0},
+	{"cpu", "CPU-%:", 7, write_proc_cpu_usage, SNAPSHOT_PROC_CPU_USAGE, 0, 0},
+	{"pss", "PSS:", 8, write_proc_pss, 0, PROC_STAT_SMAPS, 0},
+	{"uss", "USS:", 8, write_proc_uss, 0, PROC_STAT_SMAPS, 0},
+	{"rss", "RSS:", 8, write_proc_rss, 0, PROC_STAT_STATUS, 0},
+	{"swap", "swap:", 8, write_proc_swap, 0, PROC_STAT_SMAPS, 0},
+	{"anon", "anon:", 8, write_proc_anon, 0, PROC_STAT_STATUS, 0},
+	{"file", "file:", 8, write_proc_file, 0, PROC_STAT_STATUS, 0},
+	{"shmem", "shmem:", 8, write_proc_shmem, 0, PROC_STAT_STATUS, 0},
+	{"vmsize", "VmSize:", 9, write_proc_vmsize, 0, PROC_STAT_STATUS, 0},
+	{"vmhwm", "VmHWM:", 8, write_proc_vmhwm, 0, PROC_STAT_STATUS, 0},
+	{"threads", "thrds:", 6, write_proc_threads, 0, PROC_STAT_STATUS, 0},
+	{"fds", "fds:", 5, write_proc_fds, 0, PROC_STAT_FDS, 0},
+	{"minflt", "minflt:", 9, write_proc_minflt, 0, PROC_STAT_STAT, 0},
+	{"majflt", "majflt:", 7, write_proc_majflt, 0, PROC_STAT_STAT, 0},
+	{"io", "rd-kB/s:", 9, write_proc_io_read, 0, PROC_STAT_IO, 0},
+	{"io", "wr-kB/s:", 9, write_proc_io_write, 0, PROC_STAT_IO, 0},
+	{"syscio", "rdsc/s:", 8, write_proc_io_syscr, 0, PROC_STAT_IO, 0},
+	{"syscio", "wrsc/s:", 8, write_proc_io_syscw, 0, PROC_STAT_IO, 0},
+	{"cancelled", "cwr-kB/s:", 10, write_proc_io_cancelled, 0, PROC_STAT_IO, 0},
+	{"sched", "run-%:", 8, write_proc_sched_run, 0, 0, PROC_COLLECTOR_SCHEDSTAT},
+	{"sched", "wait-%:", 8, write_proc_sched_wait, 0, 0, PROC_COLLECTOR_SCHEDSTAT},
+	{"delay", "blkio-%:", 9, write_proc_delay_blkio, 0, 0, PROC_COLLECTOR_TASKSTATS},
+	{"delay", "swpin-%:", 9, write_proc_delay_swapin, 0, 0, PROC_COLLECTOR_TASKSTATS},
+	{"delay", "recl-%:", 8, write_proc_delay_freepages, 0, 0, PROC_COLLECTOR_TASKSTATS},
+	{"delay", "thrash-%:", 10, write_proc_delay_thrashing, 0, 0, PROC_COLLECTOR_TASKSTATS},
+	{"perf", "flt/s:", 8, write_proc_perf_faults, 0, 0, PROC_COLLECTOR_PERF},
+	{"perf", "majf/s:", 8, write_proc_perf_major_faults, 0, 0, PROC_COLLECTOR_PERF},
+	{"perf", "csw/s:", 8, write_proc_perf_context_switches, 0, 0, PROC_COLLECTOR_PERF},
+	{"perf", "migr/s:", 8, write_proc_perf_cpu_migrations, 0, 0, PROC_COLLECTOR_PERF},
+	{"numa", NULL, 9, write_proc_numa_node, 0, 0, PROC_COLLECTOR_NUMA},
+	{"heap", "heap-use:", 10, write_proc_heap_used, 0, 0, PROC_COLLECTOR_HEAP},
+	{"heap", "heap-free:", 11, write_proc_heap_free, 0, 0, PROC_COLLECTOR_HEAP},
+	{"heap", "arena:", 9, write_proc_heap_arena, 0, 0, PROC_COLLECTOR_HEAP},
+	{"heap", "mmap:", 9, write_proc_heap_mmap, 0, 0, PROC_COLLECTOR_HEAP},
+	{"heap", "frag-%:", 7, write_proc_heap_frag, 0, 0, PROC_COLLECTOR_HEAP},
+};
+
+/**
+ * Writes the number of processes in process tree.
+ */
+int
+write_proc_tree_count(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	if (!proc->tree || !proc->tree->member_count) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%d", proc->tree->member_count);
+}
+
+/**
+ * Writes process tree private clean memory size (Kb).
+ */
+int
+write_proc_tree_clean(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	if (!proc->tree || !proc->tree->member_count) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%8d", proc->tree->private_clean);
+}
+
+/**
+ * Writes process tree private dirty + swap memory size (Kb).
+ */
+int
+write_proc_tree_dirty(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	if (!proc->tree || !proc->tree->member_count) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%8d", proc->tree->private_dirty);
+}
+
+/**
+ * Writes process tree proportional set size (Kb).
+ */
+int
+write_proc_tree_pss(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	if (!proc->tree || !proc->tree->member_count) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%8d", proc->tree->pss);
+}
+
+/**
+ * Writes process tree cpu usage, including the terminated descendants.
+ */
+int
+write_proc_tree_cpu_usage(char* buffer, int size, void* args)
+{
+	proc_data_t* proc = (proc_data_t*)args;
+	int total_ticks;
+	if (!proc->tree || !proc->tree->member_count ||
+			sp_measure_diff_sys_cpu_ticks(proc->app_data->sys_data1, proc->app_data->sys_data2, &total_ticks) != 0) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%5.1f%%",
+			total_ticks ? (float)(proc->tree_cpu2 - proc->tree_cpu1) * 100 / total_ticks : 0);
+}
+
+/*
+ * End of writer functions.
+ */
+
+
+/*
+ * Executes expression and checks the return value for warnings/errors
+ */
+#define CHECK_SNAPSHOT_RC(expression, text, ...) { \
+	int __rc = expression; \
+	if (__rc < 0) { \
+		fprintf(stderr, "ERROR: " text " Aborting.\n", __VA_ARGS__);\
+		exit(-1);\
+	}\
+	if (__rc > 0) { \
+		fprintf(stderr, "Warning: " text " Some data might be absent.\n", __VA_ARGS__);\
+	}\
+}
+
+/**
+ * Initializes system snapshots.
+ *
+ * @param self[in]   application data.
+ * @return           0 for success.
+ */
+static int
+app_data_init_sys_snapshots(app_data_t* self)
+{
+	int rc = 0;
+
+	CHECK_SNAPSHOT_RC(sp_measure_init_sys_data(&self->sys_data[0], self->resource_flags, NULL),
+			"system /proc/ data snapshot initialization returned (%x).", rc |= __rc);
+
+	CHECK_SNAPSHOT_RC(sp_measure_init_sys_data(&self->sys_data[1], 0, &self->sys_data[0]),
+			"system /proc/ data snapshot initialization returned (%x).", rc |= __rc);
+
+	/* initialize cgroups */
+	cgroup_data_t* cgroup = self->cgroups;
+	while (cgroup) {
+		cgroup_init(cgroup);
+		cgroup = cgroup->next;
+	}
+
+	/* take initial system snapshot */
+	CHECK_SNAPSHOT_RC(sp_measure_get_sys_data(&self->sys_data[0], self->resource_flags, NULL),
+			"System resource usage initial snapshot returned (%x).", rc = __rc);
+
+	if (rc & SNAPSHOT_SYS_MEM_WATERMARK) {
+		fprintf(stderr, "Note: (Maemo) kernel memory limits not found.\n");
+	}
+
+	self->resource_flags &= (~rc);
+	if (proc_root_is_archive()) {
+		FIELD_SYS_TIMESTAMP(&self->sys_data[0]) = proc_root_time();
+	}
+
+	self->sys_data1 = &self->sys_data[0];
+	self->sys_data2 = &self->sys_data[1];
+
+	/* take initial additional system statistics snapshot */
+	if (self->sys_stat_flags && (rc = sys_stat_read(self->sys_stat_flags, &self->sys_stat[0])) != 0) {
+		fprintf(stderr, "Warning: system statistics snapshot returned (%d). Some data might be absent.\n", rc);
+		self->sys_stat_flags &= ~rc;
+	}
+	sys_stat_read(0, &self->sys_stat[1]);
+	self->sys_stat1 = &self->sys_stat[0];
+	self->sys_stat2 = &self->sys_stat[1];
+
+	return rc;
+}
+
+/**
+ * Creates system information headers(columns).
+ *
+ * @param self[in]   application data.
+ * @return           0 for success.
+ */
+static int
+app_data_create_header(app_data_t* self)
+{
+	memset(&self->root_header, 0, sizeof(sp_report_header_t));
+	/* timestamp header */
+	if (sp_report_header_add_child(&self->root_header, HEADER_TITLE_TIMESTAMP, 12, SP_REPORT_ALIGN_CENTER, write_sys_timestamp, (void*)self) == NULL) return -ENOMEM;
+
+	/* watermarks header if necessary */
+	if (self->resource_flags & SNAPSHOT_SYS_MEM_WATERMARK) {
+		self->watermark_header = sp_report_header_add_child(&self->root_header, "BL", 2, SP_REPORT_ALIGN_CENTER, write_sys_mem_watermark, (void*)self);
+		if (self->watermark_header == NULL) return -ENOMEM;
+	}
+
+	/* memory header containing used system memory and it's change from the previous snapshot columns */
+	sp_report_header_t* mem_header = sp_report_header_add_child(&self->root_header, "system memory", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+	if (mem_header == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(mem_header, "used:", 10, SP_REPORT_ALIGN_RIGHT, write_sys_mem_used, (void*)self) == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(mem_header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_sys_mem_change, (void*)self) == NULL) return -ENOMEM;
+
+	/* cgroups headers */
+	cgroup_data_t* cgroup = self->cgroups;
+	int index = 1;
+	while (cgroup) {
+		char group_title[512];
+		snprintf(group_title, sizeof(group_title), "[%s]", strrchr(cgroup->path, '/') + 1);
+		sp_report_header_t* cgroup_header = sp_report_header_add_child(&self->root_header, group_title, 0, SP_REPORT_ALIGN_CENTER, NULL, NULL);
+		if (cgroup_header == NULL) return -ENOMEM;
+		if (colors) {
+			hlight_t* hlight = &hlight_cgroup[(index++) & 1];
+			sp_report_header_set_color(cgroup_header, hlight->set, hlight->clear);
+		}
+	    if (sp_report_header_add_child(cgroup_header, "used:", 10, SP_REPORT_ALIGN_RIGHT, write_sys_mem_cgroup_used, (void*)cgroup) == NULL) return -ENOMEM;
+	    if (sp_report_header_add_child(cgroup_header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_sys_mem_cgroup_change, (void*)cgroup) == NULL) return -ENOMEM;
+		cgroup = cgroup->next;
+	}
+
+	/* cpu header containing cpu usage and average frequency columns */
+	sp_report_header_t* cpu_header = sp_report_header_add_child(&self->root_header, "system CPU", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+	if (cpu_header == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(cpu_header, "%:", 6, SP_REPORT_ALIGN_RIGHT, write_sys_cpu_usage, (void*)self) == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(cpu_header, "MHz:", 5, SP_REPORT_ALIGN_RIGHT, write_sys_cpu_freq, (void*)self) == NULL) return -ENOMEM;
+
+	/* system I/O header with page-in/out and physical disk rates */
+	if (self->system_io && (self->sys_stat_flags & (SYS_STAT_VMSTAT | SYS_STAT_DISKSTATS))) {
+		sp_report_header_t* io_header = sp_report_header_add_child(&self->root_header, "system I/O", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+		if (io_header == NULL) return -ENOMEM;
+		if (self->sys_stat_flags & SYS_STAT_VMSTAT) {
+			if (sp_report_header_add_child(io_header, "pgin/s:", 8, SP_REPORT_ALIGN_RIGHT, write_sys_io_pgpgin, (void*)self) == NULL) return -ENOMEM;
+			if (sp_report_header_add_child(io_header, "pgout/s:", 9, SP_REPORT_ALIGN_RIGHT, write_sys_io_pgpgout, (void*)self) == NULL) return -ENOMEM;
+		}
+		if (self->sys_stat_flags & SYS_STAT_DISKSTATS) {
+			if (sp_report_header_add_child(io_header, "rd-kB/s:", 9, SP_REPORT_ALIGN_RIGHT, write_sys_io_disk_read, (void*)self) == NULL) return -ENOMEM;
+			if (sp_report_header_add_child(io_header, "wr-kB/s:", 9, SP_REPORT_ALIGN_RIGHT, write_sys_io_disk_write, (void*)self) == NULL) return -ENOMEM;
+			if (sp_report_header_add_child(io_header, "rd/s:", 6, SP_REPORT_ALIGN_RIGHT, write_sys_io_disk_reads, (void*)self) == NULL) return -ENOMEM;
+			if (sp_report_header_add_child(io_header, "wr/s:", 6, SP_REPORT_ALIGN_RIGHT, write_sys_io_disk_writes, (void*)self) == NULL) return -ENOMEM;
+		}
+	}
+
+	/* system vmstat header with fault, swap, reclaim, compaction, OOM kill
+	 * and refault rates */
+	if (self->system_vmstat && (self->sys_stat_flags & SYS_STAT_VMSTAT)) {
+		sp_report_header_t* vmstat_header = sp_report_header_add_child(&self->root_header, "system vmstat /s", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+		if (vmstat_header == NULL) return -ENOMEM;
+		int i;
+		for (i = 0; i < VMSTAT_COLUMN_COUNT; i++) {
+			sys_stat_column_t* column = &self->vmstat_columns[i];
+			column->app_data = self;
+			column->offset = vmstat_columns[i].offset;
+			if (sp_report_header_add_child(vmstat_header, vmstat_columns[i].title, vmstat_columns[i].width, SP_REPORT_ALIGN_RIGHT, write_sys_stat_rate, (void*)column) == NULL) return -ENOMEM;
+		}
+	}
+
+	/* system NUMA header with used and free memory of each node and the
+	 * node allocation rates */
+	if (self->system_numa && (self->sys_stat_flags & (SYS_STAT_VMSTAT | SYS_STAT_NODES))) {
+		sp_report_header_t* numa_header = sp_report_header_add_child(&self->root_header, "system NUMA", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+		if (numa_header == NULL) return -ENOMEM;
+		int i;
+		if (self->sys_stat_flags & SYS_STAT_NODES) {
+			for (i = 0; i < self->node_count; i++) {
+				char title[32];
+				node_column_t* column = &self->node_columns[i];
+				column->data = self;
+				column->node = i;
+				snprintf(title, sizeof(title), "N%d-used:", i);
+				if (sp_report_header_add_child(numa_header, title, 9, SP_REPORT_ALIGN_RIGHT, write_sys_node_used, (void*)column) == NULL) return -ENOMEM;
+				snprintf(title, sizeof(title), "N%d-free:", i);
+				if (sp_report_header_add_child(numa_header, title, 9, SP_REPORT_ALIGN_RIGHT, write_sys_node_free, (void*)column) == NULL) return -ENOMEM;
+			}
+		}
+		if (self->sys_stat_flags & SYS_STAT_VMSTAT) {
+			for (i = 0; i < NUMA_COLUMN_COUNT; i++) {
+				sys_stat_column_t* column = &self->numa_columns[i];
+				column->app_data = self;
+				column->offset = numa_columns[i].offset;
+				if (sp_report_header_add_child(numa_header, numa_columns[i].title, numa_columns[i].width, SP_REPORT_ALIGN_RIGHT, write_sys_stat_rate, (void*)column) == NULL) return -ENOMEM;
+			}
+		}
+	}
+
+	/* monitor self-overhead header with per phase CPU time, system call,
+	 * read kilobyte and lateness columns of the previous tick */
+	if (self->overhead) {
+		static const char* titles[OVERHEAD_PHASE_COUNT] = {
+			[OVERHEAD_DISCOVERY] = "disc:",
+			[OVERHEAD_SYSTEM] = "sys:",
+			[OVERHEAD_PROCESS] = "proc:",
+			[OVERHEAD_RENDER] = "rend:",
+		};
+		sp_report_header_t* overhead_header = sp_report_header_add_child(&self->root_header, "monitor usec", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+		if (overhead_header == NULL) return -ENOMEM;
+		int phase;
+		for (phase = 0; phase < OVERHEAD_PHASE_COUNT; phase++) {
+			overhead_column_t* column = &self->overhead_columns[phase];
+			column->overhead = self->overhead;
+			column->phase = phase;
+			if (sp_report_header_add_child(overhead_header, titles[phase], 6, SP_REPORT_ALIGN_RIGHT, write_overhead_phase, (void*)column) == NULL) return -ENOMEM;
+		}
+		if (sp_report_header_add_child(overhead_header, "sysc:", 6, SP_REPORT_ALIGN_RIGHT, write_overhead_syscalls, (void*)self->overhead) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(overhead_header, "rd-kB:", 7, SP_REPORT_ALIGN_RIGHT, write_overhead_read, (void*)self->overhead) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(overhead_header, "late:", 6, SP_REPORT_ALIGN_RIGHT, write_overhead_lateness, (void*)self->overhead) == NULL) return -ENOMEM;
+	}
+
+
+	/* create headers for monitored processes */
+	proc_data_t* proc = self->proc_list;
+	index = 0;
+	while (proc) {
+		proc_data_create_header(proc, self, index++);
+		proc = proc->next;
+	}
+
+	return 0;
+}
+
+/**
+ * Initializes application data.
+ *
+ * @param self[in]   application data.
+ * @return           0 for success.
+ */
+static int
+app_data_init(app_data_t* self)
+{
+	int rc;
+	if ( (rc = app_data_init_sys_snapshots(self)) < 0) return rc;
+	if ( (rc = app_data_create_header(self)) != 0) return rc;
+	return 0;
+}
+
+
+/**
+ * Initializes timestamp printing options.
+ *
+ * This function checks if the millisecond part of timestamps should be
+ * printed and makes necessary header adjustments.
+ * The timestamps are printed only when the decimal part of update interval
+ * is specified.
+ * @param self
+ * @return
+ */
+static int
+app_data_init_timestamps(app_data_t* self)
+{
+	self->timestamp_print_msecs = self->sleep_interval % 1000000;
+	if (!self->timestamp_print_msecs) {
+		sp_report_header_set_title(self->root_header.child, HEADER_TITLE_TIMESTAMP, 8, SP_REPORT_ALIGN_RIGHT);
+	}
+	return 0;
+}
+
+/**
+ * Releases application data resources allocated by app_data_init() function/
+ *
+ * @param self[in]   application data.
+ * @return           0 for success.
+ */
+static int
+app_data_release(app_data_t* self)
+{
+	sp_measure_free_sys_data(&self->sys_data[0]);
+	sp_measure_free_sys_data(&self->sys_data[1]);
+
+	sp_report_header_free(self->root_header.child);
+	self->root_header.child = NULL;
+
+	/* free monitored process names */
+	int i;
+	for (i = 0; i < self->name_index; i++) {
+		free(self->name_list[i].name);
+	}
+
+	/* free cgroup data */
+	cgroup_data_t* cgroup = self->cgroups;
+	while (cgroup) {
+		cgroup_data_t* next = cgroup->next;
+		cgroup_free(cgroup);
+		cgroup = next;
+	}
+
+	if (self->tree_details) fclose(self->tree_details);
+
+	if (self->taskstats) {
+		taskstats_close(self->taskstats);
+		free(self->taskstats);
+	}
+
+	/* remove the shared memory snapshot */
+	if (self->shm) {
+		mem_cpu_shm_destroy(self->shm, self->shm_name);
+	}
+	if (self->shm_name) free(self->shm_name);
+
+	if (self->record) fclose(self->record);
+	free(self->record_path);
+	free(self->sample);
+	free(self->replay_path);
+
+	if (self->overhead) {
+		overhead_release(self->overhead);
+		free(self->overhead);
+	}
+
+	return 0;
+}
+
+/**
+ * Formats process header title.
+ *
+ * @param[in] proc     the process data structure.
+ * @param[out] buffer  the output buffer.
+ * @param[in] size     the output buffer size.
+ * @return             the number of characters written into output buffer
+ *                     not counting the trailing '\0' character.
+ */
+static int
+proc_data_format_title(const proc_data_t* proc, char* buffer, int size)
+{
+	return snprintf(buffer, size, "PID %d %s", FIELD_PROC_PID(proc->data1), PROCESS_NAME(proc->data1));
+}
+
+/**
+ * Creates process data structure.
+ *
+ * This function creates process data structure, initializes its snapshots and
+ * creates output header.
+ * @param pproc[out]    the created process data structure.
+ * @param pid[in]       the process identifier.
+ * @param app_data[in]  a reference to application data.
+ * @return              0 for success.
+ */
+static int
+proc_data_create(proc_data_t** pproc, int pid, app_data_t* app_data)
+{
+	int rc = 0, i;
+	*pproc = (proc_data_t*)malloc(sizeof(proc_data_t));
+	proc_data_t* proc = *pproc;
+	if (proc == NULL) return -ENOMEM;
+
+	proc->header = NULL;
+	proc->next = NULL;
+	proc->app_data = app_data;
+	proc->resource_flags = app_data->proc_snapshot_flags;
+	proc_stat_reset(&proc->stat);
+	proc_stat_reset(&proc->stat_prev);
+	proc->io_fd = -1;
+	proc->perf_state = 0;
+	proc_schedstat_init(&proc->schedstat);
+	memset(&proc->exited_delays, 0, sizeof(proc->exited_delays));
+	for (i = 0; i < SYS_STAT_MAX_NODES; i++) {
+		proc->numa_nodes[i] = PROC_STAT_UNDEFINED;
+	}
+	proc->numa_countdown = 0;
+	proc->heap_shm = NULL;
+	proc->heap_valid = false;
+	proc->heap_countdown = 0;
+	for (i = 0; i < PROC_PERF_COUNT; i++) {
+		proc->perf_values[i] = PROC_PERF_UNDEFINED;
+		proc->perf_values_prev[i] = PROC_PERF_UNDEFINED;
+	}
+	*proc->cmdline = '\0';
+
+	/* trends are initialized by the first update, as the processes
+	 * can be added before --leak-trend option is parsed */
+	memset(proc->trend, 0, sizeof(proc->trend));
+	proc->trend_growing = 0;
+
+	proc->tree = NULL;
+	proc->tree_cpu1 = 0;
+	proc->tree_cpu2 = 0;
+	proc->sample_cpu_ticks = 0;
+	proc->sample_mem_change = 0;
+
+	/* initialize process snapshots */
+	CHECK_SNAPSHOT_RC(sp_measure_init_proc_data(&proc->data[0], pid, SNAPSHOT_PROC, NULL),
+			"proc /proc/<pid>/ data snapshot initialization returned (%d).", rc |= __rc);
+
+	CHECK_SNAPSHOT_RC(sp_measure_init_proc_data(&proc->data[1], 0, 0, &proc->data[0]),
+			"proc /proc/<pid>/ data snapshot initialization returned (%d).", rc |= __rc);
+
+	proc->data1 = &proc->data[0];
+	proc->data2 = &proc->data[1];
+
+	CHECK_SNAPSHOT_RC(sp_measure_get_proc_data(proc->data1, proc->resource_flags, NULL),
+			"proc /proc/<pid>/ data snapshot returned (%d).", rc |= __rc);
+	proc->resource_flags &= (~rc);
+
+	return rc;
+}
+
+/**
+ * Create report header for the specified process.
+ *
+ * @param[in] proc      the process data.
+ * @param[in] app_data  the application data.
+ * @param[in] index     the process index in app_data process list.
+ */
+static int
+proc_data_create_header(proc_data_t* proc, app_data_t* app_data, int index)
+{
+	char buffer[256];
+	proc_data_format_title(proc, buffer, sizeof(buffer));
+	proc->header = sp_report_header_add_child(&app_data->root_header, buffer, 30, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+	if (proc->header == NULL) return -ENOMEM;
+	int i;
+	for (i = 0; i < app_data->column_count; i++) {
+		const proc_column_t* column = app_data->columns[i];
+		if (!column->title) {
+			int node;
+			for (node = 0; node < app_data->node_count; node++) {
+				node_column_t* node_column = &proc->numa_columns[node];
+				node_column->data = proc;
+				node_column->node = node;
+				snprintf(buffer, sizeof(buffer), "N%d-kB:", node);
+				if (sp_report_header_add_child(proc->header, buffer, column->width, SP_REPORT_ALIGN_RIGHT, column->write, (void*)node_column) == NULL) return -ENOMEM;
+			}
+			continue;
+		}
+		if (sp_report_header_add_child(proc->header, column->title, column->width, SP_REPORT_ALIGN_RIGHT, column->write, (void*)proc) == NULL) return -ENOMEM;
+	}
+	if (app_data->trend_window) {
+		if (sp_report_header_add_child(proc->header, "leak:", 6, SP_REPORT_ALIGN_RIGHT, write_proc_leak_trend, (void*)proc) == NULL) return -ENOMEM;
+	}
+	if (app_data->tree_mode) {
+		if (sp_report_header_add_child(proc->header, "procs:", 7, SP_REPORT_ALIGN_RIGHT, write_proc_tree_count, (void*)proc) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc->header, "tree-clean:", 11, SP_REPORT_ALIGN_RIGHT, write_proc_tree_clean, (void*)proc) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc->header, "tree-dirty:", 11, SP_REPORT_ALIGN_RIGHT, write_proc_tree_dirty, (void*)proc) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc->header, "tree-PSS:", 11, SP_REPORT_ALIGN_RIGHT, write_proc_tree_pss, (void*)proc) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc->header, "tree-CPU-%:", 11, SP_REPORT_ALIGN_RIGHT, write_proc_tree_cpu_usage, (void*)proc) == NULL) return -ENOMEM;
+	}
+
+	/* set process column color if necessary */
+	if (colors && !(index & 1)) {
+		sp_report_header_set_color(proc->header, COLOR_PROCESS, COLOR_CLEAR);
+	}
+
+	proc->has_data = true;
+	return 0;
+}
+
+/**
+ * Fress process data structure.
+ *
+ * This structure frees process data resources allocated by proc_data_create() function
+ * together with the process data structure itself.
+ *
+ * @param proc[in]  the process data.
+ * @return          0 for success.
+ */
+static int
+proc_data_free(proc_data_t* proc)
+{
+	if (proc) {
+		sp_measure_free_proc_data(&proc->data[0]);
+		sp_measure_free_proc_data(&proc->data[1]);
+
+		proc_tree_free(proc->tree);
+		if (proc->io_fd >= 0) close(proc->io_fd);
+		if (proc->perf_state == 1) proc_perf_close(&proc->perf);
+		proc_schedstat_release(&proc->schedstat);
+		mallinfo_shm_close(proc->heap_shm);
+
+		sp_report_header_remove(&proc->app_data->root_header, proc->header);
+		sp_report_header_free(proc->header);
+
+		free(proc);
+	}
+	return 0;
 }
 
 
 /**
  * Checks if the process command line has been changed.
  *
- * This function is used to determine if the process data should
- * be reinitialized.
- * @param[in] proc  the process data.
- * @return          0 if the process data should not be reinitialized.
+ * This function is used to determine if the process data should
+ * be reinitialized.
+ * @param[in] proc  the process data.
+ * @return          0 if the process data should not be reinitialized.
+ */
+static int
+proc_data_check_cmdline(proc_data_t* proc) {
+	char buffer[256];
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/cmdline", proc->data1->common->pid);
+	int len = 0;
+	int fd = open(buffer, O_RDONLY);
+	if (fd != -1) {
+		len = read(fd, buffer, sizeof(buffer) - 1);
+		if (len < 0) {
+			len = 0;
+		}
+		close(fd);
+	}
+	buffer[len] = '\0';
+	int rc = strcmp(proc->cmdline, buffer);
+	if (rc) {
+		strcpy(proc->cmdline, buffer);
+	}
+	return rc;
+}
+
+/**
+ * Updates process leak trends with the latest snapshot values.
+ *
+ * An alert is written to stderr when a value starts to grow with high
+ * confidence.
+ * @param[in] proc  the process data.
+ */
+static void
+proc_data_update_trend(proc_data_t* proc)
+{
+	struct timespec ts;
+	proc_stat_t* stat = &proc->stat;
+	int values[TREND_COUNT];
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	double time = (ts.tv_sec + ts.tv_nsec / 1e9) / 3600;
+
+	values[TREND_DIRTY] = FIELD_PROC_MEM_PRIVATE_DIRTY(proc->data2) == -1 || FIELD_PROC_MEM_SWAP(proc->data2) == -1 ?
+			PROC_STAT_UNDEFINED : FIELD_PROC_MEM_PRIV_DIRTY_SUM(proc->data2);
+	values[TREND_PSS] = stat->pss;
+	values[TREND_FDS] = stat->fds;
+	values[TREND_THREADS] = stat->threads;
+	values[TREND_MAPS] = stat->maps;
+
+	for (i = 0; i < TREND_COUNT; i++) {
+		trend_fit_t fit;
+		if (values[i] == PROC_STAT_UNDEFINED) continue;
+		if (!proc->trend[i].window) trend_init(&proc->trend[i], proc->app_data->trend_window);
+		trend_add(&proc->trend[i], time, values[i]);
+		if (trend_is_growing(&proc->trend[i], TREND_TSTAT_THRESHOLD, &fit)) {
+			if (!(proc->trend_growing & (1 << i))) {
+				fprintf(stderr, "Warning: PID %d (%s) %s grows %+.1f %s/h (t=%.1f) over the last %.1f hours.\n",
+						FIELD_PROC_PID(proc->data2), PROCESS_NAME(proc->data2), trend_values[i].name,
+						fit.slope, trend_values[i].unit, fit.tstat, trend_span(&proc->trend[i]));
+				proc->trend_growing |= 1 << i;
+			}
+		}
+		else {
+			proc->trend_growing &= ~(1 << i);
+		}
+	}
+}
+
+/**
+ * Reads process I/O accounting values through the kept open /proc/<pid>/io.
+ *
+ * @param[in] proc  the process data.
+ */
+static void
+proc_data_read_io(proc_data_t* proc)
+{
+	if (proc->io_fd == -1) {
+		/* don't retry the processes of other users on every update */
+		if ( (proc->io_fd = proc_stat_open_io(FIELD_PROC_PID(proc->data2))) == -1) proc->io_fd = -2;
+	}
+	if (proc->io_fd >= 0 && proc_stat_read_io(proc->io_fd, &proc->stat) != 0) {
+		close(proc->io_fd);
+		proc->io_fd = -2;
+	}
+}
+
+/**
+ * Reads process perf_event software counters, attaching them first if
+ * necessary.
+ *
+ * @param[in] proc  the process data.
+ */
+static void
+proc_data_read_perf(proc_data_t* proc)
+{
+	int i;
+	if (proc->perf_state == 0) {
+		if (proc_perf_open(&proc->perf, FIELD_PROC_PID(proc->data2)) == 0) {
+			proc->perf_state = 1;
+			if (proc->perf.partial) {
+				fprintf(stderr, "Warning: perf counters of process %d are attached only to %d threads because\n"
+						"of the open file limit.\n", FIELD_PROC_PID(proc->data2), proc->perf.leader_count);
+			}
+		}
+		else {
+			fprintf(stderr, "Warning: failed to attach perf counters to process %d (%s).\n",
+					FIELD_PROC_PID(proc->data2), strerror(errno));
+			proc->perf_state = -1;
+		}
+	}
+	if (proc->perf_state != 1 || proc_perf_read(&proc->perf, proc->perf_values) != 0) {
+		for (i = 0; i < PROC_PERF_COUNT; i++) proc->perf_values[i] = PROC_PERF_UNDEFINED;
+	}
+}
+
+/**
+ * Reads the process data kept between updates: /proc/<pid>/io through
+ * the kept open descriptor, perf counters and scheduler statistics.
+ *
+ * @param[in] proc  the process data.
+ */
+static void
+proc_data_read_collectors(proc_data_t* proc)
+{
+	app_data_t* app_data = proc->app_data;
+	int i;
+	if (app_data->proc_stat_flags & PROC_STAT_IO) {
+		proc_data_read_io(proc);
+	}
+	if (app_data->proc_collectors & PROC_COLLECTOR_PERF) {
+		proc_data_read_perf(proc);
+	}
+	if (app_data->proc_collectors & PROC_COLLECTOR_TASKSTATS) {
+		taskstats_delays_t delays;
+		if (app_data->taskstats && taskstats_query(app_data->taskstats, FIELD_PROC_PID(proc->data2), &delays) == 0) {
+			proc->stat.blkio_delay = delays.blkio + proc->exited_delays.blkio;
+			proc->stat.swapin_delay = delays.swapin + proc->exited_delays.swapin;
+			proc->stat.freepages_delay = delays.freepages + proc->exited_delays.freepages;
+			proc->stat.thrashing_delay = delays.thrashing == TASKSTATS_UNDEFINED ?
+					PROC_STAT_UNDEFINED : delays.thrashing + proc->exited_delays.thrashing;
+		}
+		else {
+			proc->stat.blkio_delay = PROC_STAT_UNDEFINED;
+			proc->stat.swapin_delay = PROC_STAT_UNDEFINED;
+			proc->stat.freepages_delay = PROC_STAT_UNDEFINED;
+			proc->stat.thrashing_delay = PROC_STAT_UNDEFINED;
+		}
+	}
+	if ((app_data->proc_collectors & PROC_COLLECTOR_NUMA) && --proc->numa_countdown <= 0) {
+		int pid = FIELD_PROC_PID(proc->data2);
+		if (proc_stat_read_numa(pid, proc->numa_nodes, app_data->node_count) != 0) {
+			for (i = 0; i < app_data->node_count; i++) proc->numa_nodes[i] = PROC_STAT_UNDEFINED;
+		}
+		proc->numa_countdown = NUMA_MAPS_INTERVAL / (app_data->sleep_interval / 1000 + 1) + 1;
+	}
+	if (app_data->proc_collectors & PROC_COLLECTOR_HEAP) {
+		/* the segment is mapped once, reading it takes no system calls */
+		if (!proc->heap_shm && --proc->heap_countdown <= 0) {
+			proc->heap_shm = mallinfo_shm_open(FIELD_PROC_PID(proc->data2));
+			proc->heap_countdown = HEAP_SHM_INTERVAL / (app_data->sleep_interval / 1000 + 1) + 1;
+		}
+		proc->heap_valid = proc->heap_shm && mallinfo_shm_read(proc->heap_shm, &proc->heap) == 0;
+	}
+	if (app_data->proc_collectors & PROC_COLLECTOR_SCHEDSTAT) {
+		if (proc_schedstat_update(&proc->schedstat, FIELD_PROC_PID(proc->data2)) == 0) {
+			proc->stat.run_time = proc->schedstat.run_time;
+			proc->stat.wait_time = proc->schedstat.wait_time;
+		}
+		else {
+			proc->stat.run_time = PROC_STAT_UNDEFINED;
+			proc->stat.wait_time = PROC_STAT_UNDEFINED;
+		}
+	}
+}
+
+/**
+ * Accounts the delays of an exited task to its monitored parent process.
+ *
+ * @param[in] delays  the final delays of the exited task.
+ * @param[in] data    the application data.
+ */
+static void
+app_data_account_exit(const taskstats_delays_t* delays, void* data)
+{
+	app_data_t* self = (app_data_t*)data;
+	proc_data_t* proc;
+	for (proc = self->proc_list; proc; proc = proc->next) {
+		if (FIELD_PROC_PID(proc->data2) != delays->ppid) continue;
+		proc->exited_delays.blkio += delays->blkio;
+		proc->exited_delays.swapin += delays->swapin;
+		proc->exited_delays.freepages += delays->freepages;
+		if (delays->thrashing != TASKSTATS_UNDEFINED) proc->exited_delays.thrashing += delays->thrashing;
+		break;
+	}
+}
+
+/**
+ * Opens the taskstats connection for the delay columns.
+ *
+ * @param[in] self  the application data.
+ */
+static void
+app_data_init_taskstats(app_data_t* self)
+{
+	int rc;
+	if (!(self->proc_collectors & PROC_COLLECTOR_TASKSTATS)) return;
+	if ( (self->taskstats = malloc(sizeof(taskstats_t))) == NULL) return;
+	if ( (rc = taskstats_open(self->taskstats, true)) != 0) {
+		fprintf(stderr, "Warning: taskstats is not available (%s), the delay columns are disabled.\n", strerror(-rc));
+		free(self->taskstats);
+		self->taskstats = NULL;
+		return;
+	}
+	if (self->taskstats->listen_error) {
+		fprintf(stderr, "Warning: taskstats exit listener registration failed (%s), the delays of the exited\n"
+				"child processes are not included.\n", strerror(-self->taskstats->listen_error));
+	}
+	FILE* fp = fopen("/proc/sys/kernel/task_delayacct", "r");
+	if (fp) {
+		if (fgetc(fp) == '0') {
+			fprintf(stderr, "Warning: delay accounting is disabled, enable it with sysctl kernel.task_delayacct=1.\n");
+		}
+		fclose(fp);
+	}
+}
+
+/**
+ * Adds process to monitored process list.
+ *
+ * This function creates process data structure and adds it to the
+ * application data process list.
+ * @param self[in]   the application data.
+ * @param pid[in]    the process identifier.
+ * @return           0 for success.
+ */
+static proc_data_t*
+app_data_add_proc(app_data_t* self, int pid)
+{
+	int rc;
+	proc_data_t* proc = NULL;
+	/* create process data structure */
+	if ( (rc = proc_data_create(&proc, pid, self)) != 0) {
+		proc_data_free(proc);
+		return NULL;
+	}
+	/* the first process to be monitored, set as the start of process list*/
+	if (self->proc_list == NULL) {
+		self->proc_list = proc;
+	}
+	else {
+		/* add at the end of process list */
+		proc_data_t* next = self->proc_list;
+		while (next->next != NULL) {
+			next = next->next;
+		}
+		next->next = proc;
+	}
+	self->proc_count++;
+	return proc;
+}
+
+/**
+ * Selects the process columns.
+ *
+ * @param[in] self   the application data.
+ * @param[in] spec   comma separated column names. The columns are added
+ *                   to the default columns if the list starts with '+'.
+ * @return           0 for success.
+ */
+static int
+app_data_set_columns(app_data_t* self, const char* spec)
+{
+	char buffer[256];
+	char* saveptr = NULL;
+	char* name;
+
+	self->column_count = 0;
+	if (*spec == '+') {
+		if (app_data_set_columns(self, DEFAULT_PROC_COLUMNS) != 0) return -1;
+		spec++;
+	}
+	snprintf(buffer, sizeof(buffer), "%s", spec);
+	for (name = strtok_r(buffer, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+		bool found = false;
+		size_t i;
+		for (i = 0; i < sizeof(proc_columns) / sizeof(proc_columns[0]); i++) {
+			if (strcmp(proc_columns[i].name, name)) continue;
+			if (self->column_count == MAX_PROC_COLUMNS) {
+				fprintf(stderr, "ERROR: too many process columns (max %d).\n", MAX_PROC_COLUMNS);
+				return -1;
+			}
+			self->columns[self->column_count++] = &proc_columns[i];
+			found = true;
+		}
+		if (!found) {
+			fprintf(stderr, "ERROR: unknown process column: %s\n", name);
+			return -1;
+		}
+	}
+	if (!self->column_count) {
+		fprintf(stderr, "ERROR: no process columns selected.\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Determines the process data sources needed by the selected columns
+ * and options.
+ *
+ * Only these sources are read on every update, so the processes added
+ * earlier during command line parsing are updated too.
+ * @param[in] self   the application data.
+ */
+static void
+app_data_update_sources(app_data_t* self)
+{
+	int i;
+	if (!self->column_count) app_data_set_columns(self, DEFAULT_PROC_COLUMNS);
+
+	self->proc_snapshot_flags = 0;
+	self->proc_stat_flags = 0;
+	self->proc_collectors = 0;
+	for (i = 0; i < self->column_count; i++) {
+		self->proc_snapshot_flags |= self->columns[i]->snapshot_flags;
+		self->proc_stat_flags |= self->columns[i]->stat_flags;
+		self->proc_collectors |= self->columns[i]->collectors;
+	}
+	/* the change filters, the published samples and the leak trends
+	 * need the libsp-measure values regardless of the columns */
+	if (IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_MEM_CHANGES_ONLY) ||
+			self->shm_name || self->record_path || self->trend_window) {
+		self->proc_snapshot_flags |= SNAPSHOT_PROC_MEM_USAGE;
+	}
+	if (IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_CPU_CHANGES_ONLY) ||
+			self->shm_name || self->record_path) {
+		self->proc_snapshot_flags |= SNAPSHOT_PROC_CPU_USAGE;
+	}
+	if (self->trend_window) {
+		self->proc_stat_flags |= PROC_STAT_SMAPS | PROC_STAT_MAPS | PROC_STAT_STATUS | PROC_STAT_FDS;
+	}
+
+	/* the node count is looked up after the --proc-root option */
+	if ((self->proc_collectors & PROC_COLLECTOR_NUMA) || self->system_numa) {
+		self->node_count = sys_stat_node_count();
+		if (!self->node_count) {
+			fprintf(stderr, "Warning: NUMA nodes not found, the NUMA memory columns are disabled.\n");
+			self->sys_stat_flags &= ~SYS_STAT_NODES;
+			self->proc_collectors &= ~PROC_COLLECTOR_NUMA;
+		}
+	}
+
+	proc_data_t* proc;
+	for (proc = self->proc_list; proc; proc = proc->next) {
+		proc->resource_flags &= self->proc_snapshot_flags;
+	}
+}
+
+/**
+ * Removes process from monitored process list.
+ *
+ * The process will be removed and all associated resources freed.
+ * @param self[in]  the application data.
+ * @param pid[in]   the process identifier.
+ * @return          0 for success.
+ */
+static int
+app_data_remove_proc(app_data_t* self, int pid)
+{
+	proc_data_t** pproc = &self->proc_list;
+	while (*pproc && FIELD_PROC_PID(&(*pproc)->data[0]) != pid) {
+		pproc = &(*pproc)->next;
+	}
+	if (*pproc) {
+		proc_data_t* free_proc = *pproc;
+		*pproc = (*pproc)->next;
+		proc_data_free(free_proc);
+		self->proc_count--;
+	}
+	/* reset color ordering which could get broken with column removal */
+	if (colors) {
+		int index = 0;
+		proc_data_t* proc = self->proc_list;
+		while (proc) {
+			hlight_t* hlight = &hlight_proc[(index++) & 1];
+			sp_report_header_set_color(proc->header, hlight->set, hlight->clear);
+			index ^= 1;
+			proc = proc->next;
+		}
+	}
+	return 0;
+}
+
+
+static int
+app_data_add_cgroup(app_data_t* self, const char* name)
+{
+	cgroup_data_t* cgroup = calloc(1, sizeof(cgroup_data_t));
+	if (!cgroup) return -ENOMEM;
+
+	cgroup->name = strdup(name);
+	if (!cgroup->name) {
+		free(cgroup);
+		return -ENOMEM;
+	}
+
+	if (!self->cgroups) self->cgroups = cgroup;
+	else {
+		cgroup_data_t* last = self->cgroups;
+		while (last->next) {
+			last = last->next;
+		}
+		last->next = cgroup;
+	}
+	return 0;
+}
+
+static int
+app_data_set_sleep_interval(app_data_t* self, const char* interval)
+{
+	char buffer[256] = {0};
+	int secs = 0, msecs = 0;
+	int rc;
+	/* scanf "%f" & float secs->msecs conversion has rounding issues,
+	 * whereas handling the digits directly gives exact results.
+	 */
+	if ( (rc = sscanf(interval, "%d.%s", &secs, buffer)) < 1) {
+		fprintf(stderr, "ERROR: invalid interval value: %s\n", interval);
+		return -1;
+	}
+	if (rc > 1) {
+		int power10[] = {0, 100, 10, 1};
+		buffer[3] = '\0';
+		int len = strlen(buffer);
+		msecs = atoi(buffer) * power10[len];
+		if (!secs && msecs < 10) {
+			fprintf(stderr, "ERROR: Interval value 0.%03d is too small\n", msecs);
+			return -1;
+		}
+	}
+	self->sleep_interval = secs * 1000000 + msecs * 1000;
+	ADD_OPTION_VALUE_FLAG(self->option_flags, OF_INTERVAL_OPTION_SET);
+	return 0;
+}
+
+/**
+ * Queues process name for monitoring.
+ *
+ * @param[in] name   name of the process to monitor.
+ * @return           0 for success.
+ */
+static int
+app_data_monitor_process_name(app_data_t* self, const char* name)
+{
+	if (!name) return -1;
+	if (self->name_index == sizeof(self->name_list) / sizeof(self->name_list[0])) {
+		return -1;
+	}
+	proc_name_t* proc = &self->name_list[self->name_index++];
+	proc->name = strdup(name);
+	proc->size = strlen(name);
+	return proc->name != NULL ? 0 : -ENOMEM;
+}
+
+
+/**
+ * Checks if the process is being monitored.
+ *
+ * @param[in]   the process name.
+ * @return      true if the process is being monitored.
+ */
+static bool
+app_data_is_process_monitored(app_data_t* self, const char* name)
+{
+	proc_name_t* proc = self->name_list;
+	while (proc - self->name_list < self->name_index) {
+		if (!strncmp(name, proc->name, proc->size)) {
+			return true;
+		}
+		proc++;
+	}
+	return false;
+}
+
+
+/**
+ * Checks whether process exists on monitored process list.
+ *
+ * @param self[in]   the application data.
+ * @param pid[in]    the process identifier.
+ * @return           true if process exists
+ */
+static bool
+app_data_proc_exists(app_data_t* self, int pid)
+{
+	proc_data_t* proc = self->proc_list;
+	while (proc) {
+		if (FIELD_PROC_PID(&proc->data[0]) == pid)
+            return true;
+        proc = proc->next;
+    }
+    return false;
+}
+
+/**
+ * Checks whether process belongs to a monitored process tree.
+ *
+ * @param self[in]   the application data.
+ * @param pid[in]    the process identifier.
+ * @param root[out]  the tree root process identifier (optional).
+ * @return           true if the process is a tree member.
+ */
+static bool
+app_data_is_tree_member(app_data_t* self, int pid, int* root)
+{
+	proc_data_t* proc;
+	for (proc = self->proc_list; proc; proc = proc->next) {
+		if (proc->tree && proc->tree->root != pid && proc_tree_contains(proc->tree, pid)) {
+			if (root) *root = proc->tree->root;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Writes per-process breakdown of the process trees in CSV format.
+ *
+ * @param self[in]   the application data.
+ */
+static void
+app_data_write_tree_details(app_data_t* self)
+{
+	struct timeval tv;
+	proc_data_t* proc;
+	gettimeofday(&tv, NULL);
+	unsigned long long timestamp = (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+	for (proc = self->proc_list; proc; proc = proc->next) {
+		int i;
+		if (!proc->tree) continue;
+		for (i = 0; i < proc->tree->member_count; i++) {
+			const proc_tree_member_t* member = &proc->tree->members[i];
+			int dirty = member->stat.private_dirty;
+			if (dirty != PROC_STAT_UNDEFINED && member->stat.swap != PROC_STAT_UNDEFINED) dirty += member->stat.swap;
+			fprintf(self->tree_details, "%llu,%d,%d,%d,%s,%d,%d,%d,%llu\n",
+					timestamp, proc->tree->root, member->pid, member->stat.ppid, member->stat.name,
+					member->stat.private_clean, dirty, member->stat.pss, member->cpu);
+		}
+	}
+	fflush(self->tree_details);
+}
+
+/**
+ * Updates monitored process trees.
+ *
+ * The monitored processes, which are descendants of other monitored
+ * processes, are removed from the monitored process list as they are
+ * already accounted in the ancestor tree.
+ * @param self[in]   the application data.
+ * @return           1 if monitored process list was changed, otherwise 0.
+ */
+static int
+app_data_update_trees(app_data_t* self)
+{
+	proc_tree_t* trees[self->proc_count + 1];
+	proc_data_t* proc;
+	int count = 0, rc = 0;
+
+	for (proc = self->proc_list; proc; proc = proc->next) {
+		if (!proc->tree && (proc->tree = proc_tree_create(FIELD_PROC_PID(&proc->data[0]))) == NULL) continue;
+		trees[count++] = proc->tree;
+	}
+	if (proc_tree_update(trees, count, PROC_STAT_SMAPS) != 0) {
+		fprintf(stderr, "Warning: failed to scan the process trees.\n");
+		return 0;
+	}
+	for (proc = self->proc_list; proc; proc = proc->next) {
+		if (!proc->tree) continue;
+		/* the first update sets the CPU time baseline */
+		if (!proc->tree_cpu1) proc->tree_cpu1 = proc->tree->cpu;
+		proc->tree_cpu2 = proc->tree->cpu;
+	}
+
+	proc = self->proc_list;
+	while (proc) {
+		int pid = FIELD_PROC_PID(&proc->data[0]), root;
+		proc = proc->next;
+		if (app_data_is_tree_member(self, pid, &root)) {
+			fprintf(stderr, "Note: process %d is monitored as a part of process %d tree.\n", pid, root);
+			app_data_remove_proc(self, pid);
+			rc = 1;
+		}
+	}
+
+	if (self->tree_details) {
+		app_data_write_tree_details(self);
+	}
+	return rc;
+}
+
+
+/**
+ * Creates the shared memory segment for publishing samples.
+ *
+ * @param[in] self   the application data.
+ * @return           0 for success.
+ */
+static int
+app_data_init_shm(app_data_t* self)
+{
+	if (!self->shm_name) return 0;
+	self->shm = mem_cpu_shm_create(self->shm_name);
+	if (!self->shm) {
+		if (errno == EBUSY) {
+			fprintf(stderr, "ERROR: shared memory segment %s is used by another running mem-cpu-monitor.\n",
+					self->shm_name);
+		}
+		else if (errno == EEXIST) {
+			fprintf(stderr, "ERROR: shared memory segment %s exists and is not a mem-cpu-monitor segment.\n",
+					self->shm_name);
+		}
+		else {
+			fprintf(stderr, "ERROR: failed to create shared memory segment %s (%s).\n",
+					self->shm_name, strerror(errno));
+		}
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Creates the binary recording file.
+ *
+ * @param[in] self   the application data.
+ * @param[in] path   the recording file path.
+ * @return           0 for success.
+ */
+static int
+app_data_init_record(app_data_t* self, const char* path)
+{
+	int flags = self->resource_flags & SNAPSHOT_SYS_MEM_WATERMARK ? MEM_CPU_RECORD_WATERMARK : 0;
+	self->record = replay_record_create(path, flags);
+	if (!self->record) {
+		fprintf(stderr, "ERROR: failed to create recording file %s (%s).\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Stores the latest system and process snapshots into the sample
+ * published into shared memory and written into recording.
+ *
+ * The snapshots are compared to the last printed report, so the changes
+ * since the previous sample are the differences of those comparisons.
+ * @param[in] self   the application data.
+ */
+static void
+app_data_update_sample(app_data_t* self)
+{
+	mem_cpu_shm_sample_t* sample = self->sample;
+	struct timeval tv;
+	int value, total_ticks, ticks;
+
+	gettimeofday(&tv, NULL);
+	sample->tick = ++self->tick;
+	sample->time = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+	sample->mem_total = FIELD_SYS_MEM_TOTAL(self->sys_data2);
+	sample->mem_swap = FIELD_SYS_MEM_SWAP(self->sys_data2);
+	sample->mem_used = FIELD_SYS_MEM_USED(self->sys_data2);
+	sample->mem_change = MEM_CPU_SHM_UNDEFINED;
+	if (sp_measure_diff_sys_mem_used(self->sys_data1, self->sys_data2, &value) == 0) {
+		sample->mem_change = value - self->sample_mem_change;
+		self->sample_mem_change = value;
+	}
+	sample->mem_watermark = self->resource_flags & SNAPSHOT_SYS_MEM_WATERMARK ?
+			FIELD_SYS_MEM_WATERMARK(self->sys_data2) : 0;
+	if (sp_measure_diff_sys_cpu_ticks(self->sys_data1, self->sys_data2, &total_ticks) != 0) {
+		total_ticks = 0;
+	}
+	ticks = total_ticks - self->sample_ticks;
+	/* the averages since the last report are weighted with the ticks */
+	sample->cpu_usage = MEM_CPU_SHM_UNDEFINED;
+	if (sp_measure_diff_sys_cpu_usage(self->sys_data1, self->sys_data2, &value) == 0) {
+		long long usage = (long long)value * total_ticks;
+		sample->cpu_usage = ticks > 0 ? (usage - self->sample_cpu_usage) / ticks : value;
+		/* the rounding of the averages can make idle samples negative */
+		if (sample->cpu_usage < 0) sample->cpu_usage = 0;
+		self->sample_cpu_usage = usage;
+	}
+	sample->cpu_freq = MEM_CPU_SHM_UNDEFINED;
+	if (sp_measure_diff_sys_cpu_avg_freq(self->sys_data1, self->sys_data2, &value) == 0) {
+		long long freq = (long long)value * total_ticks;
+		sample->cpu_freq = ticks > 0 ? (freq - self->sample_cpu_freq) / ticks : value;
+		self->sample_cpu_freq = freq;
+	}
+	self->sample_ticks = total_ticks;
+
+	int index = 0;
+	cgroup_data_t* cgroup;
+	for (cgroup = self->cgroups; cgroup && index < MEM_CPU_SHM_MAX_CGROUPS; cgroup = cgroup->next) {
+		mem_cpu_shm_cgroup_t* item = &sample->cgroups[index++];
+		snprintf(item->name, sizeof(item->name), "%s", strrchr(cgroup->path, '/') + 1);
+		item->mem_used = FIELD_SYS_MEM_CGROUP(cgroup->data2);
+		item->mem_change = MEM_CPU_SHM_UNDEFINED;
+		if (sp_measure_diff_sys_mem_cgroup(cgroup->data1, cgroup->data2, &value) == 0) {
+			item->mem_change = value - cgroup->sample_mem_change;
+			cgroup->sample_mem_change = value;
+		}
+	}
+	sample->cgroup_count = index;
+
+	index = 0;
+	proc_data_t* proc;
+	for (proc = self->proc_list; proc && index < MEM_CPU_SHM_MAX_PROCS; proc = proc->next) {
+		mem_cpu_shm_proc_t* item = &sample->procs[index++];
+		item->pid = FIELD_PROC_PID(proc->data1);
+		snprintf(item->name, sizeof(item->name), "%s", PROCESS_NAME(proc->data1));
+		item->mem_clean = item->mem_dirty = item->mem_change = item->cpu_usage = MEM_CPU_SHM_UNDEFINED;
+		if (!proc->has_data) continue;
+		if (FIELD_PROC_MEM_PRIVATE_CLEAN(proc->data2) != -1) {
+			item->mem_clean = FIELD_PROC_MEM_PRIVATE_CLEAN(proc->data2);
+		}
+		if (FIELD_PROC_MEM_SWAP(proc->data2) != -1 && FIELD_PROC_MEM_PRIVATE_DIRTY(proc->data2) != -1) {
+			item->mem_dirty = FIELD_PROC_MEM_PRIV_DIRTY_SUM(proc->data2);
+		}
+		if (sp_measure_diff_proc_mem_private_dirty(proc->data1, proc->data2, &value) == 0) {
+			item->mem_change = value - proc->sample_mem_change;
+			proc->sample_mem_change = value;
+		}
+		if (sp_measure_diff_proc_cpu_ticks(proc->data1, proc->data2, &value) == 0) {
+			if (ticks > 0) {
+				item->cpu_usage = (long long)(value - proc->sample_cpu_ticks) * 10000 / ticks;
+			}
+			proc->sample_cpu_ticks = value;
+		}
+	}
+	sample->proc_count = index;
+}
+
+/**
+ * Scans running processes and updates monitored process list
+ *
+ * @param[in] self    the application data.
+ * @return            -1 - failure, 0 - monitored process list was not changed,
+ *                    1 - a process was added or removed to the list.
+ */
+static int
+app_data_scan_processes(app_data_t* self)
+{
+	int rc = 0;
+	if (self->name_index) {
+		static time_t last_timestamp = 0;
+		time_t current_timestamp = time(NULL);
+		char buffer[512];
+
+		/* first check for a new processes */
+		proc_root_path(buffer, sizeof(buffer), "/proc");
+		DIR* procDir = opendir(buffer);
+		if (procDir) {
+			struct dirent* item;
+			while ( (item = readdir(procDir)) ) {
+				int pid = atoi(item->d_name);
+				if (pid != 0) {
+					/* the captured process directories have no creation times */
+					bool check = do_full_process_scan || proc_root_is_archive();
+					if (!check) {
+						struct stat fs;
+						proc_root_path(buffer, sizeof(buffer), "/proc/%s", item->d_name);
+						if (stat(buffer, &fs) == 0) check = last_timestamp < fs.st_mtime;
+					}
+					if (check) {
+						sp_measure_proc_data_t data;
+						if (sp_measure_init_proc_data(&data, pid, 0, NULL) == 0 && data.common->name &&
+								app_data_is_process_monitored(self, data.common->name) &&
+								!app_data_proc_exists(self, pid) && !app_data_is_tree_member(self, pid, NULL) ) {
+							proc_data_t* proc = app_data_add_proc(self, pid);
+							if (proc) proc_data_create_header(proc, self, self->proc_count - 1);
+							rc = 1;
+						}
+						sp_measure_free_proc_data(&data);
+					}
+				}
+			}
+			closedir(procDir);
+		}
+		last_timestamp = current_timestamp;
+
+		/* check for terminated processes */
+		proc_data_t* proc = self->proc_list;
+		while (proc) {
+			proc_data_t* proc_free = NULL;
+			int pid = proc->data[0].common->pid;
+			proc_root_path(buffer, sizeof(buffer), "/proc/%d", pid);
+			if (access(buffer, F_OK) != 0) {
+				proc_free = proc;
+			}
+			proc = proc->next;
+			if (proc_free) {
+				app_data_remove_proc(self, pid);
+				rc = 1;
+			}
+		}
+	}
+	return rc;
+}
+
+
+/**
+ * Describes the wordexp() error code.
+ *
+ * @param[in] rc   the wordexp() return value.
+ * @return         the error description.
+ */
+static const char*
+wordexp_error(int rc)
+{
+	switch (rc) {
+	case WRDE_BADCHAR:
+		return "unquoted |, &, ;, <, >, (, ), {, } or newline, quote it or run the command with sh -c";
+	case WRDE_CMDSUB:
+		return "command substitution is not allowed";
+	case WRDE_SYNTAX:
+		return "syntax error, for example unbalanced quotes";
+	case WRDE_NOSPACE:
+		return "out of memory";
+	case WRDE_BADVAL:
+		return "undefined shell variable";
+	default:
+		return "unknown error";
+	}
+}
+
+/**
+ * Execute the specified application and start monitoring it.
+ *
+ * The command line is split into arguments with shell quoting rules.
+ * Variables, ~ and globs are expanded, but command substitution and
+ * unquoted shell operators are rejected.
  */
 static int
-proc_data_check_cmdline(proc_data_t* proc) {
-	char buffer[256];
-	snprintf(buffer, sizeof(buffer), "/proc/%d/cmdline", proc->data1->common->pid);
-	int len = 0;
-	int fd = open(buffer, O_RDONLY);
-	if (fd != -1) {
-		len = read(fd, buffer, sizeof(buffer) - 1);
-		if (len < 0) {
-			len = 0;
+execute_application(app_data_t* self, const char* cmd)
+{
+	wordexp_t words;
+	pid_t pid;
+	int rc;
+
+	if ( (rc = wordexp(cmd, &words, WRDE_NOCMD)) != 0) {
+		fprintf(stderr, "ERROR: failed to parse command line '%s': %s\n", cmd, wordexp_error(rc));
+		return -1;
+	}
+	if (!words.we_wordc) {
+		wordfree(&words);
+		return -1;
+	}
+	rc = posix_spawnp(&pid, words.we_wordv[0], NULL, NULL, words.we_wordv, environ);
+	wordfree(&words);
+	if (rc != 0) {
+		fprintf(stderr, "ERROR: %s\n", strerror(rc));
+		return -1;
+	}
+	/* the first executed application is profiled with --startup option */
+	if (!startup.pid) {
+		startup_init(&startup, pid, 0, 0);
+	}
+	return app_data_add_proc(self, pid) == 0 ? -1 : 0;
+}
+
+/**
+ * Cleanup terminated child processes.
+ */
+static void process_closed(int sig __attribute__((unused)))
+{
+	int status, saved_errno = errno;
+	struct rusage usage;
+	pid_t pid;
+	while ( (pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+		if (pid == startup.pid) {
+			startup_set_exited(&startup, status, &usage);
 		}
-		close(fd);
 	}
-	buffer[len] = '\0';
-	int rc = strcmp(proc->cmdline, buffer);
-	if (rc) {
-		strcpy(proc->cmdline, buffer);
+	errno = saved_errno;
+}
+
+/**
+ * Parses application command line.
+ */
+static void
+parse_cmdline(int argc, char** argv, app_data_t* self)
+{
+	int opt;
+	char* output_path = NULL;
+	while ((opt = getopt_long(argc, argv, "p:hf:mcM:C:i:n:x:N:G:", long_opts, NULL)) != -1) {
+		/* getopt allows -<char><arg> which gives confusing results
+		 * when one writes --name foobar as -name.  Complain about it.
+		 */
+		if (optarg && argv[optind - 1] != optarg && *(argv[optind - 1] + 1) != '-') {
+			fprintf(stderr, "ERROR: failed to parse argument %s!\n", argv[optind - 1]);
+			exit(1);
+		}
+		switch (opt) {
+		case 'f':
+			output_path = strdup(optarg);
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		case 1001:
+			colors = false;
+			break;
+		case 1002:
+			if ( app_data_add_proc(self, getpid()) == NULL) {
+				fprintf(stderr, "Error during process %d monitoring initialization!\n",
+							getpid());
+				exit(-1);
+			}
+			break;
+		case 'p':
+			if (app_data_add_proc(self, atoi(optarg)) == NULL) {
+				fprintf(stderr, "Error during process %d monitoring initialization!\n",
+							atoi(optarg));
+				exit(-1);
+			}
+			break;
+		case 'm':
+			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_PROC_MEM_CHANGES_ONLY);
+			do_print_report_default = false;
+			break;
+		case 'c':
+			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_PROC_CPU_CHANGES_ONLY);
+			do_print_report_default = false;
+			break;
+		case 'M':
+			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_SYS_MEM_CHANGES_ONLY);
+			sys_mem_change_threshold = atoi(optarg);
+			do_print_report_default = false;
+			break;
+		case 'C':
+			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_SYS_CPU_CHANGES_ONLY);
+			if (!sscanf(optarg, "%f", &sys_cpu_change_threshold) ) {
+				fprintf(stderr, "ERROR: invalid CPU change threshold for the system\n");
+				exit(1);
+			}
+			do_print_report_default = false;
+			break;
+		case 'i':
+			if (app_data_set_sleep_interval(self, optarg) != 0) {
+				exit(1);
+			}
+			break;
+		case 'n':
+			do_full_process_scan = true;
+		case 'N':
+			if (app_data_monitor_process_name(self, optarg) != 0) {
+				fprintf(stderr, "ERROR: failed to monitor process %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'x':
+			if (execute_application(self, optarg) != 0) {
+				fprintf(stderr, "ERROR: failed to execute command %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'G':
+			app_data_add_cgroup(self, optarg);
+			break;
+		case 1003:
+			if (self->shm_name) free(self->shm_name);
+			self->shm_name = strdup(optarg);
+			break;
+		case 1008:
+			free(self->record_path);
+			self->record_path = strdup(optarg);
+			break;
+		case 1009:
+			free(self->replay_path);
+			self->replay_path = strdup(optarg);
+			break;
+		case 1011:
+			if (self->overhead) break;
+			if ( (self->overhead = malloc(sizeof(overhead_t))) == NULL) {
+				fprintf(stderr, "ERROR: failed to allocate overhead statistics.\n");
+				exit(1);
+			}
+			overhead_init(self->overhead);
+			break;
+		case 1012:
+			if (app_data_set_columns(self, optarg) != 0) exit(1);
+			break;
+		case 1013:
+			self->sys_stat_flags |= SYS_STAT_VMSTAT | SYS_STAT_DISKSTATS;
+			self->system_io = true;
+			break;
+		case 1014:
+			self->sys_stat_flags |= SYS_STAT_VMSTAT;
+			self->system_vmstat = true;
+			break;
+		case 1015:
+			self->sys_stat_flags |= SYS_STAT_VMSTAT | SYS_STAT_NODES;
+			self->system_numa = true;
+			break;
+		case 1010:
+			if (proc_root_set(optarg) != 0) {
+				fprintf(stderr, "ERROR: proc root %s is not a directory.\n", optarg);
+				exit(1);
+			}
+			break;
+		case 1005:
+			self->tree_mode = true;
+			break;
+		case 1006:
+			if (self->tree_details) fclose(self->tree_details);
+			if ( (self->tree_details = fopen(optarg, "w")) == NULL) {
+				perror("ERROR: unable to open tree details file");
+				exit(1);
+			}
+			fprintf(self->tree_details, "time,root,pid,ppid,name,clean,dirty,pss,cpu_ticks\n");
+			self->tree_mode = true;
+			break;
+		case 1007: {
+			double window = DEFAULT_STARTUP_WINDOW / 1000.0;
+			self->startup_interval = DEFAULT_STARTUP_INTERVAL;
+			if (optarg && sscanf(optarg, "%lf,%d", &window, &self->startup_interval) < 1) window = 0;
+			self->startup_window = window * 1000;
+			if (self->startup_window <= 0 || self->startup_interval < 1 || self->startup_interval > MAX_STARTUP_INTERVAL) {
+				fprintf(stderr, "ERROR: invalid startup profiling parameters: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		}
+		case 1004:
+			self->trend_window = optarg ? atof(optarg) : DEFAULT_TREND_WINDOW;
+			if (self->trend_window <= 0) {
+				fprintf(stderr, "ERROR: invalid leak trend window: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'F':
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (output_path) {
+		FILE* fp = fopen(output_path, "a");
+		if (!fp) {
+			perror("ERROR: unable to open output file");
+			exit(1);
+		}
+		output = fp;
+		free(output_path);
+	} else {
+		output = stdout;
+	}
+	while (optind < argc) {
+		int pid = atoi(argv[optind]);
+		if (!pid) {
+			fprintf(stderr, "WARNING: Failed to parse target process pid: %s\n", argv[optind]);
+		}
+		else if (app_data_add_proc(self, pid) == NULL) {
+			fprintf(stderr, "Error occurred during process %d monitoring initialization!\n",
+						atoi(argv[optind]));
+			exit(-1);
+		}
+		++optind;
+	}
+	// determine if no printing needs to be done by default
+	if (self->proc_list &&
+		(IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_MEM_CHANGES_ONLY) ||
+		 IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_CPU_CHANGES_ONLY) ) ) {
+
+		do_print_report_default = false;
+	}
+	app_data_update_sources(self);
+}
+
+/*
+ * Offline replay of recorded runs.
+ */
+
+/**
+ * Replay state.
+ */
+typedef struct replay_data_t {
+	/* the last printed, the previous and the latest sample */
+	mem_cpu_shm_sample_t* printed;
+	mem_cpu_shm_sample_t* prev;
+	mem_cpu_shm_sample_t* latest;
+	mem_cpu_shm_sample_t samples[3];
+	bool has_printed;
+
+	/* system and process CPU usage weighted with the sample durations
+	 * since the last printed sample, and the sums of the durations (ms) */
+	double cpu_sum;
+	double cpu_time;
+	double proc_cpu_sum[MEM_CPU_SHM_MAX_PROCS];
+	double proc_cpu_time[MEM_CPU_SHM_MAX_PROCS];
+
+	/* replay aggregation interval (ms), 0 to replay every sample */
+	int interval;
+	bool print_msecs;
+	int flags;
+
+	sp_report_header_t root_header;
+	/* process and cgroup column writer arguments */
+	struct replay_item_t {
+		struct replay_data_t* replay;
+		int index;
+	} items[MEM_CPU_SHM_MAX_PROCS + MEM_CPU_SHM_MAX_CGROUPS];
+} replay_data_t;
+
+typedef struct replay_item_t replay_item_t;
+
+/**
+ * Finds process in a sample.
+ *
+ * @param[in] sample  the sample.
+ * @param[in] pid     the process identifier.
+ * @return            the process index or -1 if not found.
+ */
+static int
+replay_find_proc(const mem_cpu_shm_sample_t* sample, int pid)
+{
+	int i;
+	for (i = 0; i < sample->proc_count; i++) {
+		if (sample->procs[i].pid == pid) return i;
 	}
-	return rc;
+	return -1;
 }
 
 /**
- * Adds process to monitored process list.
+ * Calculates the average CPU usage since the last printed sample.
  *
- * This function creates process data structure and adds it to the
- * application data process list.
- * @param self[in]   the application data.
- * @param pid[in]    the process identifier.
- * @return           0 for success.
+ * @param[in] sum     the CPU usage sum weighted with sample durations.
+ * @param[in] time    the sample duration sum.
+ * @param[in] value   the latest sample CPU usage, used if the duration is 0.
+ * @return            the CPU usage in 1/100 percents.
  */
-static proc_data_t*
-app_data_add_proc(app_data_t* self, int pid)
+static double
+replay_cpu_usage(double sum, double time, int value)
 {
-	int rc;
-	proc_data_t* proc = NULL;
-	/* create process data structure */
-	if ( (rc = proc_data_create(&proc, pid, self)) != 0) {
-		proc_data_free(proc);
-		return NULL;
-	}
-	/* the first process to be monitored, set as the start of process list*/
-	if (self->proc_list == NULL) {
-		self->proc_list = proc;
-	}
-	else {
-		/* add at the end of process list */
-		proc_data_t* next = self->proc_list;
-		while (next->next != NULL) {
-			next = next->next;
-		}
-		next->next = proc;
+	return time > 0 ? sum / time : value;
+}
+
+/**
+ * Writes replayed sample timestamp.
+ */
+int
+write_replay_timestamp(char* buffer, int size, void* args)
+{
+	replay_data_t* replay = (replay_data_t*)args;
+	int timestamp = replay->latest->time % (24 * 60 * 60 * 1000);
+	int hours = timestamp / (60 * 60 * 1000);
+	timestamp %= 60 * 60 * 1000;
+	int minutes = timestamp / (60 * 1000);
+	timestamp %= 60 * 1000;
+	int seconds = timestamp / 1000;
+	if (replay->print_msecs) {
+		return snprintf(buffer, size + 1, "%02d:%02d:%02d.%03d", hours, minutes, seconds, timestamp % 1000);
 	}
-	self->proc_count++;
-	return proc;
+	return snprintf(buffer, size + 1, "%02d:%02d:%02d", hours, minutes, seconds);
 }
 
 /**
- * Removes process from monitored process list.
- *
- * The process will be removed and all associated resources freed.
- * @param self[in]  the application data.
- * @param pid[in]   the process identifier.
- * @return          0 for success.
+ * Writes replayed memory watermark information.
  */
-static int
-app_data_remove_proc(app_data_t* self, int pid)
+int
+write_replay_mem_watermark(char* buffer, int size __attribute((unused)), void* args)
 {
-	proc_data_t** pproc = &self->proc_list;
-	while (*pproc && FIELD_PROC_PID(&(*pproc)->data[0]) != pid) {
-		pproc = &(*pproc)->next;
+	replay_data_t* replay = (replay_data_t*)args;
+	int flag_high = replay->latest->mem_watermark & MEM_WATERMARK_HIGH;
+	int flag_low = replay->latest->mem_watermark & MEM_WATERMARK_LOW;
+	if (flag_low) {
+		strcpy(buffer, flag_high ? COLORIZE(COLOR_HIGHMARK, "BL", COLOR_CLEAR) : COLORIZE(COLOR_LOWMARK, "B-", COLOR_CLEAR));
 	}
-	if (*pproc) {
-		proc_data_t* free_proc = *pproc;
-		*pproc = (*pproc)->next;
-		proc_data_free(free_proc);
-		self->proc_count--;
+	else if (flag_high) {
+		strcpy(buffer, COLORIZE(COLOR_HIGHMARK, "-L", COLOR_CLEAR));
 	}
-	/* reset color ordering which could get broken with column removal */
-	if (colors) {
-		int index = 0;
-		proc_data_t* proc = self->proc_list;
-		while (proc) {
-			hlight_t* hlight = &hlight_proc[(index++) & 1];
-			sp_report_header_set_color(proc->header, hlight->set, hlight->clear);
-			index ^= 1;
-			proc = proc->next;
-		}
+	else {
+		strcpy(buffer, "--");
 	}
-	return 0;
+	return 2;
 }
 
-
-static int
-app_data_add_cgroup(app_data_t* self, const char* name)
+/**
+ * Writes replayed used system memory.
+ */
+int
+write_replay_mem_used(char* buffer, int size, void* args)
 {
-	cgroup_data_t* cgroup = calloc(1, sizeof(cgroup_data_t));
-	if (!cgroup) return -ENOMEM;
+	replay_data_t* replay = (replay_data_t*)args;
+	if (replay->latest->mem_used == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%8d", replay->latest->mem_used);
+}
 
-	cgroup->name = strdup(name);
-	if (!cgroup->name) {
-		free(cgroup);
-		return -ENOMEM;
+/**
+ * Writes replayed used system memory change since the last printed sample.
+ */
+int
+write_replay_mem_change(char* buffer, int size, void* args)
+{
+	replay_data_t* replay = (replay_data_t*)args;
+	int value = replay->latest->mem_change;
+	if (replay->has_printed) {
+		value = replay->latest->mem_used != MEM_CPU_SHM_UNDEFINED && replay->printed->mem_used != MEM_CPU_SHM_UNDEFINED ?
+				replay->latest->mem_used - replay->printed->mem_used : MEM_CPU_SHM_UNDEFINED;
 	}
+	if (value == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%+6d", value);
+}
 
-	if (!self->cgroups) self->cgroups = cgroup;
-	else {
-		cgroup_data_t* last = self->cgroups;
-		while (last->next) {
-			last = last->next;
-		}
-		last->next = cgroup;
+/**
+ * Writes replayed cgroup used memory.
+ */
+int
+write_replay_cgroup_used(char* buffer, int size, void* args)
+{
+	replay_item_t* item = (replay_item_t*)args;
+	int value = item->replay->latest->cgroups[item->index].mem_used;
+	if (value == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
 	}
-	return 0;
+	return snprintf(buffer, size + 1, "%8d", value);
 }
 
-static int
-app_data_set_sleep_interval(app_data_t* self, const char* interval)
+/**
+ * Writes replayed cgroup used memory change since the last printed sample.
+ */
+int
+write_replay_cgroup_change(char* buffer, int size, void* args)
 {
-	char buffer[256] = {0};
-	int secs = 0, msecs = 0;
-	int rc;
-	/* scanf "%f" & float secs->msecs conversion has rounding issues,
-	 * whereas handling the digits directly gives exact results.
-	 */
-	if ( (rc = sscanf(interval, "%d.%s", &secs, buffer)) < 1) {
-		fprintf(stderr, "ERROR: invalid interval value: %s\n", interval);
-		return -1;
+	replay_item_t* item = (replay_item_t*)args;
+	const mem_cpu_shm_cgroup_t* cgroup = &item->replay->latest->cgroups[item->index];
+	int value = cgroup->mem_change;
+	if (item->replay->has_printed) {
+		int used = item->replay->printed->cgroups[item->index].mem_used;
+		value = cgroup->mem_used != MEM_CPU_SHM_UNDEFINED && used != MEM_CPU_SHM_UNDEFINED ?
+				cgroup->mem_used - used : MEM_CPU_SHM_UNDEFINED;
 	}
-	if (rc > 1) {
-		int power10[] = {0, 100, 10, 1};
-		buffer[3] = '\0';
-		int len = strlen(buffer);
-		msecs = atoi(buffer) * power10[len];
-		if (!secs && msecs < 10) {
-			fprintf(stderr, "ERROR: Interval value 0.%03d is too small\n", msecs);
-			return -1;
-		}
+	if (value == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
 	}
-	self->sleep_interval = secs * 1000000 + msecs * 1000;
-	ADD_OPTION_VALUE_FLAG(self->option_flags, OF_INTERVAL_OPTION_SET);
-	return 0;
+	return snprintf(buffer, size + 1, "%+6d", value);
 }
 
 /**
- * Queues process name for monitoring.
- *
- * @param[in] name   name of the process to monitor.
- * @return           0 for success.
+ * Writes replayed system CPU usage.
  */
-static int
-app_data_monitor_process_name(app_data_t* self, const char* name)
+int
+write_replay_cpu_usage(char* buffer, int size, void* args)
 {
-	if (!name) return -1;
-	if (self->name_index == sizeof(self->name_list) / sizeof(self->name_list[0])) {
-		return -1;
+	replay_data_t* replay = (replay_data_t*)args;
+	if (!replay->cpu_time && replay->latest->cpu_usage == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
 	}
-	proc_name_t* proc = &self->name_list[self->name_index++];
-	proc->name = strdup(name);
-	proc->size = strlen(name);
-	return proc->name != NULL ? 0 : -ENOMEM;
+	return snprintf(buffer, size + 1, "%5.1f%%",
+			replay_cpu_usage(replay->cpu_sum, replay->cpu_time, replay->latest->cpu_usage) / 100);
 }
 
-
 /**
- * Checks if the process is being monitored.
- *
- * @param[in]   the process name.
- * @return      true if the process is being monitored.
+ * Writes replayed average CPU frequency.
  */
-static bool
-app_data_is_process_monitored(app_data_t* self, const char* name)
+int
+write_replay_cpu_freq(char* buffer, int size, void* args)
 {
-	proc_name_t* proc = self->name_list;
-	while (proc - self->name_list < self->name_index) {
-		if (!strncmp(name, proc->name, proc->size)) {
-			return true;
-		}
-		proc++;
+	replay_data_t* replay = (replay_data_t*)args;
+	if (replay->latest->cpu_freq == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
 	}
-	return false;
+	return snprintf(buffer, size + 1, "%4d", replay->latest->cpu_freq / 1000);
 }
 
-
 /**
- * Checks whether process exists on monitored process list.
- *
- * @param self[in]   the application data.
- * @param pid[in]    the process identifier.
- * @return           true if process exists
+ * Writes replayed process private clean memory.
  */
-static bool
-app_data_proc_exists(app_data_t* self, int pid)
+int
+write_replay_proc_mem_clean(char* buffer, int size, void* args)
 {
-	proc_data_t* proc = self->proc_list;
-	while (proc) {
-		if (FIELD_PROC_PID(&proc->data[0]) == pid)
-            return true;
-        proc = proc->next;
-    }
-    return false;
+	replay_item_t* item = (replay_item_t*)args;
+	int value = item->replay->latest->procs[item->index].mem_clean;
+	if (value == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%8d", value);
 }
 
-
 /**
- * Scans running processes and updates monitored process list
- *
- * @param[in] self    the application data.
- * @return            -1 - failure, 0 - monitored process list was not changed,
- *                    1 - a process was added or removed to the list.
+ * Writes replayed process private dirty memory.
  */
-static int
-app_data_scan_processes(app_data_t* self)
+int
+write_replay_proc_mem_dirty(char* buffer, int size, void* args)
 {
-	int rc = 0;
-	if (self->name_index) {
-		static time_t last_timestamp = 0;
-		time_t current_timestamp = time(NULL);
-		char buffer[512];
-
-		/* first check for a new processes */
-		DIR* procDir = opendir("/proc");
-		if (procDir) {
-			struct dirent* item;
-			while ( (item = readdir(procDir)) ) {
-				int pid = atoi(item->d_name);
-				if (pid != 0) {
-					bool check = do_full_process_scan;
-					if (!check) {
-						struct stat fs;
-						sprintf(buffer, "/proc/%s", item->d_name);
-						if (stat(buffer, &fs) == 0) check = last_timestamp < fs.st_mtime;
-					}
-					if (check) {
-						sp_measure_proc_data_t data;
-						if (sp_measure_init_proc_data(&data, pid, 0, NULL) == 0 && data.common->name &&
-								app_data_is_process_monitored(self, data.common->name) &&
-								!app_data_proc_exists(self, pid) ) {
-							proc_data_t* proc = app_data_add_proc(self, pid);
-							if (proc) proc_data_create_header(proc, self, self->proc_count - 1);
-							rc = 1;
-						}
-						sp_measure_free_proc_data(&data);
-					}
-				}
-			}
-			closedir(procDir);
-		}
-		last_timestamp = current_timestamp;
-
-		/* check for terminated processes */
-		proc_data_t* proc = self->proc_list;
-		while (proc) {
-			proc_data_t* proc_free = NULL;
-			int pid = proc->data[0].common->pid;
-			sprintf(buffer, "/proc/%d", pid);
-			if (access(buffer, F_OK) != 0) {
-				proc_free = proc;
-			}
-			proc = proc->next;
-			if (proc_free) {
-				app_data_remove_proc(self, pid);
-				rc = 1;
-			}
-		}
+	replay_item_t* item = (replay_item_t*)args;
+	int value = item->replay->latest->procs[item->index].mem_dirty;
+	if (value == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%8d", value);
+}
+
+/**
+ * Writes replayed process private dirty memory change since the last printed sample.
+ */
+int
+write_replay_proc_mem_change(char* buffer, int size, void* args)
+{
+	replay_item_t* item = (replay_item_t*)args;
+	const mem_cpu_shm_proc_t* proc = &item->replay->latest->procs[item->index];
+	int value = proc->mem_change;
+	if (item->replay->has_printed) {
+		int index = replay_find_proc(item->replay->printed, proc->pid);
+		int dirty = index == -1 ? MEM_CPU_SHM_UNDEFINED : item->replay->printed->procs[index].mem_dirty;
+		value = proc->mem_dirty != MEM_CPU_SHM_UNDEFINED && dirty != MEM_CPU_SHM_UNDEFINED ?
+				proc->mem_dirty - dirty : MEM_CPU_SHM_UNDEFINED;
 	}
-	return rc;
+	if (value == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%+6d", value);
 }
 
+/**
+ * Writes replayed process CPU usage.
+ */
+int
+write_replay_proc_cpu_usage(char* buffer, int size, void* args)
+{
+	replay_item_t* item = (replay_item_t*)args;
+	replay_data_t* replay = item->replay;
+	int value = replay->latest->procs[item->index].cpu_usage;
+	if (!replay->proc_cpu_time[item->index] && value == MEM_CPU_SHM_UNDEFINED) {
+		strcpy(buffer, NO_DATA);
+		return sizeof(NO_DATA) - 1;
+	}
+	return snprintf(buffer, size + 1, "%5.1f%%",
+			replay_cpu_usage(replay->proc_cpu_sum[item->index], replay->proc_cpu_time[item->index], value) / 100);
+}
 
 /**
- * Execute the specified application and start monitoring it.
+ * Creates the replay report header for the latest sample layout.
+ *
+ * @param[in] replay   the replay state.
+ * @return             0 for success.
  */
 static int
-execute_application(app_data_t* self, const char* cmd)
+replay_create_header(replay_data_t* replay)
 {
-	int pid = fork();
-	if (pid == 0) {
-		char* argv[100];
-		char buffer[512];
-		int argc = 0;
-		const char* in = cmd;
-		char* out = buffer;
-
-		/* parse the command line */
-		while (*in) {
-			switch (*in) {
-				case '"':
-				case '\'': {
-					char quote = *in++;
-					while (*in && *in != quote) *out++ = *in++;
-					break;
-				}
-				case ' ':
-				case '\0': {
-					if (out != buffer) {
-						*out = '\0';
-						argv[argc++] = strdup(buffer);
-						out = buffer;
-					}
-					break;
-				}
-				default: {
-					*out++ = *in;
-					break;
-				}
-			}
-			in++;
-		}
-		if (out != buffer) {
-			*out = '\0';
-			argv[argc++] = strdup(buffer);
+	const mem_cpu_shm_sample_t* sample = replay->latest;
+	char buffer[256];
+	int i;
+
+	sp_report_header_free(replay->root_header.child);
+	memset(&replay->root_header, 0, sizeof(sp_report_header_t));
+
+	if (sp_report_header_add_child(&replay->root_header, HEADER_TITLE_TIMESTAMP, replay->print_msecs ? 12 : 8,
+			replay->print_msecs ? SP_REPORT_ALIGN_CENTER : SP_REPORT_ALIGN_RIGHT, write_replay_timestamp, replay) == NULL) return -ENOMEM;
+	if (replay->flags & MEM_CPU_RECORD_WATERMARK) {
+		if (sp_report_header_add_child(&replay->root_header, "BL", 2, SP_REPORT_ALIGN_CENTER, write_replay_mem_watermark, replay) == NULL) return -ENOMEM;
+	}
+
+	sp_report_header_t* mem_header = sp_report_header_add_child(&replay->root_header, "system memory", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+	if (mem_header == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(mem_header, "used:", 10, SP_REPORT_ALIGN_RIGHT, write_replay_mem_used, replay) == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(mem_header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_replay_mem_change, replay) == NULL) return -ENOMEM;
+
+	for (i = 0; i < sample->cgroup_count; i++) {
+		replay_item_t* item = &replay->items[MEM_CPU_SHM_MAX_PROCS + i];
+		item->replay = replay;
+		item->index = i;
+		snprintf(buffer, sizeof(buffer), "[%s]", sample->cgroups[i].name);
+		sp_report_header_t* cgroup_header = sp_report_header_add_child(&replay->root_header, buffer, 0, SP_REPORT_ALIGN_CENTER, NULL, NULL);
+		if (cgroup_header == NULL) return -ENOMEM;
+		if (colors) {
+			hlight_t* hlight = &hlight_cgroup[(i + 1) & 1];
+			sp_report_header_set_color(cgroup_header, hlight->set, hlight->clear);
 		}
-		argv[argc] = NULL;
-		/* execute application */
-		if (execvp(argv[0], argv) == -1) {
-			return -1;
+		if (sp_report_header_add_child(cgroup_header, "used:", 10, SP_REPORT_ALIGN_RIGHT, write_replay_cgroup_used, item) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(cgroup_header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_replay_cgroup_change, item) == NULL) return -ENOMEM;
+	}
+
+	sp_report_header_t* cpu_header = sp_report_header_add_child(&replay->root_header, "system CPU", 0, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+	if (cpu_header == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(cpu_header, "%:", 6, SP_REPORT_ALIGN_RIGHT, write_replay_cpu_usage, replay) == NULL) return -ENOMEM;
+	if (sp_report_header_add_child(cpu_header, "MHz:", 5, SP_REPORT_ALIGN_RIGHT, write_replay_cpu_freq, replay) == NULL) return -ENOMEM;
+
+	for (i = 0; i < sample->proc_count; i++) {
+		replay_item_t* item = &replay->items[i];
+		item->replay = replay;
+		item->index = i;
+		snprintf(buffer, sizeof(buffer), "PID %d %s", sample->procs[i].pid, sample->procs[i].name);
+		sp_report_header_t* proc_header = sp_report_header_add_child(&replay->root_header, buffer, 30, SP_REPORT_ALIGN_LEFT, NULL, NULL);
+		if (proc_header == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc_header, "clean:", 8, SP_REPORT_ALIGN_RIGHT, write_replay_proc_mem_clean, item) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc_header, "dirty:", 8, SP_REPORT_ALIGN_RIGHT, write_replay_proc_mem_dirty, item) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc_header, "change:", 8, SP_REPORT_ALIGN_RIGHT, write_replay_proc_mem_change, item) == NULL) return -ENOMEM;
+		if (sp_report_header_add_child(proc_header, "CPU-%:", 7, SP_REPORT_ALIGN_RIGHT, write_replay_proc_cpu_usage, item) == NULL) return -ENOMEM;
+		if (colors && !(i & 1)) {
+			sp_report_header_set_color(proc_header, COLOR_PROCESS, COLOR_CLEAR);
 		}
+	}
+	return 0;
+}
 
-		while (argc--) {
-			free(argv[argc]);
+/**
+ * Accumulates the latest sample CPU usage.
+ *
+ * The process CPU usage sums are moved to the latest sample process
+ * indices, as the monitored processes might have changed.
+ * @param[in] replay   the replay state.
+ */
+static void
+replay_accumulate(replay_data_t* replay)
+{
+	const mem_cpu_shm_sample_t* prev = replay->prev;
+	const mem_cpu_shm_sample_t* latest = replay->latest;
+	double proc_cpu_sum[MEM_CPU_SHM_MAX_PROCS], proc_cpu_time[MEM_CPU_SHM_MAX_PROCS];
+	double duration = latest->time > prev->time ? latest->time - prev->time : 0;
+	int i;
+
+	if (latest->cpu_usage != MEM_CPU_SHM_UNDEFINED) {
+		replay->cpu_sum += latest->cpu_usage * duration;
+		replay->cpu_time += duration;
+	}
+	for (i = 0; i < latest->proc_count; i++) {
+		int index = replay_find_proc(prev, latest->procs[i].pid);
+		proc_cpu_sum[i] = index == -1 ? 0 : replay->proc_cpu_sum[index];
+		proc_cpu_time[i] = index == -1 ? 0 : replay->proc_cpu_time[index];
+		if (latest->procs[i].cpu_usage != MEM_CPU_SHM_UNDEFINED) {
+			proc_cpu_sum[i] += latest->procs[i].cpu_usage * duration;
+			proc_cpu_time[i] += duration;
 		}
 	}
-	if (pid == -1) {
-		return -1;
+	memcpy(replay->proc_cpu_sum, proc_cpu_sum, latest->proc_count * sizeof(double));
+	memcpy(replay->proc_cpu_time, proc_cpu_time, latest->proc_count * sizeof(double));
+}
+
+/**
+ * Checks if the monitored processes or cgroups differ between samples.
+ */
+static bool
+replay_layout_changed(const mem_cpu_shm_sample_t* sample1, const mem_cpu_shm_sample_t* sample2)
+{
+	int i;
+	if (sample1->proc_count != sample2->proc_count || sample1->cgroup_count != sample2->cgroup_count) return true;
+	for (i = 0; i < sample1->proc_count; i++) {
+		if (sample1->procs[i].pid != sample2->procs[i].pid) return true;
 	}
-	return app_data_add_proc(self, pid) == 0 ? -1 : 0;
+	for (i = 0; i < sample1->cgroup_count; i++) {
+		if (strcmp(sample1->cgroups[i].name, sample2->cgroups[i].name)) return true;
+	}
+	return false;
 }
 
 /**
- * Cleanup terminated child processes.
+ * Checks if the latest sample should be printed.
+ *
+ * The same change thresholds are applied as when monitoring, the
+ * changes are relative to the last printed sample.
+ * @param[in] self     the application data.
+ * @param[in] replay   the replay state.
+ * @return             true if the sample should be printed.
  */
-static void process_closed(int sig __attribute__((unused)))
+static bool
+replay_check_print(app_data_t* self, replay_data_t* replay)
 {
-	int status;
-	wait(&status);
+	const mem_cpu_shm_sample_t* printed = replay->printed;
+	const mem_cpu_shm_sample_t* latest = replay->latest;
+	int i;
+
+	if (!replay->has_printed) return true;
+	if (replay->interval && latest->time + replay->interval / 10 < printed->time + replay->interval) return false;
+	if (replay_layout_changed(printed, latest) || do_print_report_default) return true;
+
+	if (IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_SYS_MEM_CHANGES_ONLY) &&
+			latest->mem_used != MEM_CPU_SHM_UNDEFINED && printed->mem_used != MEM_CPU_SHM_UNDEFINED &&
+			abs(latest->mem_used - printed->mem_used) >= sys_mem_change_threshold) {
+		return true;
+	}
+	if (IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_SYS_CPU_CHANGES_ONLY) && replay->cpu_time &&
+			replay_cpu_usage(replay->cpu_sum, replay->cpu_time, 0) / 100 >= sys_cpu_change_threshold) {
+		return true;
+	}
+	for (i = 0; i < latest->proc_count; i++) {
+		if (IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_MEM_CHANGES_ONLY) &&
+				latest->procs[i].mem_dirty != printed->procs[i].mem_dirty) {
+			return true;
+		}
+		if (IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_CPU_CHANGES_ONLY) && replay->proc_cpu_sum[i] > 0) {
+			return true;
+		}
+	}
+	return false;
 }
 
 /**
- * Parses application command line.
+ * Replays recorded run.
+ *
+ * The samples are read and reported at full speed, applying the change
+ * thresholds and aggregating the samples into the interval given with
+ * command line options.
+ * @param[in] self   the application data.
+ * @return           0 for success.
  */
-static void
-parse_cmdline(int argc, char** argv, app_data_t* self)
+static int
+app_data_replay(app_data_t* self)
 {
-	int opt;
-	char* output_path = NULL;
-	while ((opt = getopt_long(argc, argv, "p:hf:mcM:C:i:n:x:N:G:", long_opts, NULL)) != -1) {
-		/* getopt allows -<char><arg> which gives confusing results
-		 * when one writes --name foobar as -name.  Complain about it.
-		 */
-		if (optarg && argv[optind - 1] != optarg && *(argv[optind - 1] + 1) != '-') {
-			fprintf(stderr, "ERROR: failed to parse argument %s!\n", argv[optind - 1]);
-			exit(1);
+	replay_t* reader = replay_open(self->replay_path);
+	mem_cpu_shm_sample_t* swap;
+	bool do_print_header = true;
+	int rc, samples = 0;
+
+	if (!reader) {
+		fprintf(stderr, "ERROR: failed to open recorded run %s.\n", self->replay_path);
+		return -1;
+	}
+	replay_data_t* replay = calloc(1, sizeof(replay_data_t));
+	if (!replay) {
+		replay_close(reader);
+		return -ENOMEM;
+	}
+	replay->printed = &replay->samples[0];
+	replay->prev = &replay->samples[1];
+	replay->latest = &replay->samples[2];
+	if (IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_INTERVAL_OPTION_SET)) {
+		replay->interval = self->sleep_interval / 1000;
+	}
+
+	if (!isatty(fileno(output))) colors = false;
+	while ( (rc = replay_read(reader, replay->latest)) == 0) {
+		if (!samples++) {
+			replay->flags = reader->flags;
+			replay->print_msecs = (replay->latest->time % 1000) || (replay->interval % 1000);
+			fprintf(output, "System: CPU: 0 MHz max, total memory: %u kB RAM, %u kB swap\n",
+					replay->latest->mem_total, replay->latest->mem_swap);
 		}
-		switch (opt) {
-		case 'f':
-			output_path = strdup(optarg);
-			break;
-		case 'h':
-			usage();
-			exit(0);
-		case 1001:
-			colors = false;
-			break;
-		case 1002:
-			if ( app_data_add_proc(self, getpid()) == NULL) {
-				fprintf(stderr, "Error during process %d monitoring initialization!\n",
-							getpid());
-				exit(-1);
-			}
-			break;
-		case 'p':
-			if (app_data_add_proc(self, atoi(optarg)) == NULL) {
-				fprintf(stderr, "Error during process %d monitoring initialization!\n",
-							atoi(optarg));
-				exit(-1);
-			}
-			break;
-		case 'm':
-			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_PROC_MEM_CHANGES_ONLY);
-			do_print_report_default = false;
-			break;
-		case 'c':
-			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_PROC_CPU_CHANGES_ONLY);
-			do_print_report_default = false;
-			break;
-		case 'M':
-			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_SYS_MEM_CHANGES_ONLY);
-			sys_mem_change_threshold = atoi(optarg);
-			do_print_report_default = false;
-			break;
-		case 'C':
-			ADD_OPTION_VALUE_FLAG(self->option_flags, OF_SYS_CPU_CHANGES_ONLY);
-			if (!sscanf(optarg, "%f", &sys_cpu_change_threshold) ) {
-				fprintf(stderr, "ERROR: invalid CPU change threshold for the system\n");
-				exit(1);
-			}
-			do_print_report_default = false;
-			break;
-		case 'i':
-			if (app_data_set_sleep_interval(self, optarg) != 0) {
-				exit(1);
-			}
-			break;
-		case 'n':
-			do_full_process_scan = true;
-		case 'N':
-			if (app_data_monitor_process_name(self, optarg) != 0) {
-				fprintf(stderr, "ERROR: failed to monitor process %s\n", optarg);
-				exit(1);
+		else {
+			replay_accumulate(replay);
+		}
+
+		if (replay_check_print(self, replay)) {
+			if (!replay->has_printed || replay_layout_changed(replay->printed, replay->latest) ||
+					replay->flags != reader->flags) {
+				replay->flags = reader->flags;
+				do_print_header = true;
 			}
-			break;
-		case 'x':
-			if (execute_application(self, optarg) != 0) {
-				fprintf(stderr, "ERROR: failed to execute command %s\n", optarg);
-				exit(1);
+			if (do_print_header) {
+				if ( (rc = replay_create_header(replay)) != 0 ||
+						(rc = sp_report_print_header(output, &replay->root_header)) != 0) {
+					fprintf(stderr, "ERROR: failed to print report header (%d).\n", rc);
+					break;
+				}
+				do_print_header = false;
 			}
-			break;
-		case 'G':
-			app_data_add_cgroup(self, optarg);
-			break;
-		case 'F':
-			break;
-		default:
-			usage();
-			exit(1);
+			sp_report_print_data(output, &replay->root_header);
+
+			/* the printed sample is the base for the next changes */
+			swap = replay->printed;
+			replay->printed = replay->latest;
+			replay->latest = swap;
+			replay->has_printed = true;
+			replay->cpu_sum = replay->cpu_time = 0;
+			memset(replay->proc_cpu_sum, 0, sizeof(replay->proc_cpu_sum));
+			memset(replay->proc_cpu_time, 0, sizeof(replay->proc_cpu_time));
+			memcpy(replay->prev, replay->printed, sizeof(mem_cpu_shm_sample_t));
 		}
-	}
-	if (output_path) {
-		FILE* fp = fopen(output_path, "a");
-		if (!fp) {
-			perror("ERROR: unable to open output file");
-			exit(1);
+		else {
+			swap = replay->prev;
+			replay->prev = replay->latest;
+			replay->latest = swap;
 		}
-		output = fp;
-		free(output_path);
-	} else {
-		output = stdout;
 	}
-	while (optind < argc) {
-		int pid = atoi(argv[optind]);
-		if (!pid) {
-			fprintf(stderr, "WARNING: Failed to parse target process pid: %s\n", argv[optind]);
-		}
-		else if (app_data_add_proc(self, pid) == NULL) {
-			fprintf(stderr, "Error occurred during process %d monitoring initialization!\n",
-						atoi(argv[optind]));
-			exit(-1);
-		}
-		++optind;
+	if (rc < 0) {
+		fprintf(stderr, "ERROR: recorded run %s is corrupted after %d samples.\n", self->replay_path, samples);
 	}
-	// determine if no printing needs to be done by default
-	if (self->proc_list &&
-		(IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_MEM_CHANGES_ONLY) ||
-		 IS_OPTION_VALUE_FLAG_SET(self->option_flags, OF_PROC_CPU_CHANGES_ONLY) ) ) {
+	fflush(output);
 
-		do_print_report_default = false;
-	}
+	sp_report_header_free(replay->root_header.child);
+	free(replay);
+	replay_close(reader);
+	return rc < 0 ? -1 : 0;
 }
 
 /* When printing results to console, we want to periodically reprint the
@@ -1362,22 +3743,56 @@ int main(int argc, char** argv)
 	int rows=0, lines_printed=0;
 	app_data_t app_data = {
 			.resource_flags = SNAPSHOT_SYS,
+			.proc_snapshot_flags = SNAPSHOT_PROC,
 			.sleep_interval = DEFAULT_SLEEP_INTERVAL,
 	};
 	int rc = 0, value;
 	sp_measure_proc_data_t* proc_data_swap;
 	sp_measure_sys_data_t* sys_data_swap;
+	sys_stat_t* sys_stat_swap;
 	proc_data_t* proc;
 	bool do_print_header = true;
+	bool startup_reported = false;
 	bool do_print_report;
 	struct timeval timestamp = {0, 0};
 
 	parse_cmdline(argc, argv, &app_data);
 
+	if (app_data.replay_path) {
+		rc = app_data_replay(&app_data);
+		free(app_data.replay_path);
+		return rc == 0 ? 0 : 1;
+	}
+
 	if (app_data_init(&app_data) < 0) {
 		fprintf(stderr, "ERROR: program initialization failed.\n");
 		exit(-1);
 	}
+	app_data_init_taskstats(&app_data);
+
+	if (app_data_init_shm(&app_data) != 0) {
+		exit(-1);
+	}
+
+	if (app_data.record_path && app_data_init_record(&app_data, app_data.record_path) != 0) {
+		exit(-1);
+	}
+
+	if ( (app_data.shm || app_data.record) &&
+			(app_data.sample = calloc(1, sizeof(mem_cpu_shm_sample_t))) == NULL) {
+		fprintf(stderr, "ERROR: failed to allocate sample buffer.\n");
+		exit(-1);
+	}
+
+	if (app_data.startup_window) {
+		if (!startup.pid) {
+			fprintf(stderr, "ERROR: --startup option requires an application started with --exec option.\n");
+			exit(1);
+		}
+		startup.window = app_data.startup_window;
+		startup.interval = app_data.startup_interval;
+		startup_sample(&startup);
+	}
 
 	struct sigaction sa = {.sa_flags = 0, .sa_handler = process_closed};
 	sigemptyset(&sa.sa_mask);
@@ -1385,6 +3800,8 @@ int main(int argc, char** argv)
 		fprintf(stderr, "ERROR: Failed to install SIGCHILD handler\n");
 		exit(-1);
 	}
+	/* reap the applications which terminated before the handler was installed */
+	process_closed(SIGCHLD);
 
 	if (nice(-19) == -1) {
 		perror("Warning: failed to change process priority.");
@@ -1407,6 +3824,12 @@ int main(int argc, char** argv)
 		sa.sa_handler = quit_app;
 		sigaction(SIGINT, &sa, NULL);
 	}
+	// The shared memory segment should be removed also when terminated
+	// by a service manager.
+	if (app_data.shm && sigaction(SIGTERM, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN) {
+		sa.sa_handler = quit_app;
+		sigaction(SIGTERM, &sa, NULL);
+	}
 
 	/* take initial process snapshots */
 	proc = app_data.proc_list;
@@ -1415,22 +3838,57 @@ int main(int argc, char** argv)
 				"Process (name=%s, pid=%d) resource usage snapshot returned (%d).",
 				PROCESS_NAME(proc->data2), proc->data2->common->pid, rc = __rc);
 		proc->resource_flags &= (~rc);
+		/* the rate column baselines */
+		proc_data_read_collectors(proc);
+		proc->stat_prev = proc->stat;
+		memcpy(proc->perf_values_prev, proc->perf_values, sizeof(proc->perf_values));
 		proc = proc->next;
 	}
 
+	/* set process tree CPU time baselines */
+	if (app_data.tree_mode) {
+		app_data_update_trees(&app_data);
+	}
+
 	gettimeofday(&timestamp, NULL);
+	/* the schedule overrun of the previous tick, when the schedule was
+	 * restarted because the interval was too small (us) */
+	unsigned long long overrun = 0;
 
 	do_print_report = true;
 	while (!quit) {
+		/* switch to the next snapshot of a capture archive */
+		if (proc_root_is_archive() && proc_root_next() != 0) break;
+
+		/* tick lateness versus the schedule */
+		unsigned long long lateness = 0;
+		if (app_data.overhead && !proc_root_is_archive()) {
+			struct timeval now;
+			gettimeofday(&now, NULL);
+			long long late = (now.tv_sec - timestamp.tv_sec) * 1000000LL + now.tv_usec - timestamp.tv_usec;
+			if (late > 0) lateness = late;
+			lateness += overrun;
+		}
+		overrun = 0;
+
 		/* scan for processes to monitor */
+		OVERHEAD_BEGIN(&app_data, OVERHEAD_DISCOVERY);
 		if (app_data_scan_processes(&app_data) == 1) {
 			do_print_header = true;
 		}
+		OVERHEAD_END(&app_data, OVERHEAD_DISCOVERY);
 
 		/* take system snapshot */
+		OVERHEAD_BEGIN(&app_data, OVERHEAD_SYSTEM);
 		CHECK_SNAPSHOT_RC(sp_measure_get_sys_data(app_data.sys_data2, app_data.resource_flags, NULL),
 				"System resource usage snapshot returned (%d).", rc = __rc);
 		app_data.resource_flags &= (~rc);
+		if (proc_root_is_archive()) {
+			FIELD_SYS_TIMESTAMP(app_data.sys_data2) = proc_root_time();
+		}
+		if (app_data.sys_stat_flags) {
+			sys_stat_read(app_data.sys_stat_flags, app_data.sys_stat2);
+		}
 
 		/* check if report should be printed */
 		if (!do_print_report) {
@@ -1462,7 +3920,13 @@ int main(int argc, char** argv)
 			cgroup_read(cgroup);
 			cgroup = cgroup->next;
 		}
+		OVERHEAD_END(&app_data, OVERHEAD_SYSTEM);
+		OVERHEAD_BEGIN(&app_data, OVERHEAD_PROCESS);
 
+		/* account the delays of the exited child processes */
+		if (app_data.taskstats && taskstats_read_exits(app_data.taskstats, app_data_account_exit, &app_data) == -ENOBUFS) {
+			fprintf(stderr, "Warning: taskstats exit notifications were lost.\n");
+		}
 
 		/* take process snapshots */
 		proc = app_data.proc_list;
@@ -1483,7 +3947,19 @@ int main(int argc, char** argv)
 				}
 			}
   			/* take snapshot */
-			if ( (rc = sp_measure_get_proc_data(proc->data2, proc->resource_flags, NULL)) >= 0) {
+			rc = sp_measure_get_proc_data(proc->data2, proc->resource_flags, NULL);
+			/* read only the /proc/<pid>/ files needed by the selected columns */
+			if (rc >= 0 && app_data.proc_stat_flags &&
+					proc_stat_read(FIELD_PROC_PID(proc->data2), app_data.proc_stat_flags & ~PROC_STAT_IO, &proc->stat) < 0) {
+				rc = -1;
+			}
+			if (rc >= 0) {
+				proc_data_read_collectors(proc);
+			}
+			if (rc >= 0) {
+				if (app_data.trend_window) {
+					proc_data_update_trend(proc);
+				}
 				/* check if the report should be printed */
 				if (!do_print_report) {
 					if (IS_OPTION_VALUE_FLAG_SET(app_data.option_flags, OF_PROC_MEM_CHANGES_ONLY)) {
@@ -1525,7 +4001,33 @@ int main(int argc, char** argv)
 			}
 		}
 
+		/* update process trees */
+		if (app_data.tree_mode && app_data_update_trees(&app_data) == 1) {
+			do_print_header = true;
+		}
+		OVERHEAD_END(&app_data, OVERHEAD_PROCESS);
+
+		/* report the startup profile when the profiled application terminates */
+		if (startup.window && startup.exited && !startup_reported) {
+			startup_report(&startup, stderr);
+			startup_reported = true;
+		}
+
+		/* publish the completed sample for shared memory readers and recording */
+		if (app_data.sample) {
+			app_data_update_sample(&app_data);
+			if (app_data.shm) {
+				mem_cpu_shm_publish(app_data.shm, app_data.sample);
+			}
+			if (app_data.record && replay_record_write(app_data.record, app_data.sample) != 0) {
+				fprintf(stderr, "Warning: failed to write recording, recording stopped.\n");
+				fclose(app_data.record);
+				app_data.record = NULL;
+			}
+		}
+
 		/* reprint header if its the first time or next screen or a process was added/removed */
+		OVERHEAD_BEGIN(&app_data, OVERHEAD_RENDER);
 		if (do_print_header) {
 			if ( (rc = sp_report_print_header(output, &app_data.root_header)) != 0) {
 				fprintf(stderr, "ERROR: failed to print report header (%d).\n", rc);
@@ -1539,25 +4041,46 @@ int main(int argc, char** argv)
 		if (do_print_report) {
 			sp_report_print_data(output, &app_data.root_header);
 			fflush(output);
+		}
+		OVERHEAD_END(&app_data, OVERHEAD_RENDER);
+		if (app_data.overhead) {
+			overhead_tick(app_data.overhead, lateness);
+		}
 
+		if (do_print_report) {
 			/* swap snapshot references so last snapshot is again in app_data.sys_data1 and
 			 * the next snapshot will be stored into app_data.sys_data2 */
 			sys_data_swap = app_data.sys_data1;
 			app_data.sys_data1 = app_data.sys_data2;
 			app_data.sys_data2 = sys_data_swap;
+			sys_stat_swap = app_data.sys_stat1;
+			app_data.sys_stat1 = app_data.sys_stat2;
+			app_data.sys_stat2 = sys_stat_swap;
 			/* do the same for project snapshots */
 			for (proc = app_data.proc_list; proc; proc = proc->next) {
+				proc->stat_prev = proc->stat;
+				memcpy(proc->perf_values_prev, proc->perf_values, sizeof(proc->perf_values));
 				proc_data_swap = proc->data1;
 				proc->data1 = proc->data2;
 				proc->data2 = proc_data_swap;
+				proc->tree_cpu1 = proc->tree_cpu2;
+				proc->sample_cpu_ticks = 0;
+				proc->sample_mem_change = 0;
 			}
 
 			/* swap cgroups data snapshots */
 			cgroup_data_t* cgroup = app_data.cgroups;
 			while (cgroup) {
 				cgroup_swap(cgroup);
+				cgroup->sample_mem_change = 0;
 				cgroup = cgroup->next;
 			}
+
+			/* the next sample changes are relative to the printed report */
+			app_data.sample_ticks = 0;
+			app_data.sample_cpu_usage = 0;
+			app_data.sample_cpu_freq = 0;
+			app_data.sample_mem_change = 0;
 		}
 
 		if (quit) break;
@@ -1567,12 +4090,21 @@ int main(int argc, char** argv)
 		int interval  = (tv.tv_sec - timestamp.tv_sec) * 1000000 + tv.tv_usec - timestamp.tv_usec;
 		/* the sleep could be interrupted, force interval to 0 in that case */
 		if (interval < 0) interval = 0;
-		if (interval > (int)app_data.sleep_interval) {
+		if (proc_root_is_archive()) {
+			/* the captured snapshots are processed at full speed */
+		}
+		else if (interval > (int)app_data.sleep_interval) {
 			fprintf(stderr, "Warning, the specified update interval is too small, please increase it.\n");
+			overrun = interval - app_data.sleep_interval;
 			gettimeofday(&timestamp, NULL);
 		}
 		else {
-			usleep(app_data.sleep_interval - interval);
+			if (startup_is_active(&startup)) {
+				startup_sleep(&startup, app_data.sleep_interval - interval);
+			}
+			else {
+				usleep(app_data.sleep_interval - interval);
+			}
 			timestamp.tv_usec += app_data.sleep_interval;
 			timestamp.tv_sec += timestamp.tv_usec / 1000000;
 			timestamp.tv_usec %= 1000000;
@@ -1590,6 +4122,13 @@ int main(int argc, char** argv)
 		do_print_report = do_print_report_default;
 	}
 
+	if (startup.window && !startup_reported) {
+		startup_report(&startup, stderr);
+	}
+	if (app_data.overhead) {
+		overhead_report(app_data.overhead, stderr);
+	}
+
 	while (app_data.proc_list) {
 		app_data_remove_proc(&app_data, FIELD_PROC_PID(&app_data.proc_list->data[0]));
 	}
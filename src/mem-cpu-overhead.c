@@ -0,0 +1,313 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "mem-cpu-overhead.h"
+#include "proc-root.h"
+
+/**
+ * Private API
+ */
+
+/* heap allocations and the allocated bytes, updated by the allocator
+ * wrappers with MEM_CPU_BENCH */
+static unsigned long long allocs;
+static unsigned long long alloc_bytes;
+
+static const char* phase_names[OVERHEAD_PHASE_COUNT] = {
+	[OVERHEAD_DISCOVERY] = "discovery",
+	[OVERHEAD_SYSTEM] = "system",
+	[OVERHEAD_PROCESS] = "process",
+	[OVERHEAD_RENDER] = "render",
+};
+
+/**
+ * Reads clock in nanoseconds.
+ */
+static unsigned long long
+clock_read(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Adds value to log2 histogram.
+ *
+ * @param[in] hist   the histogram.
+ * @param[in] value  the value (us).
+ */
+static void
+hist_add(unsigned long* hist, unsigned long long value)
+{
+	int bucket = 0;
+	while (value && bucket < OVERHEAD_HIST_SIZE - 1) {
+		value >>= 1;
+		bucket++;
+	}
+	hist[bucket]++;
+}
+
+/**
+ * Calculates histogram percentile.
+ *
+ * @param[in] hist     the histogram.
+ * @param[in] percent  the percentile.
+ * @param[in] max      the maximum value (us).
+ * @return             the upper bound of the bucket containing the
+ *                     percentile, limited to the maximum value (us).
+ */
+static unsigned long long
+hist_percentile(const unsigned long* hist, int percent, unsigned long long max)
+{
+	unsigned long long total = 0, sum = 0;
+	int i;
+	for (i = 0; i < OVERHEAD_HIST_SIZE; i++) total += hist[i];
+	for (i = 0; i < OVERHEAD_HIST_SIZE; i++) {
+		sum += hist[i];
+		if (sum * 100 >= total * percent) break;
+	}
+	unsigned long long bound = 1ULL << (i < OVERHEAD_HIST_SIZE ? i : OVERHEAD_HIST_SIZE - 1);
+	return bound < max ? bound : max;
+}
+
+/**
+ * Updates per tick counter.
+ */
+static void
+counter_update(overhead_counter_t* counter, unsigned long long value)
+{
+	counter->tick = value;
+	counter->total += value;
+	if (value > counter->max) counter->max = value;
+}
+
+/**
+ * Reads the system call and read byte counts of the process.
+ *
+ * @param[in] self       the statistics.
+ * @param[out] syscalls  the read, write and open calls.
+ * @param[out] bytes     the bytes read.
+ * @return               0 for success.
+ */
+static int
+io_read(overhead_t* self, unsigned long long* syscalls, unsigned long long* bytes)
+{
+	char buffer[512];
+	const char* ptr;
+	*syscalls = proc_root_calls;
+	*bytes = 0;
+	if (self->io_fd < 0) return -1;
+	ssize_t len = pread(self->io_fd, buffer, sizeof(buffer) - 1, 0);
+	if (len <= 0) return -1;
+	buffer[len] = '\0';
+	if ( (ptr = strstr(buffer, "rchar:")) ) *bytes = strtoull(ptr + 6, NULL, 10);
+	if ( (ptr = strstr(buffer, "syscr:")) ) *syscalls += strtoull(ptr + 6, NULL, 10);
+	if ( (ptr = strstr(buffer, "syscw:")) ) *syscalls += strtoull(ptr + 6, NULL, 10);
+	return 0;
+}
+
+/**
+ * Writes a histogram row.
+ */
+static void
+report_hist(FILE* fp, const char* name, const unsigned long* hist, int first, int last)
+{
+	int i;
+	fprintf(fp, "%-10s", name);
+	for (i = first; i <= last; i++) fprintf(fp, " %7lu", hist[i]);
+	fprintf(fp, "\n");
+}
+
+/**
+ * Public API
+ */
+
+#ifdef MEM_CPU_BENCH
+/*
+ * The glibc allocator entry points are wrapped to count the heap
+ * allocations of the monitor and the libraries it uses.
+ */
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+void*
+malloc(size_t size)
+{
+	allocs++;
+	alloc_bytes += size;
+	return __libc_malloc(size);
+}
+
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+	allocs++;
+	alloc_bytes += nmemb * size;
+	return __libc_calloc(nmemb, size);
+}
+
+
+void*
+realloc(void* ptr, size_t size)
+{
+	allocs++;
+	alloc_bytes += size;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+/**
+ * See header for specifications.
+ */
+
+void
+overhead_init(overhead_t* self)
+{
+	memset(self, 0, sizeof(overhead_t));
+	self->io_fd = open("/proc/self/io", O_RDONLY);
+	io_read(self, &self->io_syscalls, &self->io_bytes);
+}
+
+
+void
+overhead_release(overhead_t* self)
+{
+	if (self->io_fd >= 0) close(self->io_fd);
+	self->io_fd = -1;
+}
+
+
+void
+overhead_begin(overhead_t* self, int phase)
+{
+	overhead_phase_t* stat = &self->phases[phase];
+	stat->allocs_start = allocs;
+	stat->alloc_bytes_start = alloc_bytes;
+	stat->wall_start = clock_read(CLOCK_MONOTONIC);
+	stat->cpu_start = clock_read(CLOCK_THREAD_CPUTIME_ID);
+}
+
+
+void
+overhead_end(overhead_t* self, int phase)
+{
+	overhead_phase_t* stat = &self->phases[phase];
+	unsigned long long cpu = clock_read(CLOCK_THREAD_CPUTIME_ID) - stat->cpu_start;
+	unsigned long long wall = clock_read(CLOCK_MONOTONIC) - stat->wall_start;
+	stat->cpu += cpu;
+	if (wall > stat->wall_max) stat->wall_max = wall;
+	hist_add(stat->hist, wall / 1000);
+	stat->count++;
+	stat->allocs_total += allocs - stat->allocs_start;
+	stat->alloc_bytes_total += alloc_bytes - stat->alloc_bytes_start;
+}
+
+
+void
+overhead_tick(overhead_t* self, unsigned long long lateness)
+{
+	unsigned long long syscalls, bytes;
+	int i;
+	for (i = 0; i < OVERHEAD_PHASE_COUNT; i++) {
+		overhead_phase_t* stat = &self->phases[i];
+		stat->tick_cpu = stat->cpu;
+		stat->cpu_total += stat->cpu;
+		if (stat->cpu > stat->cpu_max) stat->cpu_max = stat->cpu;
+		stat->cpu = 0;
+	}
+	if (io_read(self, &syscalls, &bytes) == 0) {
+		counter_update(&self->syscalls, syscalls - self->io_syscalls);
+		counter_update(&self->bytes_read, bytes - self->io_bytes);
+		self->io_syscalls = syscalls;
+		self->io_bytes = bytes;
+	}
+	counter_update(&self->lateness, lateness);
+	hist_add(self->lateness_hist, lateness);
+	self->ticks++;
+}
+
+
+void
+overhead_report(const overhead_t* self, FILE* fp)
+{
+	unsigned long long total_avg = 0;
+	int i, first = OVERHEAD_HIST_SIZE, last = 0;
+
+	if (!self->ticks) return;
+	fprintf(fp, "Monitor overhead over %lu ticks (usec):\n", self->ticks);
+	fprintf(fp, "%-10s %9s %9s %9s %9s %9s\n", "phase", "CPU-avg:", "CPU-max:",
+			"lat-p50:", "lat-p99:", "lat-max:");
+	for (i = 0; i < OVERHEAD_PHASE_COUNT; i++) {
+		const overhead_phase_t* stat = &self->phases[i];
+		fprintf(fp, "%-10s %9llu %9llu %9llu %9llu %9llu\n", phase_names[i],
+				stat->cpu_total / 1000 / self->ticks, stat->cpu_max / 1000,
+				hist_percentile(stat->hist, 50, stat->wall_max / 1000),
+				hist_percentile(stat->hist, 99, stat->wall_max / 1000),
+				stat->wall_max / 1000);
+		total_avg += stat->cpu_total;
+		int bucket;
+		for (bucket = 0; bucket < OVERHEAD_HIST_SIZE; bucket++) {
+			if (!stat->hist[bucket]) continue;
+			if (bucket < first) first = bucket;
+			if (bucket > last) last = bucket;
+		}
+	}
+	fprintf(fp, "%-10s %9llu\n", "total", total_avg / 1000 / self->ticks);
+
+	if (self->io_fd >= 0) {
+		fprintf(fp, "syscalls per tick: %llu avg, %llu max; bytes read per tick: %llu avg, %llu max\n",
+				self->syscalls.total / self->ticks, self->syscalls.max,
+				self->bytes_read.total / self->ticks, self->bytes_read.max);
+	}
+#ifdef MEM_CPU_BENCH
+	fprintf(fp, "heap allocations per tick:\n%-10s %9s %9s\n", "phase", "allocs:", "kB:");
+	for (i = 0; i < OVERHEAD_PHASE_COUNT; i++) {
+		const overhead_phase_t* stat = &self->phases[i];
+		fprintf(fp, "%-10s %9.1f %9.1f\n", phase_names[i], (double)stat->allocs_total / self->ticks,
+				stat->alloc_bytes_total / 1024.0 / self->ticks);
+	}
+#endif
+	fprintf(fp, "tick lateness: %llu avg, %llu p99, %llu max (usec)\n",
+			self->lateness.total / self->ticks, hist_percentile(self->lateness_hist, 99, self->lateness.max),
+			self->lateness.max);
+
+	for (i = 0; i < OVERHEAD_HIST_SIZE; i++) {
+		if (!self->lateness_hist[i]) continue;
+		if (i < first) first = i;
+		if (i > last) last = i;
+	}
+	fprintf(fp, "latency histogram (count below the bound, usec):\n%-10s", "");
+	for (i = first; i <= last; i++) fprintf(fp, " %7llu", 1ULL << i);
+	fprintf(fp, "\n");
+	for (i = 0; i < OVERHEAD_PHASE_COUNT; i++) {
+		report_hist(fp, phase_names[i], self->phases[i].hist, first, last);
+	}
+	report_hist(fp, "lateness", self->lateness_hist, first, last);
+}
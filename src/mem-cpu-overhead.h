@@ -0,0 +1,161 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-overhead.h
+ * Self-overhead instrumentation for mem-cpu-monitor --overhead option.
+ *
+ * The sampling loop phases are bracketed with overhead_begin() and
+ * overhead_end() calls, which accumulate the thread CPU time and the
+ * wall clock latency histogram of each phase. The system calls and
+ * the bytes read are taken from /proc/self/io once per tick and the
+ * open calls are counted by the proc root wrappers. The latest tick
+ * values are shown in report columns and the totals are summarized at
+ * exit.
+ *
+ * With MEM_CPU_BENCH defined (make bench) the heap allocations of each
+ * phase are counted as well, by wrapping the glibc allocator.
+ */
+#ifndef MEM_CPU_OVERHEAD_H
+#define MEM_CPU_OVERHEAD_H
+
+#include <stdio.h>
+
+/**
+ * The instrumented sampling loop phases.
+ */
+enum {
+	/* monitored process discovery */
+	OVERHEAD_DISCOVERY,
+	/* system and cgroup snapshots */
+	OVERHEAD_SYSTEM,
+	/* process and process tree snapshots */
+	OVERHEAD_PROCESS,
+	/* report rendering */
+	OVERHEAD_RENDER,
+	OVERHEAD_PHASE_COUNT
+};
+
+/* number of the log2 histogram buckets, the last one collects
+ * everything above 2^(OVERHEAD_HIST_SIZE - 1) microseconds */
+#define OVERHEAD_HIST_SIZE    24
+
+/**
+ * Phase statistics.
+ */
+typedef struct overhead_phase_t {
+	/* phase start times (ns) */
+	unsigned long long cpu_start;
+	unsigned long long wall_start;
+	/* CPU time of the latest completed tick (ns) */
+	unsigned long long tick_cpu;
+	/* CPU time of the current tick (ns) */
+	unsigned long long cpu;
+	/* total and maximum per tick CPU time (ns) */
+	unsigned long long cpu_total;
+	unsigned long long cpu_max;
+	/* maximum wall clock latency (ns) and the latency histogram,
+	 * bucket i counts latencies below 2^i microseconds */
+	unsigned long long wall_max;
+	unsigned long hist[OVERHEAD_HIST_SIZE];
+	/* number of measurements */
+	unsigned long count;
+	/* heap allocations and allocated bytes at the phase start and the
+	 * totals, counted only with MEM_CPU_BENCH */
+	unsigned long long allocs_start;
+	unsigned long long alloc_bytes_start;
+	unsigned long long allocs_total;
+	unsigned long long alloc_bytes_total;
+} overhead_phase_t;
+
+/**
+ * Per tick counter with totals.
+ */
+typedef struct overhead_counter_t {
+	/* value of the latest completed tick */
+	unsigned long long tick;
+	unsigned long long total;
+	unsigned long long max;
+} overhead_counter_t;
+
+/**
+ * Self-overhead statistics.
+ */
+typedef struct overhead_t {
+	overhead_phase_t phases[OVERHEAD_PHASE_COUNT];
+	/* number of completed ticks */
+	unsigned long ticks;
+
+	/* read, write and open calls */
+	overhead_counter_t syscalls;
+	/* bytes read */
+	overhead_counter_t bytes_read;
+	/* tick lateness versus the schedule (us) and its histogram */
+	overhead_counter_t lateness;
+	unsigned long lateness_hist[OVERHEAD_HIST_SIZE];
+
+	/* /proc/self/io descriptor and the previous counter values */
+	int io_fd;
+	unsigned long long io_syscalls;
+	unsigned long long io_bytes;
+} overhead_t;
+
+/**
+ * Initializes self-overhead statistics.
+ *
+ * @param[in] self   the statistics.
+ */
+void overhead_init(overhead_t* self);
+
+/**
+ * Releases resources allocated by the statistics.
+ *
+ * @param[in] self   the statistics.
+ */
+void overhead_release(overhead_t* self);
+
+/**
+ * Starts measuring a phase.
+ *
+ * @param[in] self   the statistics.
+ * @param[in] phase  the phase (OVERHEAD_* value).
+ */
+void overhead_begin(overhead_t* self, int phase);
+
+/**
+ * Stops measuring a phase.
+ *
+ * @param[in] self   the statistics.
+ * @param[in] phase  the phase (OVERHEAD_* value).
+ */
+void overhead_end(overhead_t* self, int phase);
+
+/**
+ * Completes a tick.
+ *
+ * @param[in] self      the statistics.
+ * @param[in] lateness  the tick start lateness versus the schedule (us).
+ */
+void overhead_tick(overhead_t* self, unsigned long long lateness);
+
+/**
+ * Writes the exit summary.
+ *
+ * @param[in] self   the statistics.
+ * @param[in] fp     the output stream.
+ */
+void overhead_report(const overhead_t* self, FILE* fp);
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+
+#include "mem-cpu-perf.h"
+#include "proc-root.h"
+
+/**
+ * Private API
+ */
+
+/* the software event configurations, in the counter order */
+static const int perf_configs[PROC_PERF_COUNT] = {
+	[PROC_PERF_PAGE_FAULTS] = PERF_COUNT_SW_PAGE_FAULTS,
+	[PROC_PERF_MAJOR_FAULTS] = PERF_COUNT_SW_PAGE_FAULTS_MAJ,
+	[PROC_PERF_CONTEXT_SWITCHES] = PERF_COUNT_SW_CONTEXT_SWITCHES,
+	[PROC_PERF_CPU_MIGRATIONS] = PERF_COUNT_SW_CPU_MIGRATIONS,
+};
+
+/* the number of non-leader counters of a thread */
+#define PERF_MEMBER_COUNT   (PROC_PERF_COUNT - 1)
+
+/* the counter file descriptors open in all processes */
+static int perf_fds = 0;
+
+/**
+ * Checks if the counters of one more thread fit into the file
+ * descriptor budget, half of the open file limit.
+ *
+ * @return   true if the counters can be opened.
+ */
+static int
+perf_fds_available(void)
+{
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) return 1;
+	return perf_fds + PROC_PERF_COUNT <= (long long)limit.rlim_cur / 2;
+}
+
+/**
+ * Opens a software event counter.
+ *
+ * @param[in] tid     the thread identifier.
+ * @param[in] config  the software event.
+ * @param[in] group   the group leader or -1.
+ * @param[in] format  the read format.
+ * @return            the file descriptor or -1 in the case of failure.
+ */
+static int
+perf_open(int tid, int config, int group, int format)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = config;
+	attr.read_format = format;
+	attr.inherit = 1;
+	return syscall(SYS_perf_event_open, &attr, tid, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+/**
+ * Opens the counters of a thread.
+ *
+ * @param[in] self   the process counters.
+ * @param[in] tid    the thread identifier.
+ * @return           0 for success.
+ */
+static int
+perf_open_thread(proc_perf_t* self, int tid)
+{
+	int* members = self->members + self->leader_count * PERF_MEMBER_COUNT;
+	int i;
+	int leader = perf_open(tid, perf_configs[0], -1, self->grouped ? PERF_FORMAT_GROUP : 0);
+	if (leader == -1) return -1;
+	for (i = 0; i < PERF_MEMBER_COUNT; i++) {
+		members[i] = perf_open(tid, perf_configs[i + 1], self->grouped ? leader : -1, 0);
+		if (members[i] == -1) {
+			int err = errno;
+			while (i--) close(members[i]);
+			close(leader);
+			errno = err;
+			return -1;
+		}
+	}
+	self->leaders[self->leader_count++] = leader;
+	perf_fds += PROC_PERF_COUNT;
+	return 0;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+int
+proc_perf_open(proc_perf_t* self, int pid)
+{
+	char path[PATH_MAX];
+	struct dirent* item;
+	int size = 0, err = 0;
+
+	memset(self, 0, sizeof(proc_perf_t));
+	self->grouped = 1;
+
+	proc_root_path(path, sizeof(path), "/proc/%d/task", pid);
+	DIR* dir = opendir(path);
+	if (!dir) return -1;
+	while ( (item = readdir(dir)) ) {
+		int tid = atoi(item->d_name);
+		if (tid <= 0) continue;
+		if (self->leader_count == size) {
+			size = size ? size * 2 : 8;
+			int* leaders = realloc(self->leaders, size * sizeof(int));
+			if (leaders) self->leaders = leaders;
+			int* members = realloc(self->members, size * PERF_MEMBER_COUNT * sizeof(int));
+			if (members) self->members = members;
+			if (!leaders || !members) {
+				err = ENOMEM;
+				break;
+			}
+		}
+		if (!perf_fds_available()) {
+			errno = EMFILE;
+		}
+		else {
+			if (perf_open_thread(self, tid) == 0) continue;
+			/* the thread could have just exited */
+			if (errno == ESRCH) continue;
+			/* try again without grouping if the kernel doesn't support
+			 * reading inherited groups */
+			if (errno == EINVAL && self->grouped && !self->leader_count) {
+				self->grouped = 0;
+				if (perf_open_thread(self, tid) == 0) continue;
+			}
+		}
+		/* out of descriptors, count the threads attached so far */
+		if ((errno == EMFILE || errno == ENFILE) && self->leader_count) {
+			self->partial = 1;
+			break;
+		}
+		err = errno;
+		break;
+	}
+	closedir(dir);
+	if (err || !self->leader_count) {
+		proc_perf_close(self);
+		errno = err ? err : ESRCH;
+		return -1;
+	}
+	return 0;
+}
+
+
+int
+proc_perf_read(proc_perf_t* self, long long values[PROC_PERF_COUNT])
+{
+	int i, j;
+	for (j = 0; j < PROC_PERF_COUNT; j++) values[j] = 0;
+	for (i = 0; i < self->leader_count; i++) {
+		if (self->grouped) {
+			/* the number of counters followed by the counter values */
+			unsigned long long data[PROC_PERF_COUNT + 1];
+			if (read(self->leaders[i], data, sizeof(data)) != sizeof(data)) return -1;
+			for (j = 0; j < PROC_PERF_COUNT; j++) values[j] += data[j + 1];
+		}
+		else {
+			unsigned long long value;
+			if (read(self->leaders[i], &value, sizeof(value)) != sizeof(value)) return -1;
+			values[0] += value;
+			for (j = 0; j < PERF_MEMBER_COUNT; j++) {
+				if (read(self->members[i * PERF_MEMBER_COUNT + j], &value, sizeof(value)) != sizeof(value)) return -1;
+				values[j + 1] += value;
+			}
+		}
+	}
+	return 0;
+}
+
+
+void
+proc_perf_close(proc_perf_t* self)
+{
+	int i;
+	for (i = 0; i < self->leader_count; i++) {
+		int j;
+		/* closing a member counter would also detach it from the group */
+		for (j = 0; j < PERF_MEMBER_COUNT; j++) close(self->members[i * PERF_MEMBER_COUNT + j]);
+		close(self->leaders[i]);
+		perf_fds -= PROC_PERF_COUNT;
+	}
+	free(self->leaders);
+	free(self->members);
+	memset(self, 0, sizeof(proc_perf_t));
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-perf.h
+ * Per-process software event counters for mem-cpu-monitor.
+ *
+ * The page fault, major page fault, context switch and CPU migration
+ * counts of the monitored processes are taken from perf_event_open(2)
+ * software counters instead of polling /proc/<pid>/stat. The counters
+ * are exact, cost nothing between the reads and need no hardware PMU.
+ *
+ * The counters of a thread are opened as a group, so all of them are
+ * read with a single read call. Perf events are attached to threads,
+ * so a group is opened for every thread existing when the process is
+ * attached. The threads created later inherit the counters of their
+ * creator and the counts of the exited threads are added back to the
+ * inherited counters.
+ *
+ * Every thread needs PROC_PERF_COUNT file descriptors. At most half of
+ * the open file limit is used for the counters, the threads beyond it
+ * are left uncounted instead of failing the whole process.
+ *
+ * Attaching needs ptrace access to the process, the kernel
+ * perf_event_paranoid setting can restrict it further.
+ */
+#ifndef MEM_CPU_PERF_H
+#define MEM_CPU_PERF_H
+
+/**
+ * The software event counters.
+ */
+enum {
+	PROC_PERF_PAGE_FAULTS,
+	PROC_PERF_MAJOR_FAULTS,
+	PROC_PERF_CONTEXT_SWITCHES,
+	PROC_PERF_CPU_MIGRATIONS,
+	PROC_PERF_COUNT
+};
+
+/* value of the counters which could not be read */
+#define PROC_PERF_UNDEFINED   (-1)
+
+/**
+ * Process software event counters.
+ */
+typedef struct proc_perf_t {
+	/* the group leader file descriptors, one per attached thread */
+	int* leaders;
+	int leader_count;
+	/* the counters are grouped, otherwise read one by one */
+	int grouped;
+	/* the other counter file descriptors of the threads */
+	int* members;
+	/* some threads are not counted because of the open file limit */
+	int partial;
+} proc_perf_t;
+
+/**
+ * Attaches software event counters to all threads of a process.
+ *
+ * If the file descriptor budget runs out, only the threads attached so
+ * far are counted and partial is set.
+ * @param[out] self   the process counters.
+ * @param[in] pid     the process identifier.
+ * @return            0 for success, -1 if the counters could not be
+ *                    attached (errno is set).
+ */
+int proc_perf_open(proc_perf_t* self, int pid);
+
+/**
+ * Reads the process software event counters.
+ *
+ * @param[in] self     the process counters.
+ * @param[out] values  the counter values summed over the threads.
+ * @return             0 for success.
+ */
+int proc_perf_read(proc_perf_t* self, long long values[PROC_PERF_COUNT]);
+
+/**
+ * Detaches the process software event counters.
+ *
+ * @param[in] self   the process counters.
+ */
+void proc_perf_close(proc_perf_t* self);
+
+#endif
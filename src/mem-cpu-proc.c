@@ -0,0 +1,546 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <ctype.h>
+
+#include "mem-cpu-proc.h"
+#include "proc-root.h"
+
+/**
+ * Private API
+ */
+
+/**
+ * Parses value of the specified key from "Key:   value" formatted line.
+ *
+ * @param[in] line   the line to parse.
+ * @param[in] key    the key including ':' character.
+ * @param[out] value the parsed value.
+ * @return           true if the line contained the key.
+ */
+static bool
+parse_key_value(const char* line, const char* key, int* value)
+{
+	size_t len = strlen(key);
+	if (strncmp(line, key, len)) return false;
+	*value = atoi(line + len);
+	return true;
+}
+
+/**
+ * Checks if the smaps line is a mapping header line.
+ *
+ * Header lines start with the hexadecimal "start-end" address range,
+ * unlike the "Key:   value" lines following them.
+ * @param[in] line   the line to check.
+ * @return           true if the line is a mapping header.
+ */
+static bool
+is_smaps_header(const char* line)
+{
+	size_t len = strcspn(line, " \n");
+	const char* dash = memchr(line, '-', len);
+	return isxdigit((unsigned char)line[0]) && dash && dash > line && !memchr(line, ':', len);
+}
+
+/**
+ * Reads memory totals from /proc/<pid>/smaps_rollup.
+ *
+ * Falls back to summing up /proc/<pid>/smaps on older kernels, which
+ * gives also the mapping count as a side product.
+ * @param[in] pid     the process identifier.
+ * @param[out] stat   the process statistics.
+ * @return            0 for success.
+ */
+static int
+read_smaps(int pid, proc_stat_t* stat)
+{
+	static bool has_rollup = true;
+	char buffer[256];
+	FILE* fp = NULL;
+	bool line_start = true;
+	int value;
+
+	if (has_rollup) {
+		proc_root_path(buffer, sizeof(buffer), "/proc/%d/smaps_rollup", pid);
+		fp = fopen(buffer, "r");
+	}
+	if (!fp) {
+		proc_root_path(buffer, sizeof(buffer), "/proc/%d/smaps", pid);
+		if ( (fp = fopen(buffer, "r")) == NULL) return -1;
+		/* smaps exists, so the kernel just lacks smaps_rollup */
+		has_rollup = false;
+		stat->maps = 0;
+	}
+	stat->pss = 0;
+	stat->private_clean = 0;
+	stat->private_dirty = 0;
+	stat->swap = 0;
+	while (fgets(buffer, sizeof(buffer), fp)) {
+		/* skip the rest of a header line with a long path name */
+		bool continued = !line_start;
+		line_start = strchr(buffer, '\n') != NULL;
+		if (continued) continue;
+		if (parse_key_value(buffer, "Pss:", &value)) {
+			stat->pss += value;
+			continue;
+		}
+		if (parse_key_value(buffer, "Private_Clean:", &value)) {
+			stat->private_clean += value;
+			continue;
+		}
+		if (parse_key_value(buffer, "Private_Dirty:", &value)) {
+			stat->private_dirty += value;
+			continue;
+		}
+		if (parse_key_value(buffer, "Swap:", &value)) {
+			stat->swap += value;
+			continue;
+		}
+		/* mapping header lines start with the address range */
+		if (!has_rollup && is_smaps_header(buffer)) {
+			stat->maps++;
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+/**
+ * Counts memory mappings in /proc/<pid>/maps.
+ *
+ * @param[in] pid     the process identifier.
+ * @param[out] stat   the process statistics.
+ * @return            0 for success.
+ */
+static int
+read_maps(int pid, proc_stat_t* stat)
+{
+	char buffer[4096];
+	ssize_t len;
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/maps", pid);
+	int fd = open(buffer, O_RDONLY);
+	if (fd == -1) return -1;
+	stat->maps = 0;
+	while ( (len = read(fd, buffer, sizeof(buffer))) > 0) {
+		const char* ptr = buffer;
+		while ( (ptr = memchr(ptr, '\n', buffer + len - ptr)) ) {
+			stat->maps++;
+			ptr++;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+/**
+ * Reads /proc/<pid>/status values.
+ *
+ * @param[in] pid     the process identifier.
+ * @param[out] stat   the process statistics.
+ * @return            0 for success.
+ */
+static int
+read_status(int pid, proc_stat_t* stat)
+{
+	char buffer[256];
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/status", pid);
+	FILE* fp = fopen(buffer, "r");
+	if (!fp) return -1;
+	/* kernel threads have no memory values */
+	stat->rss = 0;
+	stat->rss_anon = 0;
+	stat->rss_file = 0;
+	stat->rss_shmem = 0;
+	stat->vm_size = 0;
+	stat->vm_hwm = 0;
+	while (fgets(buffer, sizeof(buffer), fp)) {
+		/* only the lines starting with "Vm", "Rss" or "Th" are parsed */
+		if (*buffer != 'V' && *buffer != 'R' && *buffer != 'T') continue;
+		if (parse_key_value(buffer, "VmSize:", &stat->vm_size)) continue;
+		if (parse_key_value(buffer, "VmHWM:", &stat->vm_hwm)) continue;
+		if (parse_key_value(buffer, "VmRSS:", &stat->rss)) continue;
+		if (parse_key_value(buffer, "RssAnon:", &stat->rss_anon)) continue;
+		if (parse_key_value(buffer, "RssFile:", &stat->rss_file)) continue;
+		if (parse_key_value(buffer, "RssShmem:", &stat->rss_shmem)) continue;
+		if (parse_key_value(buffer, "Threads:", &stat->threads)) break;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/**
+ * Parses /proc/<pid>/io contents.
+ *
+ * @param[in] text    the file contents.
+ * @param[out] stat   the process statistics.
+ * @return            0 for success.
+ */
+static int
+parse_io(const char* text, proc_stat_t* stat)
+{
+	static const struct {
+		const char* key;
+		size_t offset;
+	} keys[] = {
+		{"syscr:", offsetof(proc_stat_t, syscr)},
+		{"syscw:", offsetof(proc_stat_t, syscw)},
+		{"read_bytes:", offsetof(proc_stat_t, read_bytes)},
+		{"write_bytes:", offsetof(proc_stat_t, write_bytes)},
+		{"cancelled_write_bytes:", offsetof(proc_stat_t, cancelled_write_bytes)},
+	};
+	int found = 0;
+	size_t i;
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		const char* ptr = strstr(text, keys[i].key);
+		if (!ptr) continue;
+		*(long long*)((char*)stat + keys[i].offset) = strtoll(ptr + strlen(keys[i].key), NULL, 10);
+		found++;
+	}
+	return found ? 0 : -1;
+}
+
+/**
+ * Reads /proc/<pid>/io values.
+ *
+ * @param[in] pid     the process identifier.
+ * @param[out] stat   the process statistics.
+ * @return            0 for success.
+ */
+static int
+read_io(int pid, proc_stat_t* stat)
+{
+	int fd = proc_stat_open_io(pid);
+	if (fd == -1) return -1;
+	int rc = proc_stat_read_io(fd, stat);
+	close(fd);
+	return rc;
+}
+
+/**
+ * Counts open file descriptors in /proc/<pid>/fd/.
+ *
+ * @param[in] pid     the process identifier.
+ * @param[out] stat   the process statistics.
+ * @return            0 for success.
+ */
+static int
+read_fds(int pid, proc_stat_t* stat)
+{
+	char buffer[256];
+	struct dirent* item;
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/fd", pid);
+	DIR* dir = opendir(buffer);
+	if (!dir) return -1;
+	stat->fds = 0;
+	while ( (item = readdir(dir)) ) {
+		if (*item->d_name != '.') stat->fds++;
+	}
+	closedir(dir);
+	return 0;
+}
+
+/**
+ * Reads /proc/<pid>/stat values.
+ *
+ * @param[in] pid     the process identifier.
+ * @param[out] stat   the process statistics.
+ * @return            0 for success.
+ */
+static int
+read_stat(int pid, proc_stat_t* stat)
+{
+	char buffer[1024];
+	ssize_t len;
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/stat", pid);
+	int fd = open(buffer, O_RDONLY);
+	if (fd == -1) return -1;
+	len = read(fd, buffer, sizeof(buffer) - 1);
+	close(fd);
+	if (len <= 0) return -1;
+	buffer[len] = '\0';
+
+	/* the process name is in parentheses and can contain spaces */
+	char* name = strchr(buffer, '(');
+	char* ptr = strrchr(buffer, ')');
+	if (!name || !ptr) return -1;
+	len = ptr - name - 1;
+	if (len >= PROC_STAT_NAME_SIZE) len = PROC_STAT_NAME_SIZE - 1;
+	memcpy(stat->name, name + 1, len);
+	stat->name[len] = '\0';
+
+	if (sscanf(ptr + 2, "%*c %d %*d %*d %*d %*d %*u %lld %*u %lld %*u %lu %lu %lu %lu %*d %*d %*d %*d %llu",
+			&stat->ppid, &stat->minflt, &stat->majflt, &stat->utime, &stat->stime, &stat->cutime,
+			&stat->cstime, &stat->start_time) != 8) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Thread scheduler statistics at the previous update.
+ */
+typedef struct proc_schedstat_thread_t {
+	int tid;
+	long long run_time;
+	long long wait_time;
+} proc_schedstat_thread_t;
+
+static int
+compare_thread(const void* p1, const void* p2)
+{
+	return ((const proc_schedstat_thread_t*)p1)->tid - ((const proc_schedstat_thread_t*)p2)->tid;
+}
+
+/**
+ * Reads the on-CPU and run queue wait times from a schedstat file.
+ *
+ * @param[in] path     the file path.
+ * @param[out] thread  the thread statistics.
+ * @return             0 for success.
+ */
+static int
+read_schedstat(const char* path, proc_schedstat_thread_t* thread)
+{
+	char buffer[128];
+	ssize_t len;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) return -1;
+	len = read(fd, buffer, sizeof(buffer) - 1);
+	close(fd);
+	if (len <= 0) return -1;
+	buffer[len] = '\0';
+	return sscanf(buffer, "%lld %lld", &thread->run_time, &thread->wait_time) == 2 ? 0 : -1;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+void
+proc_stat_reset(proc_stat_t* stat)
+{
+	stat->pss = PROC_STAT_UNDEFINED;
+	stat->private_clean = PROC_STAT_UNDEFINED;
+	stat->private_dirty = PROC_STAT_UNDEFINED;
+	stat->swap = PROC_STAT_UNDEFINED;
+	stat->maps = PROC_STAT_UNDEFINED;
+	stat->threads = PROC_STAT_UNDEFINED;
+	stat->fds = PROC_STAT_UNDEFINED;
+	stat->rss = PROC_STAT_UNDEFINED;
+	stat->rss_anon = PROC_STAT_UNDEFINED;
+	stat->rss_file = PROC_STAT_UNDEFINED;
+	stat->rss_shmem = PROC_STAT_UNDEFINED;
+	stat->vm_size = PROC_STAT_UNDEFINED;
+	stat->vm_hwm = PROC_STAT_UNDEFINED;
+	stat->minflt = PROC_STAT_UNDEFINED;
+	stat->majflt = PROC_STAT_UNDEFINED;
+	stat->read_bytes = PROC_STAT_UNDEFINED;
+	stat->write_bytes = PROC_STAT_UNDEFINED;
+	stat->syscr = PROC_STAT_UNDEFINED;
+	stat->syscw = PROC_STAT_UNDEFINED;
+	stat->cancelled_write_bytes = PROC_STAT_UNDEFINED;
+	stat->run_time = PROC_STAT_UNDEFINED;
+	stat->wait_time = PROC_STAT_UNDEFINED;
+	stat->blkio_delay = PROC_STAT_UNDEFINED;
+	stat->swapin_delay = PROC_STAT_UNDEFINED;
+	stat->freepages_delay = PROC_STAT_UNDEFINED;
+	stat->thrashing_delay = PROC_STAT_UNDEFINED;
+}
+
+
+int
+proc_stat_open_io(int pid)
+{
+	char buffer[256];
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/io", pid);
+	return open(buffer, O_RDONLY | O_CLOEXEC);
+}
+
+
+int
+proc_stat_read_io(int fd, proc_stat_t* stat)
+{
+	char buffer[512];
+	/* the values are regenerated on every read from the start */
+	ssize_t len = pread(fd, buffer, sizeof(buffer) - 1, 0);
+	if (len <= 0) return -1;
+	buffer[len] = '\0';
+	return parse_io(buffer, stat);
+}
+
+
+int
+proc_stat_read_numa(int pid, int* nodes, int count)
+{
+	char buffer[256];
+	char* line = NULL;
+	size_t size = 0;
+	int i;
+
+	if (count <= 0) return -1;
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/numa_maps", pid);
+	FILE* fp = fopen(buffer, "r");
+	if (!fp) return -1;
+	long long resident[count];
+	for (i = 0; i < count; i++) resident[i] = 0;
+	/* the mapping lines have N<node>=<pages> fields for the resident
+	 * pages and kernelpagesize_kB=<size> at the end */
+	while (getline(&line, &size, fp) > 0) {
+		long long mapping[count];
+		int page_size = 4;
+		char* saveptr = NULL;
+		char* field;
+		for (i = 0; i < count; i++) mapping[i] = 0;
+		for (field = strtok_r(line, " \n", &saveptr); field; field = strtok_r(NULL, " \n", &saveptr)) {
+			int node;
+			long long value;
+			if (sscanf(field, "N%d=%lld", &node, &value) == 2) {
+				if (node >= 0 && node < count) mapping[node] += value;
+			}
+			else if (!strncmp(field, "kernelpagesize_kB=", 18)) {
+				page_size = atoi(field + 18);
+			}
+		}
+		for (i = 0; i < count; i++) resident[i] += mapping[i] * page_size;
+	}
+	free(line);
+	fclose(fp);
+	for (i = 0; i < count; i++) nodes[i] = resident[i];
+	return 0;
+}
+
+
+int
+proc_stat_read(int pid, int flags, proc_stat_t* stat)
+{
+	int rc = 0;
+	char buffer[256];
+
+	proc_stat_reset(stat);
+
+	if ((flags & PROC_STAT_STAT) && read_stat(pid, stat) != 0) rc |= PROC_STAT_STAT;
+	if ((flags & PROC_STAT_SMAPS) && read_smaps(pid, stat) != 0) rc |= PROC_STAT_SMAPS;
+	/* fallback smaps parsing provides also the mapping count */
+	if ((flags & PROC_STAT_MAPS) && stat->maps == PROC_STAT_UNDEFINED && read_maps(pid, stat) != 0) {
+		rc |= PROC_STAT_MAPS;
+	}
+	if ((flags & PROC_STAT_STATUS) && read_status(pid, stat) != 0) rc |= PROC_STAT_STATUS;
+	if ((flags & PROC_STAT_FDS) && read_fds(pid, stat) != 0) rc |= PROC_STAT_FDS;
+	if ((flags & PROC_STAT_IO) && read_io(pid, stat) != 0) rc |= PROC_STAT_IO;
+
+	/* check if the process is gone only when nothing could be read */
+	if (rc && rc == flags) {
+		proc_root_path(buffer, sizeof(buffer), "/proc/%d", pid);
+		if (access(buffer, F_OK) != 0) return -1;
+	}
+	return rc;
+}
+
+
+void
+proc_schedstat_init(proc_schedstat_t* self)
+{
+	memset(self, 0, sizeof(proc_schedstat_t));
+}
+
+
+int
+proc_schedstat_update(proc_schedstat_t* self, int pid)
+{
+	char path[256];
+	struct dirent* item;
+	proc_schedstat_thread_t* threads = NULL;
+	int count = 0, size = 0, i;
+
+	proc_root_path(path, sizeof(path), "/proc/%d/task", pid);
+	DIR* dir = opendir(path);
+	if (dir) {
+		while ( (item = readdir(dir)) ) {
+			int tid = atoi(item->d_name);
+			if (tid <= 0) continue;
+			if (count == size) {
+				size = size ? size * 2 : 16;
+				proc_schedstat_thread_t* tmp = realloc(threads, size * sizeof(proc_schedstat_thread_t));
+				if (!tmp) break;
+				threads = tmp;
+			}
+			proc_root_path(path, sizeof(path), "/proc/%d/task/%d/schedstat", pid, tid);
+			threads[count].tid = tid;
+			/* the thread could have just exited */
+			if (read_schedstat(path, &threads[count]) == 0) count++;
+		}
+		closedir(dir);
+	}
+	else if ( (threads = malloc(sizeof(proc_schedstat_thread_t))) != NULL) {
+		proc_root_path(path, sizeof(path), "/proc/%d/schedstat", pid);
+		threads->tid = pid;
+		if (read_schedstat(path, threads) == 0) count++;
+	}
+	if (!count) {
+		free(threads);
+		return -1;
+	}
+	qsort(threads, count, sizeof(proc_schedstat_thread_t), compare_thread);
+
+	for (i = 0; i < count; i++) {
+		proc_schedstat_thread_t* thread = &threads[i];
+		const proc_schedstat_thread_t* prev = self->threads ?
+				bsearch(thread, self->threads, self->thread_count, sizeof(proc_schedstat_thread_t), compare_thread) : NULL;
+		if (prev) {
+			if (thread->run_time > prev->run_time) self->run_time += thread->run_time - prev->run_time;
+			if (thread->wait_time > prev->wait_time) self->wait_time += thread->wait_time - prev->wait_time;
+		}
+		else if (self->started) {
+			/* the thread was created after the previous update */
+			self->run_time += thread->run_time;
+			self->wait_time += thread->wait_time;
+		}
+	}
+	if (!self->started) {
+		/* start from the times of the existing threads */
+		for (i = 0; i < count; i++) {
+			self->run_time += threads[i].run_time;
+			self->wait_time += threads[i].wait_time;
+		}
+		self->started = 1;
+	}
+	free(self->threads);
+	self->threads = threads;
+	self->thread_count = count;
+	return 0;
+}
+
+
+void
+proc_schedstat_release(proc_schedstat_t* self)
+{
+	free(self->threads);
+	memset(self, 0, sizeof(proc_schedstat_t));
+}
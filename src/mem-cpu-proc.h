@@ -0,0 +1,216 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-proc.h
+ * Additional per-process statistics for mem-cpu-monitor.
+ *
+ * libsp-measure provides the private clean/dirty memory and CPU usage
+ * of the monitored processes. This API reads the other /proc/<pid>/
+ * values used by the optional mem-cpu-monitor features. Only the files
+ * selected by the flags argument are read.
+ */
+#ifndef MEM_CPU_PROC_H
+#define MEM_CPU_PROC_H
+
+/* value of the fields which could not be read */
+#define PROC_STAT_UNDEFINED   (-1)
+
+/**
+ * The /proc/<pid>/ data sources.
+ */
+enum {
+	/* memory totals from smaps_rollup (or smaps) */
+	PROC_STAT_SMAPS = 1 << 0,
+	/* number of memory mappings from maps */
+	PROC_STAT_MAPS = 1 << 1,
+	/* thread count and memory sizes from status */
+	PROC_STAT_STATUS = 1 << 2,
+	/* number of open file descriptors from fd/ directory */
+	PROC_STAT_FDS = 1 << 3,
+	/* parent, start time, page faults and CPU times from stat */
+	PROC_STAT_STAT = 1 << 4,
+	/* I/O accounting from io */
+	PROC_STAT_IO = 1 << 5,
+};
+
+/* process name buffer size, as in /proc/<pid>/stat */
+#define PROC_STAT_NAME_SIZE   16
+
+/**
+ * Per-process statistics.
+ */
+typedef struct proc_stat_t {
+	/* proportional set size (kB) */
+	int pss;
+	/* private clean, private dirty and swapped memory (kB) */
+	int private_clean;
+	int private_dirty;
+	int swap;
+	/* number of memory mappings */
+	int maps;
+	/* number of threads */
+	int threads;
+	/* number of open file descriptors */
+	int fds;
+	/* resident, anonymous, file backed and shared memory, virtual
+	 * memory size and resident set high water mark from status (kB) */
+	int rss;
+	int rss_anon;
+	int rss_file;
+	int rss_shmem;
+	int vm_size;
+	int vm_hwm;
+
+	/* minor and major page faults */
+	long long minflt;
+	long long majflt;
+
+	/* I/O accounting: storage bytes read and written, read and write
+	 * system calls and cancelled write bytes */
+	long long read_bytes;
+	long long write_bytes;
+	long long syscr;
+	long long syscw;
+	long long cancelled_write_bytes;
+
+	/* on-CPU and run queue wait times (ns), set from proc_schedstat_t */
+	long long run_time;
+	long long wait_time;
+
+	/* block I/O, swap-in, direct reclaim and thrashing delays (ns),
+	 * set from taskstats */
+	long long blkio_delay;
+	long long swapin_delay;
+	long long freepages_delay;
+	long long thrashing_delay;
+
+	/* process name and parent process identifier */
+	char name[PROC_STAT_NAME_SIZE];
+	int ppid;
+	/* process start time since boot (clock ticks) */
+	unsigned long long start_time;
+	/* user and system CPU time of the process and of its
+	 * terminated and waited-for children (clock ticks) */
+	unsigned long utime;
+	unsigned long stime;
+	unsigned long cutime;
+	unsigned long cstime;
+} proc_stat_t;
+
+/**
+ * Sets all process statistics fields to PROC_STAT_UNDEFINED.
+ *
+ * @param[out] stat   the process statistics.
+ */
+void proc_stat_reset(proc_stat_t* stat);
+
+/**
+ * Reads process statistics.
+ *
+ * The fields which were not requested or could not be read are set
+ * to PROC_STAT_UNDEFINED.
+ * @param[in] pid     the process identifier.
+ * @param[in] flags   the data sources to read (PROC_STAT_* flags).
+ * @param[out] stat   the process statistics.
+ * @return            0 for success, -1 if the process does not exist,
+ *                    otherwise the flags of the data sources which
+ *                    could not be read.
+ */
+int proc_stat_read(int pid, int flags, proc_stat_t* stat);
+
+/**
+ * Opens /proc/<pid>/io for repeated reading.
+ *
+ * The file is readable only by the process owner (or with ptrace access).
+ * Keeping it open saves the path lookup and permission check on every
+ * update. The descriptor refers to the opened process, so it can't be
+ * mixed up with a new process reusing the same identifier.
+ * @param[in] pid     the process identifier.
+ * @return            the file descriptor or -1 in the case of failure.
+ */
+int proc_stat_open_io(int pid);
+
+/**
+ * Reads I/O accounting values from an opened /proc/<pid>/io file.
+ *
+ * @param[in] fd      the file descriptor from proc_stat_open_io().
+ * @param[out] stat   the process statistics (only the I/O fields are set).
+ * @return            0 for success, -1 if the process has terminated or
+ *                    the values could not be read.
+ */
+int proc_stat_read_io(int fd, proc_stat_t* stat);
+
+/**
+ * Reads resident memory per NUMA node from /proc/<pid>/numa_maps.
+ *
+ * The kernel walks the page tables of every mapping to generate the
+ * file, so it is much more expensive than the other /proc/<pid>/ files
+ * and should be read less often.
+ * @param[in] pid     the process identifier.
+ * @param[out] nodes  the resident memory on each node (kB).
+ * @param[in] count   the number of nodes.
+ * @return            0 for success, -1 if the file could not be read
+ *                    or there are no nodes.
+ */
+int proc_stat_read_numa(int pid, int* nodes, int count);
+
+/**
+ * Per-thread scheduler statistics of a process.
+ *
+ * /proc/<pid>/schedstat has the nanosecond on-CPU and run queue wait
+ * times of the main thread only, so the values are summed up from the
+ * /proc/<pid>/task/<tid>/schedstat files. The times are accumulated
+ * from the per-thread changes, so they don't drop when threads exit.
+ * The times of a thread between the last update and its exit are lost.
+ */
+typedef struct proc_schedstat_t {
+	/* the threads at the previous update, sorted by thread identifier */
+	struct proc_schedstat_thread_t* threads;
+	int thread_count;
+	/* the accumulated on-CPU and run queue wait times (ns) */
+	long long run_time;
+	long long wait_time;
+	/* the first update has been done */
+	int started;
+} proc_schedstat_t;
+
+/**
+ * Initializes process scheduler statistics.
+ *
+ * @param[out] self   the scheduler statistics.
+ */
+void proc_schedstat_init(proc_schedstat_t* self);
+
+/**
+ * Updates process scheduler statistics.
+ *
+ * The process main thread schedstat is used if the task directory is
+ * not available, for example in capture archives.
+ * @param[in] self   the scheduler statistics.
+ * @param[in] pid    the process identifier.
+ * @return           0 for success, -1 if the process does not exist or
+ *                   the kernel doesn't have schedstat.
+ */
+int proc_schedstat_update(proc_schedstat_t* self, int pid);
+
+/**
+ * Releases process scheduler statistics resources.
+ *
+ * @param[in] self   the scheduler statistics.
+ */
+void proc_schedstat_release(proc_schedstat_t* self);
+
+#endif
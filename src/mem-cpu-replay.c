@@ -0,0 +1,459 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <time.h>
+
+#include <sp_measure.h>
+
+#include "mem-cpu-replay.h"
+
+/**
+ * Private API
+ */
+
+/* size of the sample structure part preceding process and cgroup arrays */
+#define SAMPLE_HEADER_SIZE     offsetof(mem_cpu_shm_sample_t, procs)
+
+#define MSECS_PER_DAY          (24 * 60 * 60 * 1000)
+
+/**
+ * Text report column fields.
+ */
+enum {
+	COLUMN_IGNORE,
+	COLUMN_TIME,
+	COLUMN_WATERMARK,
+	COLUMN_MEM_USED,
+	COLUMN_MEM_CHANGE,
+	COLUMN_CPU_USAGE,
+	COLUMN_CPU_FREQ,
+	COLUMN_CGROUP_USED,
+	COLUMN_CGROUP_CHANGE,
+	COLUMN_PROC_CLEAN,
+	COLUMN_PROC_DIRTY,
+	COLUMN_PROC_CHANGE,
+	COLUMN_PROC_CPU,
+};
+
+/**
+ * Text report column groups.
+ */
+enum {
+	GROUP_COMMON,
+	GROUP_MEM,
+	GROUP_CPU,
+	GROUP_CGROUP,
+	GROUP_PROC,
+};
+
+/**
+ * Copies the used part of a sample.
+ *
+ * @param[out] dst   the destination sample.
+ * @param[in] src    the source sample.
+ */
+static void
+sample_copy(mem_cpu_shm_sample_t* dst, const mem_cpu_shm_sample_t* src)
+{
+	memcpy(dst, src, SAMPLE_HEADER_SIZE);
+	memcpy(dst->procs, src->procs, src->proc_count * sizeof(mem_cpu_shm_proc_t));
+	memcpy(dst->cgroups, src->cgroups, src->cgroup_count * sizeof(mem_cpu_shm_cgroup_t));
+}
+
+/**
+ * Removes terminal escape sequences (colors) from a text line.
+ *
+ * @param[in,out] line  the line to process.
+ */
+static void
+strip_escapes(char* line)
+{
+	char* out = line;
+	while (*line) {
+		if (*line == '\033' && line[1] == '[') {
+			line += 2;
+			while (*line && !isalpha(*line)) line++;
+			if (*line) line++;
+			continue;
+		}
+		*out++ = *line++;
+	}
+	*out = '\0';
+}
+
+/**
+ * Removes leading and trailing whitespace.
+ *
+ * @param[in] text   the text to trim.
+ * @return           the trimmed text.
+ */
+static char*
+trim(char* text)
+{
+	while (isspace(*text)) text++;
+	char* end = text + strlen(text);
+	while (end > text && isspace(end[-1])) end--;
+	*end = '\0';
+	return text;
+}
+
+/**
+ * Checks if the line is the column group separator line.
+ */
+static bool
+is_separator_line(const char* line)
+{
+	if (*line != '_') return false;
+	for (; *line; line++) {
+		if (*line != '_' && !isspace(*line)) return false;
+	}
+	return true;
+}
+
+/**
+ * Finds the field of a column.
+ *
+ * @param[in] group  the column group.
+ * @param[in] name   the column name.
+ * @return           the column field.
+ */
+static int
+column_field(int group, const char* name)
+{
+	if (!strcmp(name, "time:")) return COLUMN_TIME;
+	if (!strcmp(name, "BL")) return COLUMN_WATERMARK;
+	switch (group) {
+		case GROUP_MEM:
+			if (!strcmp(name, "used:")) return COLUMN_MEM_USED;
+			if (!strcmp(name, "change:")) return COLUMN_MEM_CHANGE;
+			break;
+		case GROUP_CPU:
+			if (!strcmp(name, "%:")) return COLUMN_CPU_USAGE;
+			if (!strcmp(name, "MHz:")) return COLUMN_CPU_FREQ;
+			break;
+		case GROUP_CGROUP:
+			if (!strcmp(name, "used:")) return COLUMN_CGROUP_USED;
+			if (!strcmp(name, "change:")) return COLUMN_CGROUP_CHANGE;
+			break;
+		case GROUP_PROC:
+			if (!strcmp(name, "clean:")) return COLUMN_PROC_CLEAN;
+			if (!strcmp(name, "dirty:")) return COLUMN_PROC_DIRTY;
+			if (!strcmp(name, "change:")) return COLUMN_PROC_CHANGE;
+			if (!strcmp(name, "CPU-%:")) return COLUMN_PROC_CPU;
+			break;
+	}
+	return COLUMN_IGNORE;
+}
+
+/**
+ * Parses text report header.
+ *
+ * @param[in] self     the reader.
+ * @param[in] titles   the column group title line.
+ * @param[in] names    the column name line.
+ */
+static void
+parse_header(replay_t* self, char* titles, char* names)
+{
+	mem_cpu_shm_sample_t* layout = &self->layout;
+	char* title;
+	char* group_names;
+
+	layout->proc_count = 0;
+	layout->cgroup_count = 0;
+	self->column_count = 0;
+	self->flags = 0;
+
+	/* the column groups are separated with '|' in both lines */
+	while ( (title = strsep(&titles, "|")) && (group_names = strsep(&names, "|")) ) {
+		int group = GROUP_COMMON, index = 0;
+		title = trim(title);
+		if (!strcmp(title, "system memory")) {
+			group = GROUP_MEM;
+		}
+		else if (!strcmp(title, "system CPU")) {
+			group = GROUP_CPU;
+		}
+		else if (*title == '[' && layout->cgroup_count < MEM_CPU_SHM_MAX_CGROUPS) {
+			group = GROUP_CGROUP;
+			index = layout->cgroup_count++;
+			mem_cpu_shm_cgroup_t* cgroup = &layout->cgroups[index];
+			snprintf(cgroup->name, sizeof(cgroup->name), "%.*s", (int)strcspn(title + 1, "]"), title + 1);
+			cgroup->mem_used = cgroup->mem_change = MEM_CPU_SHM_UNDEFINED;
+		}
+		else if (!strncmp(title, "PID ", 4) && layout->proc_count < MEM_CPU_SHM_MAX_PROCS) {
+			group = GROUP_PROC;
+			index = layout->proc_count++;
+			mem_cpu_shm_proc_t* proc = &layout->procs[index];
+			char* name = title + 4;
+			proc->pid = strtol(name, &name, 10);
+			snprintf(proc->name, sizeof(proc->name), "%s", trim(name));
+			proc->mem_clean = proc->mem_dirty = proc->mem_change = proc->cpu_usage = MEM_CPU_SHM_UNDEFINED;
+		}
+
+		char* name;
+		char* state;
+		for (name = strtok_r(group_names, " \t", &state); name; name = strtok_r(NULL, " \t", &state)) {
+			if (self->column_count == REPLAY_MAX_COLUMNS) return;
+			replay_column_t* column = &self->columns[self->column_count++];
+			column->field = column_field(group, name);
+			column->index = index;
+			if (column->field == COLUMN_WATERMARK) self->flags |= MEM_CPU_RECORD_WATERMARK;
+		}
+	}
+}
+
+/**
+ * Parses an optional value.
+ *
+ * @param[in] text    the value text.
+ * @param[in] scale   the value multiplier.
+ * @return            the parsed value or MEM_CPU_SHM_UNDEFINED.
+ */
+static int
+parse_value(const char* text, double scale)
+{
+	char* end;
+	double value = strtod(text, &end);
+	if (end == text) return MEM_CPU_SHM_UNDEFINED;
+	return value * scale + (value < 0 ? -0.5 : 0.5);
+}
+
+/**
+ * Parses a text report data line.
+ *
+ * @param[in] self     the reader.
+ * @param[in] line     the data line.
+ * @param[out] sample  the parsed sample.
+ * @return             0 for success.
+ */
+static int
+parse_data(replay_t* self, char* line, mem_cpu_shm_sample_t* sample)
+{
+	char* state;
+	char* token = strtok_r(line, " \t", &state);
+	int i;
+
+	sample_copy(sample, &self->layout);
+	sample->mem_total = self->mem_total;
+	sample->mem_swap = self->mem_swap;
+	sample->mem_used = sample->mem_change = MEM_CPU_SHM_UNDEFINED;
+	sample->cpu_usage = sample->cpu_freq = MEM_CPU_SHM_UNDEFINED;
+	sample->mem_watermark = 0;
+
+	for (i = 0; i < self->column_count; i++, token = strtok_r(NULL, " \t", &state)) {
+		const replay_column_t* column = &self->columns[i];
+		if (!token) return -1;
+		switch (column->field) {
+			case COLUMN_TIME: {
+				int hours, minutes, seconds, msecs = 0;
+				if (sscanf(token, "%d:%d:%d.%d", &hours, &minutes, &seconds, &msecs) < 3) return -1;
+				int time = ((hours * 60 + minutes) * 60 + seconds) * 1000 + msecs;
+				/* the report contains only the time of day */
+				if (time < self->last_time - MSECS_PER_DAY / 2) self->day++;
+				self->last_time = time;
+				sample->time = (uint64_t)self->day * MSECS_PER_DAY + time;
+				break;
+			}
+			case COLUMN_WATERMARK:
+				if (token[0] == 'B') sample->mem_watermark |= MEM_WATERMARK_LOW;
+				if (token[0] && token[1] == 'L') sample->mem_watermark |= MEM_WATERMARK_HIGH;
+				break;
+			case COLUMN_MEM_USED:
+				sample->mem_used = parse_value(token, 1);
+				break;
+			case COLUMN_MEM_CHANGE:
+				sample->mem_change = parse_value(token, 1);
+				break;
+			case COLUMN_CPU_USAGE:
+				sample->cpu_usage = parse_value(token, 100);
+				break;
+			case COLUMN_CPU_FREQ:
+				sample->cpu_freq = parse_value(token, 1000);
+				break;
+			case COLUMN_CGROUP_USED:
+				sample->cgroups[column->index].mem_used = parse_value(token, 1);
+				break;
+			case COLUMN_CGROUP_CHANGE:
+				sample->cgroups[column->index].mem_change = parse_value(token, 1);
+				break;
+			case COLUMN_PROC_CLEAN:
+				sample->procs[column->index].mem_clean = parse_value(token, 1);
+				break;
+			case COLUMN_PROC_DIRTY:
+				sample->procs[column->index].mem_dirty = parse_value(token, 1);
+				break;
+			case COLUMN_PROC_CHANGE:
+				sample->procs[column->index].mem_change = parse_value(token, 1);
+				break;
+			case COLUMN_PROC_CPU:
+				sample->procs[column->index].cpu_usage = parse_value(token, 100);
+				break;
+		}
+	}
+	sample->tick = ++self->tick;
+	return 0;
+}
+
+/**
+ * Reads the next sample from text report.
+ */
+static int
+read_text(replay_t* self, mem_cpu_shm_sample_t* sample)
+{
+	char line[16384];
+	while (fgets(line, sizeof(line), self->fp)) {
+		strip_escapes(line);
+		line[strcspn(line, "\r\n")] = '\0';
+		if (sscanf(line, "System: CPU: %*u MHz max, total memory: %d kB RAM, %d kB swap",
+				&self->mem_total, &self->mem_swap) == 2) {
+			continue;
+		}
+		if (is_separator_line(line)) {
+			self->header_line = 1;
+			continue;
+		}
+		if (self->header_line == 1) {
+			snprintf(self->titles, sizeof(self->titles), "%s", line);
+			self->header_line = 2;
+			continue;
+		}
+		if (self->header_line == 2) {
+			parse_header(self, self->titles, line);
+			self->header_line = 0;
+			continue;
+		}
+		/* skip the lines not containing samples */
+		if (!isdigit(*line) || !self->column_count) continue;
+		if (parse_data(self, line, sample) == 0) return 0;
+	}
+	return 1;
+}
+
+/**
+ * Reads the next sample from binary recording.
+ */
+static int
+read_binary(replay_t* self, mem_cpu_shm_sample_t* sample)
+{
+	if (fread(sample, SAMPLE_HEADER_SIZE, 1, self->fp) != 1) return 1;
+	if (sample->proc_count < 0 || sample->proc_count > MEM_CPU_SHM_MAX_PROCS ||
+			sample->cgroup_count < 0 || sample->cgroup_count > MEM_CPU_SHM_MAX_CGROUPS) {
+		return -1;
+	}
+	if (fread(sample->procs, sizeof(mem_cpu_shm_proc_t), sample->proc_count, self->fp) != (size_t)sample->proc_count ||
+			fread(sample->cgroups, sizeof(mem_cpu_shm_cgroup_t), sample->cgroup_count, self->fp) != (size_t)sample->cgroup_count) {
+		return -1;
+	}
+	if (!self->midnight) {
+		struct tm tm;
+		time_t time = sample->time / 1000;
+		localtime_r(&time, &tm);
+		tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+		self->midnight = (uint64_t)mktime(&tm) * 1000;
+	}
+	sample->time -= self->midnight;
+	return 0;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+FILE*
+replay_record_create(const char* path, int flags)
+{
+	mem_cpu_record_header_t header = {
+		.magic = MEM_CPU_RECORD_MAGIC,
+		.version = MEM_CPU_SHM_VERSION,
+		.size = sizeof(mem_cpu_shm_sample_t),
+		.flags = flags,
+	};
+	FILE* fp = fopen(path, "w");
+	if (!fp) return NULL;
+	if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+
+int
+replay_record_write(FILE* fp, const mem_cpu_shm_sample_t* sample)
+{
+	if (fwrite(sample, SAMPLE_HEADER_SIZE, 1, fp) != 1 ||
+			fwrite(sample->procs, sizeof(mem_cpu_shm_proc_t), sample->proc_count, fp) != (size_t)sample->proc_count ||
+			fwrite(sample->cgroups, sizeof(mem_cpu_shm_cgroup_t), sample->cgroup_count, fp) != (size_t)sample->cgroup_count) {
+		return -1;
+	}
+	/* keep the recording usable if the monitor gets killed */
+	return fflush(fp) == 0 ? 0 : -1;
+}
+
+
+replay_t*
+replay_open(const char* path)
+{
+	replay_t* self = calloc(1, sizeof(replay_t));
+	if (!self) return NULL;
+	self->fp = fopen(path, "r");
+	if (!self->fp) {
+		free(self);
+		return NULL;
+	}
+	mem_cpu_record_header_t header;
+	if (fread(&header, sizeof(header), 1, self->fp) == 1 && header.magic == MEM_CPU_RECORD_MAGIC) {
+		if (header.version != MEM_CPU_SHM_VERSION || header.size != sizeof(mem_cpu_shm_sample_t)) {
+			fprintf(stderr, "ERROR: unsupported recording version %u.\n", header.version);
+			replay_close(self);
+			return NULL;
+		}
+		self->binary = true;
+		self->flags = header.flags;
+		return self;
+	}
+	/* parse the already read data again as text */
+	rewind(self->fp);
+	return self;
+}
+
+
+int
+replay_read(replay_t* self, mem_cpu_shm_sample_t* sample)
+{
+	return self->binary ? read_binary(self, sample) : read_text(self, sample);
+}
+
+
+void
+replay_close(replay_t* self)
+{
+	if (self) {
+		if (self->fp) fclose(self->fp);
+		free(self);
+	}
+}
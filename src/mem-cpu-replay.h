@@ -0,0 +1,150 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-replay.h
+ * Recording and reading of mem-cpu-monitor runs for offline replay.
+ *
+ * A recorded run can be read either from the mem-cpu-monitor text
+ * report or from the binary recording written with --record option.
+ * The binary recording starts with mem_cpu_record_header_t, followed
+ * by the samples. Only the used process and cgroup entries of every
+ * sample are stored.
+ *
+ * Both formats are read into mem_cpu_shm_sample_t structures, so the
+ * replay can process the samples in the same way regardless of the
+ * source format.
+ */
+#ifndef MEM_CPU_REPLAY_H
+#define MEM_CPU_REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mem-cpu-shm.h"
+
+#define MEM_CPU_RECORD_MAGIC       0x4d435243u  /* "MCRC" */
+
+/**
+ * Recording flags.
+ */
+enum {
+	/* the system memory watermark values are available */
+	MEM_CPU_RECORD_WATERMARK = 1 << 0,
+};
+
+/**
+ * Binary recording file header.
+ */
+typedef struct mem_cpu_record_header_t {
+	uint32_t magic;
+	/* the sample structure version, MEM_CPU_SHM_VERSION */
+	uint32_t version;
+	/* size of the sample structure */
+	uint32_t size;
+	/* MEM_CPU_RECORD_* flags */
+	uint32_t flags;
+} mem_cpu_record_header_t;
+
+/* maximum number of columns in the text report */
+#define REPLAY_MAX_COLUMNS         1024
+
+/**
+ * Text report column.
+ */
+typedef struct replay_column_t {
+	/* the sample field, see replay.c */
+	int field;
+	/* the process or cgroup index */
+	int index;
+} replay_column_t;
+
+/**
+ * Recorded run reader.
+ */
+typedef struct replay_t {
+	FILE* fp;
+	/* the input is a binary recording */
+	bool binary;
+	/* MEM_CPU_RECORD_* flags */
+	int flags;
+	uint64_t tick;
+
+	/* local time of the first sample day midnight (binary recordings) */
+	uint64_t midnight;
+	/* day number and time of the previous sample (text reports) */
+	int day;
+	int last_time;
+
+	/* text report header state */
+	int header_line;
+	int mem_total;
+	int mem_swap;
+	char titles[16384];
+	/* sample with process and cgroup names from the header */
+	mem_cpu_shm_sample_t layout;
+	replay_column_t columns[REPLAY_MAX_COLUMNS];
+	int column_count;
+} replay_t;
+
+/**
+ * Creates binary recording file.
+ *
+ * @param[in] path   the recording file path.
+ * @param[in] flags  the recording flags.
+ * @return           the opened recording file or NULL in the case of failure.
+ */
+FILE* replay_record_create(const char* path, int flags);
+
+/**
+ * Writes a sample into binary recording file.
+ *
+ * @param[in] fp      the recording file.
+ * @param[in] sample  the sample to write.
+ * @return            0 for success.
+ */
+int replay_record_write(FILE* fp, const mem_cpu_shm_sample_t* sample);
+
+/**
+ * Opens recorded run.
+ *
+ * The binary recordings are recognized by the file header, other files
+ * are parsed as mem-cpu-monitor text reports.
+ * @param[in] path   the file path.
+ * @return           the reader or NULL in the case of failure.
+ */
+replay_t* replay_open(const char* path);
+
+/**
+ * Reads the next sample.
+ *
+ * The sample time is converted to milliseconds since the local midnight
+ * of the recording start day.
+ * @param[in] self     the reader.
+ * @param[out] sample  the read sample.
+ * @return             0 for success, 1 at the end of the input, -1 if
+ *                     the input is corrupted.
+ */
+int replay_read(replay_t* self, mem_cpu_shm_sample_t* sample);
+
+/**
+ * Closes recorded run.
+ *
+ * @param[in] self   the reader.
+ */
+void replay_close(replay_t* self);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include "mem-cpu-shm.h"
+
+/**
+ * Opens an existing segment, if it was left by a monitor which is not
+ * running anymore.
+ *
+ * @param[in] name  the segment name.
+ * @return          the segment descriptor or -1 in the case of failure.
+ */
+static int
+open_stale(const char* name)
+{
+	struct stat st;
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd == -1) return -1;
+	if (fstat(fd, &st) == -1) goto failure;
+	/* a monitor killed before resizing the segment */
+	if (st.st_size == 0) return fd;
+	if (st.st_size < (off_t)sizeof(mem_cpu_shm_t)) {
+		errno = EEXIST;
+		goto failure;
+	}
+	mem_cpu_shm_t* shm = mmap(NULL, sizeof(mem_cpu_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) goto failure;
+	int rc = 0;
+	if (shm->magic != MEM_CPU_SHM_MAGIC) {
+		rc = EEXIST;
+	}
+	/* the older layout has no writer pid, the sample is at its place */
+	else if (shm->version == MEM_CPU_SHM_VERSION && shm->pid > 0 &&
+			(kill(shm->pid, 0) == 0 || errno == EPERM)) {
+		rc = EBUSY;
+	}
+	munmap(shm, sizeof(mem_cpu_shm_t));
+	if (rc) {
+		errno = rc;
+		goto failure;
+	}
+	return fd;
+
+failure:
+	close(fd);
+	return -1;
+}
+
+
+mem_cpu_shm_t*
+mem_cpu_shm_create(const char* name)
+{
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	int created = fd != -1;
+	if (!created && (errno != EEXIST || (fd = open_stale(name)) == -1)) return NULL;
+	if (ftruncate(fd, sizeof(mem_cpu_shm_t)) == -1) goto failure;
+	void* addr = mmap(NULL, sizeof(mem_cpu_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) goto failure;
+	close(fd);
+	mem_cpu_shm_t* shm = (mem_cpu_shm_t*)addr;
+	/* a stale segment left by a killed monitor is reused, mark it
+	 * as empty before updating the layout information */
+	__atomic_store_n(&shm->seq, 0, __ATOMIC_RELEASE);
+	shm->magic = MEM_CPU_SHM_MAGIC;
+	shm->version = MEM_CPU_SHM_VERSION;
+	shm->size = sizeof(mem_cpu_shm_sample_t);
+	shm->pid = getpid();
+	return shm;
+
+failure:
+	{
+		int err = errno;
+		close(fd);
+		if (created) shm_unlink(name);
+		errno = err;
+	}
+	return NULL;
+}
+
+
+void
+mem_cpu_shm_publish(mem_cpu_shm_t* shm, const mem_cpu_shm_sample_t* sample)
+{
+	uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+	/* odd sequence number tells readers that the sample is being updated */
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&shm->sample, sample, sizeof(mem_cpu_shm_sample_t));
+	__atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+void
+mem_cpu_shm_destroy(mem_cpu_shm_t* shm, const char* name)
+{
+	if (shm) {
+		munmap(shm, sizeof(mem_cpu_shm_t));
+		shm_unlink(name);
+	}
+}
@@ -0,0 +1,242 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-shm.h
+ * Shared memory snapshot published by mem-cpu-monitor --shm option.
+ *
+ * mem-cpu-monitor writes every completed sample into a POSIX shared
+ * memory segment. The segment is guarded by a sequence lock, so any
+ * number of local processes can map it read-only and copy consistent
+ * snapshots without system calls and without blocking the monitor:
+ *
+ *   mem_cpu_shm_t* shm = mem_cpu_shm_open("/mem-cpu-monitor");
+ *   mem_cpu_shm_sample_t sample;
+ *   if (shm && mem_cpu_shm_read(shm, &sample) == 0) {
+ *       printf("used: %d kB\n", sample.mem_used);
+ *   }
+ *   mem_cpu_shm_close(shm);
+ *
+ * The reader API is implemented inline in this header, readers only
+ * need to link with -lrt (for shm_open) on older C libraries.
+ */
+#ifndef MEM_CPU_SHM_H
+#define MEM_CPU_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MEM_CPU_SHM_MAGIC          0x4d435348u  /* "MCSH" */
+#define MEM_CPU_SHM_VERSION        2
+
+#define MEM_CPU_SHM_MAX_PROCS      64
+#define MEM_CPU_SHM_MAX_CGROUPS    8
+#define MEM_CPU_SHM_NAME_SIZE      32
+
+/* value of the fields which could not be measured */
+#define MEM_CPU_SHM_UNDEFINED      (-1)
+
+/* attempts to read a consistent sample before giving up */
+#define MEM_CPU_SHM_RETRIES        8
+
+/**
+ * Monitored process data.
+ */
+typedef struct mem_cpu_shm_proc_t {
+	int32_t pid;
+	char name[MEM_CPU_SHM_NAME_SIZE];
+	/* private clean memory (kB) */
+	int32_t mem_clean;
+	/* private dirty + swap memory (kB) */
+	int32_t mem_dirty;
+	/* private dirty + swap memory change since the previous sample (kB) */
+	int32_t mem_change;
+	/* CPU usage in 1/100 percents */
+	int32_t cpu_usage;
+} mem_cpu_shm_proc_t;
+
+/**
+ * Monitored cgroup data.
+ */
+typedef struct mem_cpu_shm_cgroup_t {
+	char name[MEM_CPU_SHM_NAME_SIZE];
+	/* used memory (kB) */
+	int32_t mem_used;
+	/* used memory change since the previous sample (kB) */
+	int32_t mem_change;
+} mem_cpu_shm_cgroup_t;
+
+/**
+ * A single mem-cpu-monitor sample.
+ */
+typedef struct mem_cpu_shm_sample_t {
+	/* sample number, starting from 1 */
+	uint64_t tick;
+	/* wall clock time of the sample (milliseconds since epoch) */
+	uint64_t time;
+	/* system memory (kB) */
+	int32_t mem_total;
+	int32_t mem_swap;
+	int32_t mem_used;
+	int32_t mem_change;
+	/* memory watermark flags (Maemo kernels) */
+	int32_t mem_watermark;
+	/* system CPU usage in 1/100 percents */
+	int32_t cpu_usage;
+	/* average CPU frequency (kHz) */
+	int32_t cpu_freq;
+
+	int32_t proc_count;
+	int32_t cgroup_count;
+	mem_cpu_shm_proc_t procs[MEM_CPU_SHM_MAX_PROCS];
+	mem_cpu_shm_cgroup_t cgroups[MEM_CPU_SHM_MAX_CGROUPS];
+} mem_cpu_shm_sample_t;
+
+/**
+ * The shared memory segment layout.
+ */
+typedef struct mem_cpu_shm_t {
+	uint32_t magic;
+	uint32_t version;
+	/* size of the sample structure */
+	uint32_t size;
+	/* sequence lock counter. Odd while the sample is being
+	 * written, zero until the first sample is published */
+	uint32_t seq;
+	/* the writing mem-cpu-monitor process identifier */
+	int32_t pid;
+	uint32_t reserved;
+	mem_cpu_shm_sample_t sample;
+} mem_cpu_shm_t;
+
+
+/**
+ * Maps mem-cpu-monitor shared memory segment for reading.
+ *
+ * @param[in] name  the segment name given to mem-cpu-monitor --shm option.
+ * @return          the mapped segment or NULL in the case of failure.
+ */
+static inline mem_cpu_shm_t*
+mem_cpu_shm_open(const char* name)
+{
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1) return NULL;
+	void* addr = mmap(NULL, sizeof(mem_cpu_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) return NULL;
+
+	mem_cpu_shm_t* shm = (mem_cpu_shm_t*)addr;
+	if (shm->magic != MEM_CPU_SHM_MAGIC || shm->version != MEM_CPU_SHM_VERSION ||
+			shm->size != sizeof(mem_cpu_shm_sample_t)) {
+		munmap(addr, sizeof(mem_cpu_shm_t));
+		errno = EPROTO;
+		return NULL;
+	}
+	return shm;
+}
+
+/**
+ * Copies the latest published sample.
+ *
+ * The read is retried only a few times, so a monitor killed in the
+ * middle of a publish doesn't block the reader. -EAGAIN is returned
+ * instead, and the reader can try again later.
+ * @param[in] shm      the mapped segment.
+ * @param[out] sample  the sample copy.
+ * @return             0 for success, -EAGAIN if nothing is published yet
+ *                     or no consistent sample could be read.
+ */
+static inline int
+mem_cpu_shm_read(const mem_cpu_shm_t* shm, mem_cpu_shm_sample_t* sample)
+{
+	uint32_t seq1, seq2;
+	int i;
+	for (i = 0; i < MEM_CPU_SHM_RETRIES; i++) {
+		if (i) sched_yield();
+		seq1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq1 == 0) return -EAGAIN;
+		if (seq1 & 1) continue;
+		memcpy(sample, &shm->sample, sizeof(mem_cpu_shm_sample_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+		if (seq1 == seq2) return 0;
+	}
+	return -EAGAIN;
+}
+
+/**
+ * Returns the sequence number of the latest published sample.
+ *
+ * Can be used to poll for new samples without copying them.
+ * @param[in] shm  the mapped segment.
+ * @return         the sequence number.
+ */
+static inline uint32_t
+mem_cpu_shm_sequence(const mem_cpu_shm_t* shm)
+{
+	return __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE) & ~1u;
+}
+
+/**
+ * Unmaps the shared memory segment.
+ *
+ * @param[in] shm  the mapped segment.
+ */
+static inline void
+mem_cpu_shm_close(mem_cpu_shm_t* shm)
+{
+	if (shm) munmap(shm, sizeof(mem_cpu_shm_t));
+}
+
+
+/*
+ * Writer API, used by mem-cpu-monitor (see mem-cpu-shm.c).
+ */
+
+/**
+ * Creates and maps the shared memory segment for writing.
+ *
+ * An existing segment is reused only if the monitor which wrote it is
+ * not running anymore.
+ * @param[in] name  the segment name.
+ * @return          the mapped segment or NULL in the case of failure
+ *                  (errno is EBUSY if another monitor uses the segment
+ *                  and EEXIST if it is not a mem-cpu-monitor segment).
+ */
+mem_cpu_shm_t* mem_cpu_shm_create(const char* name);
+
+/**
+ * Publishes a new sample.
+ *
+ * @param[in] shm     the mapped segment.
+ * @param[in] sample  the sample to publish.
+ */
+void mem_cpu_shm_publish(mem_cpu_shm_t* shm, const mem_cpu_shm_sample_t* sample);
+
+/**
+ * Unmaps and removes the shared memory segment.
+ *
+ * @param[in] shm   the mapped segment.
+ * @param[in] name  the segment name.
+ */
+void mem_cpu_shm_destroy(mem_cpu_shm_t* shm, const char* name);
+
+#endif
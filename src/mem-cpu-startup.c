@@ -0,0 +1,190 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "mem-cpu-startup.h"
+#include "proc-root.h"
+
+/**
+ * Private API
+ */
+
+/**
+ * Returns the time elapsed since the process start (ms).
+ */
+static double
+startup_elapsed(const startup_t* self)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - self->start.tv_sec) * 1000.0 + (now.tv_nsec - self->start.tv_nsec) / 1000000.0;
+}
+
+/**
+ * Adds milliseconds to a timestamp.
+ */
+static void
+timespec_add_ms(struct timespec* ts, double ms)
+{
+	long long nsec = ts->tv_nsec + (long long)(ms * 1000000);
+	ts->tv_sec += nsec / 1000000000;
+	ts->tv_nsec = nsec % 1000000000;
+}
+
+/**
+ * Sleeps until the specified CLOCK_MONOTONIC time.
+ *
+ * @param[in] ts   the wakeup time.
+ * @return         false if the sleep was interrupted by a signal.
+ */
+static bool
+sleep_until(const struct timespec* ts)
+{
+	return clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL) == 0;
+}
+
+/**
+ * Converts statm page count to kilobytes.
+ */
+static int
+pages_to_kb(unsigned long pages)
+{
+	static int page_kb = 0;
+	if (!page_kb) page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	return pages * page_kb;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+void
+startup_init(startup_t* self, int pid, int window, int interval)
+{
+	memset(self, 0, sizeof(startup_t));
+	self->pid = pid;
+	self->window = window;
+	self->interval = interval;
+	clock_gettime(CLOCK_MONOTONIC, &self->start);
+}
+
+
+bool
+startup_is_active(const startup_t* self)
+{
+	return self->pid && !self->exited && startup_elapsed(self) < self->window;
+}
+
+
+int
+startup_sample(startup_t* self)
+{
+	char buffer[128];
+	unsigned long size, resident, shared;
+	proc_root_path(buffer, sizeof(buffer), "/proc/%d/statm", self->pid);
+	int fd = open(buffer, O_RDONLY);
+	if (fd == -1) return -1;
+	ssize_t len = read(fd, buffer, sizeof(buffer) - 1);
+	close(fd);
+	if (len <= 0) return -1;
+	buffer[len] = '\0';
+	if (sscanf(buffer, "%lu %lu %lu", &size, &resident, &shared) != 3) return -1;
+
+	double time = startup_elapsed(self);
+	int rss = pages_to_kb(resident);
+	/* statm shared field is the resident file and shared memory */
+	int anon = pages_to_kb(resident - shared);
+	if (rss > self->peak_rss) {
+		self->peak_rss = rss;
+		self->peak_rss_time = time;
+	}
+	if (anon > self->peak_anon) {
+		self->peak_anon = anon;
+		self->peak_anon_time = time;
+	}
+	self->samples++;
+	return 0;
+}
+
+
+void
+startup_sleep(startup_t* self, unsigned int usec)
+{
+	struct timespec now, end, next;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	end = now;
+	timespec_add_ms(&end, usec / 1000.0);
+
+	next = now;
+	while (startup_is_active(self)) {
+		timespec_add_ms(&next, self->interval);
+		if (next.tv_sec > end.tv_sec || (next.tv_sec == end.tv_sec && next.tv_nsec >= end.tv_nsec)) break;
+		/* return to the main loop on signals, like usleep() would */
+		if (!sleep_until(&next)) return;
+		if (startup_sample(self) != 0) break;
+	}
+	sleep_until(&end);
+}
+
+
+void
+startup_set_exited(startup_t* self, int status, const struct rusage* usage)
+{
+	self->status = status;
+	self->rusage = *usage;
+	self->exit_time = startup_elapsed(self);
+	self->exited = 1;
+}
+
+
+void
+startup_report(const startup_t* self, FILE* fp)
+{
+	if (!self->pid) return;
+	fprintf(fp, "Startup profile of PID %d (%d samples in %d ms window at %d ms interval):\n",
+			self->pid, self->samples, self->window, self->interval);
+	fprintf(fp, "  peak RSS:  %d kB at %.1f ms\n", self->peak_rss, self->peak_rss_time);
+	fprintf(fp, "  peak anon: %d kB at %.1f ms\n", self->peak_anon, self->peak_anon_time);
+	if (!self->exited) {
+		fprintf(fp, "  still running\n");
+		return;
+	}
+	if (WIFEXITED(self->status)) {
+		fprintf(fp, "  exited with status %d after %.1f ms\n", WEXITSTATUS(self->status), self->exit_time);
+	}
+	else if (WIFSIGNALED(self->status)) {
+		fprintf(fp, "  killed by signal %d after %.1f ms\n", WTERMSIG(self->status), self->exit_time);
+	}
+	const struct rusage* ru = &self->rusage;
+	fprintf(fp, "  user time: %ld.%03ld s, system time: %ld.%03ld s\n",
+			(long)ru->ru_utime.tv_sec, (long)ru->ru_utime.tv_usec / 1000,
+			(long)ru->ru_stime.tv_sec, (long)ru->ru_stime.tv_usec / 1000);
+	fprintf(fp, "  max RSS: %ld kB, minor faults: %ld, major faults: %ld\n",
+			ru->ru_maxrss, ru->ru_minflt, ru->ru_majflt);
+	fprintf(fp, "  voluntary context switches: %ld, involuntary: %ld\n",
+			ru->ru_nvcsw, ru->ru_nivcsw);
+}
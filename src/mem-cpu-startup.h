@@ -0,0 +1,121 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-startup.h
+ * Startup memory profiling of the processes started by mem-cpu-monitor.
+ *
+ * The memory usage of an application usually changes most during its
+ * startup, which is too short to be seen with the normal monitoring
+ * interval. During the warm-up window the process resident and
+ * anonymous memory is sampled from /proc/<pid>/statm at millisecond
+ * intervals. statm is used because it's cheap enough to be read at
+ * that rate, unlike smaps. The anonymous resident memory is reported
+ * as the dirty memory estimate.
+ *
+ * When the process terminates, its resource usage reported by wait4()
+ * is included in the profile summary.
+ */
+#ifndef MEM_CPU_STARTUP_H
+#define MEM_CPU_STARTUP_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/**
+ * Startup profile.
+ */
+typedef struct startup_t {
+	/* the profiled process identifier, 0 if profiling is not active */
+	int pid;
+	/* the process start time (CLOCK_MONOTONIC) */
+	struct timespec start;
+	/* the warm-up window and sampling interval (ms) */
+	int window;
+	int interval;
+
+	/* number of the taken samples */
+	int samples;
+	/* peak resident and anonymous memory (kB) and the time from the
+	 * process start to the peak (ms) */
+	int peak_rss;
+	double peak_rss_time;
+	int peak_anon;
+	double peak_anon_time;
+
+	/* set by startup_set_exited() from the SIGCHLD handler */
+	volatile int exited;
+	int status;
+	double exit_time;
+	struct rusage rusage;
+} startup_t;
+
+/**
+ * Starts startup profiling of a process.
+ *
+ * @param[in] self      the startup profile.
+ * @param[in] pid       the process identifier.
+ * @param[in] window    the warm-up window length (ms).
+ * @param[in] interval  the sampling interval (ms).
+ */
+void startup_init(startup_t* self, int pid, int window, int interval);
+
+/**
+ * Checks if the warm-up window is still open.
+ *
+ * @param[in] self   the startup profile.
+ * @return           true if the process is being sampled at high rate.
+ */
+bool startup_is_active(const startup_t* self);
+
+/**
+ * Samples the process memory usage.
+ *
+ * @param[in] self   the startup profile.
+ * @return           0 for success.
+ */
+int startup_sample(startup_t* self);
+
+/**
+ * Sleeps the specified time while sampling the process.
+ *
+ * The sampling stops when the warm-up window closes or the process
+ * terminates, and the rest of the time is slept without sampling.
+ * @param[in] self   the startup profile.
+ * @param[in] usec   the time to sleep (microseconds).
+ */
+void startup_sleep(startup_t* self, unsigned int usec);
+
+/**
+ * Stores the termination status and resource usage of the process.
+ *
+ * This function is async-signal-safe.
+ * @param[in] self    the startup profile.
+ * @param[in] status  the process termination status.
+ * @param[in] usage   the process resource usage.
+ */
+void startup_set_exited(startup_t* self, int status, const struct rusage* usage);
+
+/**
+ * Writes the startup profile summary.
+ *
+ * @param[in] self   the startup profile.
+ * @param[in] fp     the output stream.
+ */
+void startup_report(const startup_t* self, FILE* fp);
+
+#endif
@@ -0,0 +1,381 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include "mem-cpu-sysstat.h"
+#include "proc-root.h"
+
+/**
+ * Private API
+ */
+
+/**
+ * Sets all counters to SYS_STAT_UNDEFINED.
+ *
+ * @param[out] stat   the system statistics.
+ */
+static void
+sys_stat_reset(sys_stat_t* stat)
+{
+	stat->pgpgin = SYS_STAT_UNDEFINED;
+	stat->pgpgout = SYS_STAT_UNDEFINED;
+	stat->pgfault = SYS_STAT_UNDEFINED;
+	stat->pgmajfault = SYS_STAT_UNDEFINED;
+	stat->pswpin = SYS_STAT_UNDEFINED;
+	stat->pswpout = SYS_STAT_UNDEFINED;
+	stat->pgscan_kswapd = SYS_STAT_UNDEFINED;
+	stat->pgscan_direct = SYS_STAT_UNDEFINED;
+	stat->pgsteal_kswapd = SYS_STAT_UNDEFINED;
+	stat->pgsteal_direct = SYS_STAT_UNDEFINED;
+	stat->compact_stall = SYS_STAT_UNDEFINED;
+	stat->oom_kill = SYS_STAT_UNDEFINED;
+	stat->workingset_refault = SYS_STAT_UNDEFINED;
+	stat->numa_hit = SYS_STAT_UNDEFINED;
+	stat->numa_miss = SYS_STAT_UNDEFINED;
+	stat->numa_foreign = SYS_STAT_UNDEFINED;
+	stat->disk_reads = SYS_STAT_UNDEFINED;
+	stat->disk_read_sectors = SYS_STAT_UNDEFINED;
+	stat->disk_writes = SYS_STAT_UNDEFINED;
+	stat->disk_write_sectors = SYS_STAT_UNDEFINED;
+	int i;
+	for (i = 0; i < SYS_STAT_MAX_NODES; i++) {
+		stat->node_total[i] = SYS_STAT_UNDEFINED;
+		stat->node_free[i] = SYS_STAT_UNDEFINED;
+	}
+}
+
+/* size of the /proc/vmstat read buffer, the file is about 4-8kB */
+#define VMSTAT_BUFFER_SIZE   16384
+
+/* maximum number of the compiled /proc/vmstat lines */
+#define VMSTAT_PLAN_SIZE     40
+
+/**
+ * The /proc/vmstat counters and the fields they are accumulated to.
+ *
+ * The per-zone scan and steal counters of older kernels and the per
+ * type refault counters of newer kernels are summed up.
+ */
+static const struct {
+	const char* key;
+	size_t offset;
+} vmstat_keys[] = {
+	{"pgpgin", offsetof(sys_stat_t, pgpgin)},
+	{"pgpgout", offsetof(sys_stat_t, pgpgout)},
+	{"pgfault", offsetof(sys_stat_t, pgfault)},
+	{"pgmajfault", offsetof(sys_stat_t, pgmajfault)},
+	{"pswpin", offsetof(sys_stat_t, pswpin)},
+	{"pswpout", offsetof(sys_stat_t, pswpout)},
+	{"pgscan_kswapd", offsetof(sys_stat_t, pgscan_kswapd)},
+	{"pgscan_kswapd_dma", offsetof(sys_stat_t, pgscan_kswapd)},
+	{"pgscan_kswapd_dma32", offsetof(sys_stat_t, pgscan_kswapd)},
+	{"pgscan_kswapd_normal", offsetof(sys_stat_t, pgscan_kswapd)},
+	{"pgscan_kswapd_high", offsetof(sys_stat_t, pgscan_kswapd)},
+	{"pgscan_kswapd_movable", offsetof(sys_stat_t, pgscan_kswapd)},
+	{"pgscan_direct", offsetof(sys_stat_t, pgscan_direct)},
+	{"pgscan_direct_dma", offsetof(sys_stat_t, pgscan_direct)},
+	{"pgscan_direct_dma32", offsetof(sys_stat_t, pgscan_direct)},
+	{"pgscan_direct_normal", offsetof(sys_stat_t, pgscan_direct)},
+	{"pgscan_direct_high", offsetof(sys_stat_t, pgscan_direct)},
+	{"pgscan_direct_movable", offsetof(sys_stat_t, pgscan_direct)},
+	{"pgsteal_kswapd", offsetof(sys_stat_t, pgsteal_kswapd)},
+	{"pgsteal_kswapd_dma", offsetof(sys_stat_t, pgsteal_kswapd)},
+	{"pgsteal_kswapd_dma32", offsetof(sys_stat_t, pgsteal_kswapd)},
+	{"pgsteal_kswapd_normal", offsetof(sys_stat_t, pgsteal_kswapd)},
+	{"pgsteal_kswapd_high", offsetof(sys_stat_t, pgsteal_kswapd)},
+	{"pgsteal_kswapd_movable", offsetof(sys_stat_t, pgsteal_kswapd)},
+	{"pgsteal_direct", offsetof(sys_stat_t, pgsteal_direct)},
+	{"pgsteal_direct_dma", offsetof(sys_stat_t, pgsteal_direct)},
+	{"pgsteal_direct_dma32", offsetof(sys_stat_t, pgsteal_direct)},
+	{"pgsteal_direct_normal", offsetof(sys_stat_t, pgsteal_direct)},
+	{"pgsteal_direct_high", offsetof(sys_stat_t, pgsteal_direct)},
+	{"pgsteal_direct_movable", offsetof(sys_stat_t, pgsteal_direct)},
+	{"compact_stall", offsetof(sys_stat_t, compact_stall)},
+	{"oom_kill", offsetof(sys_stat_t, oom_kill)},
+	{"workingset_refault", offsetof(sys_stat_t, workingset_refault)},
+	{"workingset_refault_anon", offsetof(sys_stat_t, workingset_refault)},
+	{"workingset_refault_file", offsetof(sys_stat_t, workingset_refault)},
+	{"numa_hit", offsetof(sys_stat_t, numa_hit)},
+	{"numa_miss", offsetof(sys_stat_t, numa_miss)},
+	{"numa_foreign", offsetof(sys_stat_t, numa_foreign)},
+};
+
+/**
+ * Compiled /proc/vmstat parsing plan.
+ */
+typedef struct vmstat_plan_t {
+	/* number of compiled lines, -1 if not compiled */
+	int count;
+	struct {
+		/* the line number */
+		int line;
+		/* index in vmstat_keys table */
+		int key;
+	} lines[VMSTAT_PLAN_SIZE];
+} vmstat_plan_t;
+
+static vmstat_plan_t vmstat_plan = {.count = -1};
+
+/**
+ * Finds the vmstat_keys table entry of a /proc/vmstat line.
+ *
+ * @param[in] line   the line.
+ * @return           the key index or -1 if the counter is not needed.
+ */
+static int
+vmstat_find_key(const char* line)
+{
+	const char* end = strchr(line, ' ');
+	if (!end) return -1;
+	size_t len = end - line;
+	size_t i;
+	for (i = 0; i < sizeof(vmstat_keys) / sizeof(vmstat_keys[0]); i++) {
+		if (strlen(vmstat_keys[i].key) == len && !memcmp(line, vmstat_keys[i].key, len)) return i;
+	}
+	return -1;
+}
+
+/**
+ * Compiles the /proc/vmstat parsing plan.
+ *
+ * @param[in] text   the file contents.
+ * @param[out] plan  the compiled plan.
+ */
+static void
+vmstat_compile(const char* text, vmstat_plan_t* plan)
+{
+	const char* line = text;
+	int index = 0;
+	plan->count = 0;
+	while (*line && plan->count < VMSTAT_PLAN_SIZE) {
+		int key = vmstat_find_key(line);
+		if (key != -1) {
+			plan->lines[plan->count].line = index;
+			plan->lines[plan->count].key = key;
+			plan->count++;
+		}
+		if ( (line = strchr(line, '\n')) == NULL) break;
+		line++;
+		index++;
+	}
+}
+
+/**
+ * Parses /proc/vmstat contents with the compiled plan.
+ *
+ * @param[in] text   the file contents.
+ * @param[in] plan   the compiled plan.
+ * @param[out] stat  the system statistics.
+ * @return           0 for success, -1 if the file doesn't match the plan.
+ */
+static int
+vmstat_parse(const char* text, const vmstat_plan_t* plan, sys_stat_t* stat)
+{
+	const char* line = text;
+	int index = 0;
+	int i;
+	for (i = 0; i < plan->count; i++) {
+		*(long long*)((char*)stat + vmstat_keys[plan->lines[i].key].offset) = 0;
+	}
+	for (i = 0; i < plan->count; i++) {
+		/* skip to the next compiled line */
+		while (index < plan->lines[i].line) {
+			if ( (line = strchr(line, '\n')) == NULL) return -1;
+			line++;
+			index++;
+		}
+		const char* key = vmstat_keys[plan->lines[i].key].key;
+		size_t len = strlen(key);
+		if (memcmp(line, key, len) || line[len] != ' ') return -1;
+		*(long long*)((char*)stat + vmstat_keys[plan->lines[i].key].offset) += strtoll(line + len + 1, NULL, 10);
+	}
+	return 0;
+}
+
+/**
+ * Reads /proc/vmstat counters.
+ *
+ * @param[out] stat   the system statistics.
+ * @return            0 for success.
+ */
+static int
+read_vmstat(sys_stat_t* stat)
+{
+	static char* buffer;
+	ssize_t len;
+
+	if (!buffer && (buffer = malloc(VMSTAT_BUFFER_SIZE)) == NULL) return -1;
+	proc_root_path(buffer, VMSTAT_BUFFER_SIZE, "/proc/vmstat");
+	int fd = open(buffer, O_RDONLY);
+	if (fd == -1) return -1;
+	len = read(fd, buffer, VMSTAT_BUFFER_SIZE - 1);
+	close(fd);
+	if (len <= 0) return -1;
+	buffer[len] = '\0';
+
+	if (vmstat_plan.count == -1 || vmstat_parse(buffer, &vmstat_plan, stat) != 0) {
+		/* the counters missing from the new plan must stay undefined */
+		sys_stat_reset(stat);
+		vmstat_compile(buffer, &vmstat_plan);
+		if (vmstat_parse(buffer, &vmstat_plan, stat) != 0) return -1;
+	}
+	return vmstat_plan.count ? 0 : -1;
+}
+
+/**
+ * Checks if the block device I/O is accounted also to another device.
+ *
+ * @param[in] name   the device name.
+ * @param[in] disk   the name of the previous physical disk.
+ * @return           true for partitions and virtual devices.
+ */
+static bool
+is_derived_device(const char* name, const char* disk)
+{
+	static const char* virtual_prefixes[] = {"loop", "ram", "zram", "dm-", "md", "nbd"};
+	size_t i;
+	/* partitions are listed after their disks and have the disk name
+	 * as prefix (sda1, mmcblk0p1, nvme0n1p1) */
+	if (*disk && !strncmp(name, disk, strlen(disk))) return true;
+	for (i = 0; i < sizeof(virtual_prefixes) / sizeof(virtual_prefixes[0]); i++) {
+		if (!strncmp(name, virtual_prefixes[i], strlen(virtual_prefixes[i]))) return true;
+	}
+	return false;
+}
+
+/**
+ * Reads /proc/diskstats counters of the physical disks.
+ *
+ * @param[out] stat   the system statistics.
+ * @return            0 for success.
+ */
+static int
+read_diskstats(sys_stat_t* stat)
+{
+	char buffer[512];
+	char name[64];
+	char disk[64] = "";
+	long long reads, read_sectors, writes, write_sectors;
+
+	proc_root_path(buffer, sizeof(buffer), "/proc/diskstats");
+	FILE* fp = fopen(buffer, "r");
+	if (!fp) return -1;
+	stat->disk_reads = 0;
+	stat->disk_read_sectors = 0;
+	stat->disk_writes = 0;
+	stat->disk_write_sectors = 0;
+	while (fgets(buffer, sizeof(buffer), fp)) {
+		if (sscanf(buffer, "%*u %*u %63s %lld %*u %lld %*u %lld %*u %lld", name, &reads, &read_sectors,
+				&writes, &write_sectors) != 5) {
+			continue;
+		}
+		if (is_derived_device(name, disk)) continue;
+		strcpy(disk, name);
+		stat->disk_reads += reads;
+		stat->disk_read_sectors += read_sectors;
+		stat->disk_writes += writes;
+		stat->disk_write_sectors += write_sectors;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/**
+ * Reads the memory totals of the NUMA nodes.
+ *
+ * @param[out] stat   the system statistics.
+ * @return            0 for success.
+ */
+static int
+read_nodes(sys_stat_t* stat)
+{
+	char buffer[PATH_MAX];
+	int count = sys_stat_node_count();
+	int node, read = 0;
+	for (node = 0; node < count; node++) {
+		proc_root_path(buffer, sizeof(buffer), "/sys/devices/system/node/node%d/meminfo", node);
+		FILE* fp = fopen(buffer, "r");
+		if (!fp) continue;
+		/* the lines are prefixed with "Node <N>" */
+		while (fgets(buffer, sizeof(buffer), fp)) {
+			int value;
+			if (sscanf(buffer, "Node %*d MemTotal: %d", &value) == 1) {
+				stat->node_total[node] = value;
+			}
+			else if (sscanf(buffer, "Node %*d MemFree: %d", &value) == 1) {
+				stat->node_free[node] = value;
+				break;
+			}
+		}
+		fclose(fp);
+		read++;
+	}
+	return read ? 0 : -1;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+int
+sys_stat_read(int flags, sys_stat_t* stat)
+{
+	int rc = 0;
+
+	sys_stat_reset(stat);
+	if ((flags & SYS_STAT_VMSTAT) && read_vmstat(stat) != 0) rc |= SYS_STAT_VMSTAT;
+	if ((flags & SYS_STAT_DISKSTATS) && read_diskstats(stat) != 0) rc |= SYS_STAT_DISKSTATS;
+	if ((flags & SYS_STAT_NODES) && read_nodes(stat) != 0) rc |= SYS_STAT_NODES;
+	return rc;
+}
+
+
+int
+sys_stat_node_count(void)
+{
+	static int count = -1;
+	char path[PATH_MAX];
+	struct dirent* item;
+
+	if (count != -1) return count;
+	count = 0;
+	proc_root_path(path, sizeof(path), "/sys/devices/system/node");
+	DIR* dir = opendir(path);
+	if (!dir) return count;
+	while ( (item = readdir(dir)) ) {
+		int node;
+		char c;
+		if (sscanf(item->d_name, "node%d%c", &node, &c) != 1 || node < 0) continue;
+		if (node >= count) count = node + 1;
+	}
+	closedir(dir);
+	if (count > SYS_STAT_MAX_NODES) count = SYS_STAT_MAX_NODES;
+	return count;
+}
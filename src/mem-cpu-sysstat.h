@@ -0,0 +1,119 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-sysstat.h
+ * Additional system statistics for mem-cpu-monitor.
+ *
+ * libsp-measure provides the system memory and CPU usage. This API reads
+ * the other system wide counters from /proc/vmstat and /proc/diskstats,
+ * and the per NUMA node memory from /sys/devices/system/node/.
+ * The counters are cumulative, the rates are calculated by the monitor
+ * from two snapshots. Only the files selected by the flags are read.
+ *
+ * /proc/vmstat has over a hundred lines in a fixed order, of which only
+ * a few are needed. The first read compiles the line numbers and keys of
+ * the needed counters, so the following reads just verify the key at
+ * each compiled line and skip the other lines without comparing them.
+ * The plan is recompiled if a key doesn't match, for example when the
+ * proc root is switched to a capture from another kernel.
+ */
+#ifndef MEM_CPU_SYSSTAT_H
+#define MEM_CPU_SYSSTAT_H
+
+/* value of the counters which could not be read */
+#define SYS_STAT_UNDEFINED   (-1)
+
+/**
+ * The system data sources.
+ */
+enum {
+	/* virtual memory counters from /proc/vmstat */
+	SYS_STAT_VMSTAT = 1 << 0,
+	/* block device counters from /proc/diskstats */
+	SYS_STAT_DISKSTATS = 1 << 1,
+	/* NUMA node memory from /sys/devices/system/node/node<N>/meminfo */
+	SYS_STAT_NODES = 1 << 2,
+};
+
+/* maximum number of the reported NUMA nodes */
+#define SYS_STAT_MAX_NODES   16
+
+/**
+ * System statistics snapshot.
+ */
+typedef struct sys_stat_t {
+	/* kilobytes paged in from and out to storage */
+	long long pgpgin;
+	long long pgpgout;
+
+	/* page faults, major page faults, and pages swapped in and out */
+	long long pgfault;
+	long long pgmajfault;
+	long long pswpin;
+	long long pswpout;
+	/* pages scanned and reclaimed by kswapd and by direct reclaim */
+	long long pgscan_kswapd;
+	long long pgscan_direct;
+	long long pgsteal_kswapd;
+	long long pgsteal_direct;
+	/* direct compaction stalls, OOM killer invocations and refaults
+	 * of recently evicted pages */
+	long long compact_stall;
+	long long oom_kill;
+	long long workingset_refault;
+	/* pages allocated from the intended node, allocated from another
+	 * node than intended, and intended for a node but allocated elsewhere */
+	long long numa_hit;
+	long long numa_miss;
+	long long numa_foreign;
+
+	/* completed reads and writes, and sectors (512 bytes) read and
+	 * written by the physical disks. Partitions and virtual devices
+	 * are excluded, as their I/O is accounted to the disks too */
+	long long disk_reads;
+	long long disk_read_sectors;
+	long long disk_writes;
+	long long disk_write_sectors;
+
+	/* total and free memory of the NUMA nodes (kB), indexed by the node
+	 * number. Offline nodes and the nodes without memory are undefined */
+	int node_total[SYS_STAT_MAX_NODES];
+	int node_free[SYS_STAT_MAX_NODES];
+} sys_stat_t;
+
+/**
+ * Reads system statistics.
+ *
+ * The counters which were not requested or could not be read are set
+ * to SYS_STAT_UNDEFINED.
+ * @param[in] flags   the data sources to read (SYS_STAT_* flags).
+ * @param[out] stat   the system statistics.
+ * @return            0 for success, otherwise the flags of the data
+ *                    sources which could not be read.
+ */
+int sys_stat_read(int flags, sys_stat_t* stat);
+
+/**
+ * Gets the number of NUMA nodes.
+ *
+ * The nodes are looked up from /sys/devices/system/node/ on the first
+ * call. Node numbers can have gaps, so this is the highest node number
+ * plus one, limited to SYS_STAT_MAX_NODES.
+ * @return   the number of nodes, 0 if the kernel has no NUMA support.
+ */
+int sys_stat_node_count(void);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+
+#include "mem-cpu-taskstats.h"
+
+/**
+ * Private API
+ */
+
+/* netlink message buffer size, an exit notification has two nested
+ * statistics records */
+#define TASKSTATS_BUFFER_SIZE   8192
+
+/* attribute payload pointer and length */
+#define NLA_DATA(nla)   ((char*)(nla) + NLA_HDRLEN)
+#define NLA_LEN(nla)    ((int)(nla)->nla_len - NLA_HDRLEN)
+
+/* generic netlink message payload pointer and length */
+#define GENL_DATA(nlh)  ((char*)NLMSG_DATA(nlh) + GENL_HDRLEN)
+#define GENL_LEN(nlh)   ((int)(nlh)->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN))
+
+/**
+ * Generic netlink request with space for the attributes.
+ */
+typedef struct genl_request_t {
+	struct nlmsghdr nlh;
+	struct genlmsghdr genl;
+	char attrs[256];
+} genl_request_t;
+
+/**
+ * Adds an attribute to a request.
+ *
+ * @param[in] request  the request.
+ * @param[in] type     the attribute type.
+ * @param[in] data     the attribute data.
+ * @param[in] len      the attribute data length.
+ */
+static void
+request_add_attr(genl_request_t* request, int type, const void* data, int len)
+{
+	struct nlattr* nla = (struct nlattr*)((char*)request + NLMSG_ALIGN(request->nlh.nlmsg_len));
+	nla->nla_type = type;
+	nla->nla_len = NLA_HDRLEN + len;
+	memcpy(NLA_DATA(nla), data, len);
+	request->nlh.nlmsg_len = NLMSG_ALIGN(request->nlh.nlmsg_len) + NLA_ALIGN(nla->nla_len);
+}
+
+/**
+ * Sends a generic netlink request.
+ *
+ * @param[in] fd      the socket.
+ * @param[in] family  the family identifier.
+ * @param[in] cmd     the command.
+ * @param[in] flags   the message flags in addition to NLM_F_REQUEST.
+ * @param[in] seq     the sequence number.
+ * @param[in] type    the attribute type.
+ * @param[in] data    the attribute data.
+ * @param[in] len     the attribute data length.
+ * @return            0 for success, otherwise a negative error code.
+ */
+static int
+request_send(int fd, int family, int cmd, int flags, unsigned int seq, int type, const void* data, int len)
+{
+	genl_request_t request;
+	struct sockaddr_nl addr = {.nl_family = AF_NETLINK};
+
+	memset(&request, 0, sizeof(request));
+	request.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	request.nlh.nlmsg_type = family;
+	request.nlh.nlmsg_flags = NLM_F_REQUEST | flags;
+	request.nlh.nlmsg_seq = seq;
+	request.nlh.nlmsg_pid = 0;
+	request.genl.cmd = cmd;
+	request.genl.version = 1;
+	request_add_attr(&request, type, data, len);
+	if (sendto(fd, &request, request.nlh.nlmsg_len, 0, (struct sockaddr*)&addr, sizeof(addr)) < 0) return -errno;
+	return 0;
+}
+
+/**
+ * Waits for the acknowledgement of a request.
+ *
+ * The other messages received before it are discarded.
+ * @param[in] fd    the socket.
+ * @param[in] seq   the request sequence number.
+ * @return          0 for success, otherwise a negative error code.
+ */
+static int
+request_ack(int fd, unsigned int seq)
+{
+	char buffer[TASKSTATS_BUFFER_SIZE];
+	while (1) {
+		int len = recv(fd, buffer, sizeof(buffer), 0);
+		if (len < 0) {
+			if (errno == EINTR) continue;
+			return -errno;
+		}
+		struct nlmsghdr* nlh;
+		for (nlh = (struct nlmsghdr*)buffer; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == NLMSG_ERROR && nlh->nlmsg_seq == seq) {
+				return ((struct nlmsgerr*)NLMSG_DATA(nlh))->error;
+			}
+		}
+	}
+}
+
+/**
+ * Finds an attribute.
+ *
+ * @param[in] attrs  the attributes.
+ * @param[in] len    the attributes length.
+ * @param[in] type   the attribute type.
+ * @return           the attribute or NULL if not found.
+ */
+static struct nlattr*
+find_attr(char* attrs, int len, int type)
+{
+	while (len >= NLA_HDRLEN) {
+		struct nlattr* nla = (struct nlattr*)attrs;
+		if (nla->nla_len < NLA_HDRLEN || nla->nla_len > len) break;
+		if ((nla->nla_type & NLA_TYPE_MASK) == type) return nla;
+		attrs += NLA_ALIGN(nla->nla_len);
+		len -= NLA_ALIGN(nla->nla_len);
+	}
+	return NULL;
+}
+
+/**
+ * Resolves the TASKSTATS generic netlink family identifier.
+ *
+ * @param[in] fd   the socket.
+ * @return         the family identifier or a negative error code.
+ */
+static int
+resolve_family(int fd)
+{
+	char buffer[TASKSTATS_BUFFER_SIZE];
+	int rc = request_send(fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0, 0, CTRL_ATTR_FAMILY_NAME,
+			TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME));
+	if (rc < 0) return rc;
+	int len = recv(fd, buffer, sizeof(buffer), 0);
+	if (len < 0) return -errno;
+	struct nlmsghdr* nlh = (struct nlmsghdr*)buffer;
+	if (!NLMSG_OK(nlh, (unsigned int)len)) return -EPROTO;
+	if (nlh->nlmsg_type == NLMSG_ERROR) return ((struct nlmsgerr*)NLMSG_DATA(nlh))->error;
+	struct nlattr* nla = find_attr(GENL_DATA(nlh), GENL_LEN(nlh), CTRL_ATTR_FAMILY_ID);
+	if (!nla) return -ENOENT;
+	return *(__u16*)NLA_DATA(nla);
+}
+
+/**
+ * Copies the delays from kernel statistics.
+ *
+ * @param[in] stats    the kernel statistics.
+ * @param[out] delays  the delays.
+ */
+static void
+copy_delays(const struct taskstats* stats, taskstats_delays_t* delays)
+{
+	delays->pid = stats->ac_pid;
+	delays->ppid = stats->ac_ppid;
+	delays->blkio = stats->blkio_delay_total;
+	delays->swapin = stats->swapin_delay_total;
+	delays->freepages = stats->freepages_delay_total;
+#if TASKSTATS_VERSION >= 9
+	/* thrashing delay was added in version 9 */
+	delays->thrashing = stats->version >= 9 ? (long long)stats->thrashing_delay_total : TASKSTATS_UNDEFINED;
+#else
+	delays->thrashing = TASKSTATS_UNDEFINED;
+#endif
+}
+
+/**
+ * Gets the statistics of a pid or tgid record in a taskstats message.
+ *
+ * @param[in] nlh     the message.
+ * @param[in] type    TASKSTATS_TYPE_AGGR_PID or TASKSTATS_TYPE_AGGR_TGID.
+ * @param[out] stats  the statistics.
+ * @return            0 for success, -1 if not found.
+ */
+static int
+get_stats(struct nlmsghdr* nlh, int type, struct taskstats* stats)
+{
+	struct nlattr* aggr = find_attr(GENL_DATA(nlh), GENL_LEN(nlh), type);
+	if (!aggr) return -1;
+	struct nlattr* nla = find_attr(NLA_DATA(aggr), NLA_LEN(aggr), TASKSTATS_TYPE_STATS);
+	if (!nla) return -1;
+	/* the structure is smaller in older kernels and larger in newer,
+	 * the version tells which fields are valid */
+	int len = NLA_LEN(nla);
+	if (len < (int)(offsetof(struct taskstats, freepages_delay_total) + sizeof(stats->freepages_delay_total))) return -1;
+	if (len > (int)sizeof(struct taskstats)) len = sizeof(struct taskstats);
+	memset(stats, 0, sizeof(struct taskstats));
+	/* the attribute payload is only 4 byte aligned */
+	memcpy(stats, NLA_DATA(nla), len);
+	return 0;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+int
+taskstats_open(taskstats_t* self, bool listen)
+{
+	int rc;
+	self->fd = -1;
+	self->listen_fd = -1;
+	self->listen_error = 0;
+	self->seq = 0;
+
+	if ( (self->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) == -1) return -errno;
+	if ( (rc = resolve_family(self->fd)) < 0) goto failure;
+	self->family = rc;
+
+	if (listen) {
+		char cpumask[32];
+		long cpus = sysconf(_SC_NPROCESSORS_CONF);
+		snprintf(cpumask, sizeof(cpumask), "0-%ld", cpus > 0 ? cpus - 1 : 0);
+		if ( (self->listen_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) == -1) {
+			rc = -errno;
+			goto failure;
+		}
+		/* bursts of exits can be large */
+		int size = 1024 * 1024;
+		setsockopt(self->listen_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		/* the registration needs CAP_NET_ADMIN, without it only the
+		 * queries are available */
+		unsigned int seq = ++self->seq;
+		if ( (rc = request_send(self->listen_fd, self->family, TASKSTATS_CMD_GET, NLM_F_ACK, seq,
+				TASKSTATS_CMD_ATTR_REGISTER_CPUMASK, cpumask, strlen(cpumask) + 1)) < 0 ||
+				(rc = request_ack(self->listen_fd, seq)) < 0 ||
+				fcntl(self->listen_fd, F_SETFL, O_NONBLOCK) == -1) {
+			self->listen_error = rc < 0 ? rc : -errno;
+			close(self->listen_fd);
+			self->listen_fd = -1;
+		}
+	}
+	return 0;
+
+failure:
+	taskstats_close(self);
+	return rc;
+}
+
+
+void
+taskstats_close(taskstats_t* self)
+{
+	if (self->fd != -1) close(self->fd);
+	/* closing the socket deregisters the listener */
+	if (self->listen_fd != -1) close(self->listen_fd);
+	self->fd = -1;
+	self->listen_fd = -1;
+}
+
+
+int
+taskstats_query(taskstats_t* self, int tgid, taskstats_delays_t* delays)
+{
+	char buffer[TASKSTATS_BUFFER_SIZE];
+	unsigned int seq = ++self->seq;
+	__u32 value = tgid;
+	int rc = request_send(self->fd, self->family, TASKSTATS_CMD_GET, 0, seq, TASKSTATS_CMD_ATTR_TGID, &value, sizeof(value));
+	if (rc < 0) return rc;
+	while (1) {
+		int len = recv(self->fd, buffer, sizeof(buffer), 0);
+		if (len < 0) return -errno;
+		struct nlmsghdr* nlh = (struct nlmsghdr*)buffer;
+		if (!NLMSG_OK(nlh, (unsigned int)len)) return -EPROTO;
+		/* skip the replies of the earlier interrupted queries */
+		if (nlh->nlmsg_seq != seq) continue;
+		if (nlh->nlmsg_type == NLMSG_ERROR) return ((struct nlmsgerr*)NLMSG_DATA(nlh))->error;
+		struct taskstats stats;
+		if (get_stats(nlh, TASKSTATS_TYPE_AGGR_TGID, &stats) != 0) return -EPROTO;
+		copy_delays(&stats, delays);
+		/* the aggregated statistics don't have the process identifiers */
+		delays->pid = tgid;
+		delays->ppid = 0;
+		return 0;
+	}
+}
+
+
+int
+taskstats_read_exits(taskstats_t* self, void (*callback)(const taskstats_delays_t* delays, void* data), void* data)
+{
+	char buffer[TASKSTATS_BUFFER_SIZE];
+	int count = 0;
+	if (self->listen_fd == -1) return 0;
+	while (1) {
+		int len = recv(self->listen_fd, buffer, sizeof(buffer), 0);
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EINTR) break;
+			return -errno;
+		}
+		struct nlmsghdr* nlh;
+		for (nlh = (struct nlmsghdr*)buffer; NLMSG_OK(nlh, (unsigned int)len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type != self->family) continue;
+			/* every exiting task has a pid record with its own delays, the
+			 * tgid record of the last thread would duplicate them */
+			struct taskstats stats;
+			if (get_stats(nlh, TASKSTATS_TYPE_AGGR_PID, &stats) != 0) continue;
+			taskstats_delays_t delays;
+			copy_delays(&stats, &delays);
+			/* the delay of a task can't exceed its lifetime. A delay measured
+			 * from a missing start timestamp (for example when the delay
+			 * accounting was enabled during the delay) is since boot */
+			long long elapsed = stats.ac_etime * 1000;
+			if (delays.blkio > elapsed) delays.blkio = 0;
+			if (delays.swapin > elapsed) delays.swapin = 0;
+			if (delays.freepages > elapsed) delays.freepages = 0;
+			if (delays.thrashing > elapsed) delays.thrashing = 0;
+			callback(&delays, data);
+			count++;
+		}
+	}
+	return count;
+}
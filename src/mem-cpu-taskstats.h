@@ -0,0 +1,113 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-taskstats.h
+ * Taskstats delay accounting for mem-cpu-monitor.
+ *
+ * The kernel delay accounting tells how long the tasks have waited for
+ * block I/O, swap-in, direct reclaim (free pages) and thrashing (page
+ * cache refaults). The cumulative delays of a process, including its
+ * exited threads, are queried over the generic netlink TASKSTATS family.
+ *
+ * The delays of the short-lived child processes are lost when they exit,
+ * unless an exit listener is registered. The listener receives the final
+ * statistics of every exiting task, which are then accounted to their
+ * parent processes, like the CPU times of the waited-for children.
+ *
+ * Taskstats needs CAP_NET_ADMIN capability and the delays are collected
+ * only when the delay accounting is enabled (kernel.task_delayacct sysctl
+ * or delayacct boot parameter).
+ */
+#ifndef MEM_CPU_TASKSTATS_H
+#define MEM_CPU_TASKSTATS_H
+
+#include <stdbool.h>
+
+/* value of the delays which could not be read */
+#define TASKSTATS_UNDEFINED   (-1)
+
+/**
+ * Task delays.
+ */
+typedef struct taskstats_delays_t {
+	/* the task and its parent process identifiers */
+	int pid;
+	int ppid;
+	/* the cumulative block I/O, swap-in, free pages (direct reclaim) and
+	 * thrashing delays (ns) */
+	long long blkio;
+	long long swapin;
+	long long freepages;
+	long long thrashing;
+} taskstats_delays_t;
+
+/**
+ * Taskstats connection.
+ */
+typedef struct taskstats_t {
+	/* the query socket and the TASKSTATS family identifier */
+	int fd;
+	int family;
+	unsigned int seq;
+	/* the exit listener socket, -1 if not registered, and the
+	 * registration error, 0 if registered or not requested */
+	int listen_fd;
+	int listen_error;
+} taskstats_t;
+
+/**
+ * Opens taskstats connection.
+ *
+ * If the exit listener registration fails, the connection is opened
+ * without it and the error is stored into listen_error.
+ * @param[out] self    the connection.
+ * @param[in] listen   register also the exit listener.
+ * @return             0 for success, otherwise a negative error code.
+ */
+int taskstats_open(taskstats_t* self, bool listen);
+
+/**
+ * Closes taskstats connection.
+ *
+ * @param[in] self   the connection.
+ */
+void taskstats_close(taskstats_t* self);
+
+/**
+ * Queries the cumulative delays of a process.
+ *
+ * @param[in] self     the connection.
+ * @param[in] tgid     the process identifier.
+ * @param[out] delays  the process delays.
+ * @return             0 for success, otherwise a negative error code.
+ */
+int taskstats_query(taskstats_t* self, int tgid, taskstats_delays_t* delays);
+
+/**
+ * Reads the pending exit notifications.
+ *
+ * @param[in] self      the connection.
+ * @param[in] callback  the function called with the final delays of
+ *                      every exited task.
+ * @param[in] data      the callback data.
+ * @return              the number of the exited tasks, or a negative
+ *                      error code. -ENOBUFS means that some of the
+ *                      notifications were lost.
+ */
+int taskstats_read_exits(taskstats_t* self, void (*callback)(const taskstats_delays_t* delays, void* data),
+		void* data);
+
+#endif
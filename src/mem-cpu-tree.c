@@ -0,0 +1,290 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include "mem-cpu-tree.h"
+#include "proc-root.h"
+
+/**
+ * Private API
+ */
+
+/**
+ * Running process list, collected once per update for all trees.
+ */
+typedef struct proc_list_t {
+	proc_stat_t* items;
+	int* pids;
+	int count;
+	int size;
+} proc_list_t;
+
+static int
+compare_pid(const void* p1, const void* p2)
+{
+	return *(const int*)p1 - *(const int*)p2;
+}
+
+/**
+ * Reads parent process identifiers and CPU times of all processes.
+ *
+ * @param[out] list   the process list, sorted by process identifier.
+ * @return            0 for success.
+ */
+static int
+proc_list_read(proc_list_t* list)
+{
+	struct dirent* item;
+	char path[PATH_MAX];
+	proc_root_path(path, sizeof(path), "/proc");
+	DIR* dir = opendir(path);
+	if (!dir) return -1;
+	list->count = 0;
+	while ( (item = readdir(dir)) ) {
+		int pid = atoi(item->d_name);
+		if (pid <= 0) continue;
+		if (list->count == list->size) {
+			int size = list->size ? list->size * 2 : 512;
+			proc_stat_t* items = realloc(list->items, size * sizeof(proc_stat_t));
+			if (!items) break;
+			list->items = items;
+			int* pids = realloc(list->pids, size * sizeof(int));
+			if (!pids) break;
+			list->pids = pids;
+			list->size = size;
+		}
+		if (proc_stat_read(pid, PROC_STAT_STAT, &list->items[list->count]) == 0) {
+			list->pids[list->count++] = pid;
+		}
+	}
+	closedir(dir);
+
+	/* /proc is normally listed in process identifier order */
+	int i;
+	for (i = 1; i < list->count; i++) {
+		if (list->pids[i - 1] > list->pids[i]) break;
+	}
+	if (i < list->count) {
+		int* order = malloc(list->count * sizeof(int) * 2);
+		proc_stat_t* items = malloc(list->count * sizeof(proc_stat_t));
+		if (!order || !items) {
+			free(order);
+			free(items);
+			return -ENOMEM;
+		}
+		for (i = 0; i < list->count; i++) {
+			order[i * 2] = list->pids[i];
+			order[i * 2 + 1] = i;
+		}
+		qsort(order, list->count, sizeof(int) * 2, compare_pid);
+		for (i = 0; i < list->count; i++) {
+			list->pids[i] = order[i * 2];
+			items[i] = list->items[order[i * 2 + 1]];
+		}
+		free(list->items);
+		free(order);
+		list->items = items;
+		list->size = list->count;
+	}
+	return 0;
+}
+
+/**
+ * Finds tree member by process identifier.
+ *
+ * @param[in] self   the process tree.
+ * @param[in] pid    the process identifier.
+ * @return           the member or NULL if not found.
+ */
+static proc_tree_member_t*
+tree_find(const proc_tree_t* self, int pid)
+{
+	return bsearch(&pid, self->members, self->member_count, sizeof(proc_tree_member_t), compare_pid);
+}
+
+/**
+ * Adds a new member to the tree.
+ *
+ * @param[in] self   the process tree.
+ * @param[in] pid    the process identifier.
+ * @param[in] stat   the process statistics.
+ * @return           0 for success.
+ */
+static int
+tree_add(proc_tree_t* self, int pid, const proc_stat_t* stat)
+{
+	if (self->member_count == self->member_size) {
+		int size = self->member_size ? self->member_size * 2 : 16;
+		proc_tree_member_t* members = realloc(self->members, size * sizeof(proc_tree_member_t));
+		if (!members) return -ENOMEM;
+		self->members = members;
+		self->member_size = size;
+	}
+	int index = self->member_count;
+	while (index > 0 && self->members[index - 1].pid > pid) index--;
+	memmove(self->members + index + 1, self->members + index,
+			(self->member_count - index) * sizeof(proc_tree_member_t));
+	self->member_count++;
+
+	proc_tree_member_t* member = &self->members[index];
+	member->pid = pid;
+	member->stat = *stat;
+	member->alive = true;
+	return 0;
+}
+
+/**
+ * Updates a single tree from the running process list.
+ *
+ * @param[in] self   the process tree.
+ * @param[in] list   the running process list.
+ * @param[in] flags  the additional member data sources to read.
+ */
+static void
+tree_update(proc_tree_t* self, const proc_list_t* list, int flags)
+{
+	int i;
+	for (i = 0; i < self->member_count; i++) {
+		self->members[i].alive = false;
+	}
+
+	/* update the known members, a different start time means that
+	 * the process identifier has been reused */
+	for (i = 0; i < list->count; i++) {
+		proc_tree_member_t* member = tree_find(self, list->pids[i]);
+		if (member && member->stat.start_time == list->items[i].start_time) {
+			member->stat = list->items[i];
+			member->alive = true;
+		}
+	}
+
+	/* remove the terminated members. If the parent is a member, it will
+	 * get the CPU time of the terminated child when waiting for it */
+	int count = 0;
+	for (i = 0; i < self->member_count; i++) {
+		proc_tree_member_t* member = &self->members[i];
+		if (!member->alive) {
+			proc_tree_member_t* parent = tree_find(self, member->stat.ppid);
+			if (!parent || !parent->alive) {
+				self->cpu_departed += member->cpu;
+			}
+			continue;
+		}
+		if (count != i) self->members[count] = *member;
+		count++;
+	}
+	self->member_count = count;
+
+	/* look up the root for the first time */
+	if (!self->started) {
+		const int* pid = bsearch(&self->root, list->pids, list->count, sizeof(int), compare_pid);
+		if (!pid) return;
+		tree_add(self, self->root, &list->items[pid - list->pids]);
+		self->started = true;
+	}
+
+	/* add the new descendants until no more are found. Usually one pass
+	 * is enough, as children have larger identifiers than their parents */
+	int added;
+	do {
+		added = 0;
+		for (i = 0; i < list->count; i++) {
+			const proc_stat_t* stat = &list->items[i];
+			if (!tree_find(self, stat->ppid) || tree_find(self, list->pids[i])) continue;
+			if (tree_add(self, list->pids[i], stat) == 0) added++;
+		}
+	} while (added);
+
+	/* aggregate the tree values */
+	self->cpu = self->cpu_departed;
+	self->private_clean = 0;
+	self->private_dirty = 0;
+	self->pss = 0;
+	for (i = 0; i < self->member_count; i++) {
+		proc_tree_member_t* member = &self->members[i];
+		member->cpu = (unsigned long long)member->stat.utime + member->stat.stime +
+				member->stat.cutime + member->stat.cstime;
+		self->cpu += member->cpu;
+
+		if (flags & PROC_STAT_SMAPS) {
+			proc_stat_t stat;
+			if (proc_stat_read(member->pid, flags & ~PROC_STAT_STAT, &stat) < 0) continue;
+			member->stat.pss = stat.pss;
+			member->stat.private_clean = stat.private_clean;
+			member->stat.private_dirty = stat.private_dirty;
+			member->stat.swap = stat.swap;
+			/* kernel threads have no memory mappings */
+			if (stat.pss == PROC_STAT_UNDEFINED) continue;
+			self->private_clean += stat.private_clean;
+			self->private_dirty += stat.private_dirty + stat.swap;
+			self->pss += stat.pss;
+		}
+	}
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+proc_tree_t*
+proc_tree_create(int root)
+{
+	proc_tree_t* self = calloc(1, sizeof(proc_tree_t));
+	if (self) self->root = root;
+	return self;
+}
+
+
+void
+proc_tree_free(proc_tree_t* self)
+{
+	if (self) {
+		free(self->members);
+		free(self);
+	}
+}
+
+
+bool
+proc_tree_contains(const proc_tree_t* self, int pid)
+{
+	return tree_find(self, pid) != NULL;
+}
+
+
+int
+proc_tree_update(proc_tree_t** trees, int count, int flags)
+{
+	static proc_list_t list;
+	int rc, i;
+
+	if ( (rc = proc_list_read(&list)) != 0) return rc;
+	for (i = 0; i < count; i++) {
+		tree_update(trees[i], &list, flags);
+	}
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-tree.h
+ * Process tree tracking for mem-cpu-monitor --tree option.
+ *
+ * The descendants of the tree root processes are found by scanning the
+ * parent process identifiers from /proc/<pid>/stat. A process stays in
+ * the tree after it has been found, even if it gets reparented when
+ * its parent terminates.
+ *
+ * The tree CPU time is the sum of the member process CPU times and the
+ * CPU times of their terminated and waited-for children. This way the
+ * CPU time of the short-lived children, which start and terminate
+ * between the scans, is not lost. The CPU time of the members, which
+ * terminate without being waited for by another member, is accumulated
+ * separately when the termination is noticed.
+ */
+#ifndef MEM_CPU_TREE_H
+#define MEM_CPU_TREE_H
+
+#include <stdbool.h>
+
+#include "mem-cpu-proc.h"
+
+/**
+ * Process tree member.
+ */
+typedef struct proc_tree_member_t {
+	int pid;
+	/* CPU time of the process and its waited-for children (clock ticks) */
+	unsigned long long cpu;
+	/* the process was found by the latest scan */
+	bool alive;
+	/* the latest process statistics */
+	proc_stat_t stat;
+} proc_tree_member_t;
+
+/**
+ * Process tree.
+ */
+typedef struct proc_tree_t {
+	/* the tree root process identifier */
+	int root;
+	/* the root process has been found */
+	bool started;
+
+	/* tree members, sorted by process identifier */
+	proc_tree_member_t* members;
+	int member_count;
+	int member_size;
+
+	/* CPU time of the terminated members not waited for by other members */
+	unsigned long long cpu_departed;
+
+	/* aggregated tree values */
+	unsigned long long cpu;
+	int private_clean;
+	int private_dirty;
+	int pss;
+} proc_tree_t;
+
+/**
+ * Creates process tree.
+ *
+ * @param[in] root   the tree root process identifier.
+ * @return           the created tree or NULL in the case of failure.
+ */
+proc_tree_t* proc_tree_create(int root);
+
+/**
+ * Frees process tree.
+ *
+ * @param[in] self   the process tree.
+ */
+void proc_tree_free(proc_tree_t* self);
+
+/**
+ * Checks if the process is a member of the tree.
+ *
+ * @param[in] self   the process tree.
+ * @param[in] pid    the process identifier.
+ * @return           true if the process belongs to the tree.
+ */
+bool proc_tree_contains(const proc_tree_t* self, int pid);
+
+/**
+ * Updates process trees.
+ *
+ * Scans /proc once for all the trees, adds the new descendants, removes
+ * terminated members and updates the aggregated values.
+ * @param[in] trees  the process trees.
+ * @param[in] count  the number of trees.
+ * @param[in] flags  the additional member data sources to read. Memory
+ *                   values are aggregated if PROC_STAT_SMAPS is set.
+ * @return           0 for success.
+ */
+int proc_tree_update(proc_tree_t** trees, int count, int flags);
+
+#endif
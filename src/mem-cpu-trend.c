@@ -0,0 +1,191 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "mem-cpu-trend.h"
+
+/**
+ * Private API
+ */
+
+/* Huber weighting constant, in residual scale units */
+#define HUBER_K           1.5
+/* residuals are clipped to this many scale units when updating the scale */
+#define SCALE_CLIP        4.0
+/* residual scale update rate */
+#define SCALE_RATE        0.1
+/* the monitored values are integers, so smaller scale makes no sense */
+#define SCALE_MIN         1.0
+
+/* variance of unit quantization noise, the monitored values are integers
+ * so the residual variance of the fit can't be smaller than that */
+#define VARIANCE_MIN      (1.0 / 12)
+
+/* minimum effective number of samples for the fit */
+#define MIN_SAMPLES       3.0
+
+/**
+ * Scales down the regression sums.
+ *
+ * @param[in] sums    the regression sums.
+ * @param[in] factor  the forgetting factor.
+ */
+static void
+sums_decay(trend_sums_t* sums, double factor)
+{
+	sums->w *= factor;
+	sums->ww *= factor * factor;
+	sums->t *= factor;
+	sums->y *= factor;
+	sums->tt *= factor;
+	sums->ty *= factor;
+	sums->yy *= factor;
+}
+
+/**
+ * Adds a weighted sample to the regression sums.
+ */
+static void
+sums_add(trend_sums_t* sums, double weight, double t, double y)
+{
+	sums->w += weight;
+	sums->ww += weight * weight;
+	sums->t += weight * t;
+	sums->y += weight * y;
+	sums->tt += weight * t * t;
+	sums->ty += weight * t * y;
+	sums->yy += weight * y * y;
+}
+
+/**
+ * Calculates the weighted least squares fit from the regression sums.
+ *
+ * @param[in] sums       the regression sums.
+ * @param[out] fit       the fit estimate.
+ * @param[out] intercept the fit intercept (optional).
+ * @return               0 for success.
+ */
+static int
+sums_fit(const trend_sums_t* sums, trend_fit_t* fit, double* intercept)
+{
+	if (sums->ww <= 0) return -1;
+	double n = sums->w * sums->w / sums->ww;
+	if (n < MIN_SAMPLES) return -1;
+
+	double sxx = sums->tt - sums->t * sums->t / sums->w;
+	if (sxx <= 0) return -1;
+	double sxy = sums->ty - sums->t * sums->y / sums->w;
+	double syy = sums->yy - sums->y * sums->y / sums->w;
+
+	fit->slope = sxy / sxx;
+	if (intercept) *intercept = (sums->y - fit->slope * sums->t) / sums->w;
+
+	double sse = syy - fit->slope * sxy;
+	if (sse < 0) sse = 0;
+	/* residual variance and slope variance, scaled from the
+	 * weighted sums to the effective number of samples */
+	double variance = sse / sums->w * n / (n - 2);
+	if (variance < VARIANCE_MIN) variance = VARIANCE_MIN;
+	double slope_variance = variance * (sums->w / n) / sxx;
+
+	fit->tstat = fit->slope / sqrt(slope_variance);
+	return 0;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+void
+trend_init(trend_t* self, double window)
+{
+	memset(self, 0, sizeof(trend_t));
+	self->window = window;
+}
+
+
+void
+trend_add(trend_t* self, double time, double value)
+{
+	if (!self->count) {
+		self->first = time;
+		self->last = time;
+	}
+	double t = time - self->first;
+	if (time > self->last) {
+		double factor = exp((self->last - time) / self->window);
+		sums_decay(&self->ols, factor);
+		sums_decay(&self->robust, factor);
+		self->last = time;
+	}
+
+	/* weight down the samples far off the current robust fit line */
+	double weight = 1;
+	trend_fit_t fit;
+	double intercept;
+	if (sums_fit(&self->robust, &fit, &intercept) == 0) {
+		double residual = fabs(value - (intercept + fit.slope * t));
+		if (residual > HUBER_K * self->scale) {
+			weight = HUBER_K * self->scale / residual;
+		}
+		if (residual > SCALE_CLIP * self->scale) residual = SCALE_CLIP * self->scale;
+		self->scale += SCALE_RATE * (residual - self->scale);
+		if (self->scale < SCALE_MIN) self->scale = SCALE_MIN;
+	}
+	else {
+		self->scale = SCALE_MIN;
+	}
+
+	sums_add(&self->ols, 1, t, value);
+	sums_add(&self->robust, weight, t, value);
+	self->count++;
+}
+
+
+int
+trend_fit_ols(const trend_t* self, trend_fit_t* fit)
+{
+	return sums_fit(&self->ols, fit, NULL);
+}
+
+
+int
+trend_fit_robust(const trend_t* self, trend_fit_t* fit)
+{
+	return sums_fit(&self->robust, fit, NULL);
+}
+
+
+double
+trend_span(const trend_t* self)
+{
+	return self->count ? self->last - self->first : 0;
+}
+
+
+bool
+trend_is_growing(const trend_t* self, double threshold, trend_fit_t* fit)
+{
+	trend_fit_t ols;
+	if (trend_span(self) < self->window / 4) return false;
+	if (trend_fit_ols(self, &ols) != 0 || trend_fit_robust(self, fit) != 0) return false;
+	return ols.slope > 0 && ols.tstat >= threshold && fit->slope > 0 && fit->tstat >= threshold;
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file mem-cpu-trend.h
+ * Online growth trend detection.
+ *
+ * Fits a linear regression line over the samples of a single value
+ * (for example process dirty memory) as the samples arrive. Only the
+ * regression sums are stored, so the state size is constant regardless
+ * of the number of samples. Older samples are exponentially forgotten
+ * with the time constant given at initialization.
+ *
+ * Two fits are maintained: ordinary least squares and a robust fit,
+ * where samples far off the current fit line are given smaller weight
+ * (Huber weighting). The robust fit keeps temporary spikes (caches
+ * being filled and flushed etc.) from triggering false alarms.
+ */
+#ifndef MEM_CPU_TREND_H
+#define MEM_CPU_TREND_H
+
+#include <stdbool.h>
+
+/**
+ * Weighted regression sums.
+ */
+typedef struct trend_sums_t {
+	/* sum of weights */
+	double w;
+	/* sum of squared weights, for the effective sample count */
+	double ww;
+	double t;
+	double y;
+	double tt;
+	double ty;
+	double yy;
+} trend_sums_t;
+
+/**
+ * Regression line estimate.
+ */
+typedef struct trend_fit_t {
+	/* growth rate in value units per hour */
+	double slope;
+	/* slope t-statistic (slope / its standard error) */
+	double tstat;
+} trend_fit_t;
+
+/**
+ * Trend detection state.
+ */
+typedef struct trend_t {
+	/* forgetting time constant in hours */
+	double window;
+	/* time of the first and last sample in hours */
+	double first;
+	double last;
+	unsigned count;
+
+	trend_sums_t ols;
+	trend_sums_t robust;
+	/* robust fit residual scale estimate */
+	double scale;
+} trend_t;
+
+/**
+ * Initializes trend detection state.
+ *
+ * @param[in] self    the trend state.
+ * @param[in] window  the forgetting time constant in hours.
+ */
+void trend_init(trend_t* self, double window);
+
+/**
+ * Adds a new sample.
+ *
+ * @param[in] self    the trend state.
+ * @param[in] time    the sample time in hours.
+ * @param[in] value   the sample value.
+ */
+void trend_add(trend_t* self, double time, double value);
+
+/**
+ * Calculates the ordinary least squares fit.
+ *
+ * @param[in] self    the trend state.
+ * @param[out] fit    the fit estimate.
+ * @return            0 for success, -1 if there is not enough data.
+ */
+int trend_fit_ols(const trend_t* self, trend_fit_t* fit);
+
+/**
+ * Calculates the robust fit.
+ *
+ * @param[in] self    the trend state.
+ * @param[out] fit    the fit estimate.
+ * @return            0 for success, -1 if there is not enough data.
+ */
+int trend_fit_robust(const trend_t* self, trend_fit_t* fit);
+
+/**
+ * Checks if the value grows with high confidence.
+ *
+ * Both the ordinary and the robust fit must have positive slope with
+ * t-statistic above the threshold, and the samples must cover at least
+ * a quarter of the forgetting window.
+ * @param[in] self       the trend state.
+ * @param[in] threshold  the t-statistic threshold.
+ * @param[out] fit       the robust fit estimate, if growing.
+ * @return               true if the value is growing.
+ */
+bool trend_is_growing(const trend_t* self, double threshold, trend_fit_t* fit);
+
+/**
+ * Returns the time span covered by the samples.
+ *
+ * @param[in] self    the trend state.
+ * @return            the time span in hours.
+ */
+double trend_span(const trend_t* self);
+
+#endif
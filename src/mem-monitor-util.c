@@ -21,8 +21,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
 
 #include "mem-monitor-util.h"
+#include "proc-root.h"
 
 static char line[256];
 
@@ -30,7 +32,9 @@ unsigned
 parse_proc_meminfo(MEMINFO* wanted, unsigned size)
 {
 	unsigned counter = 0;
-	FILE* meminfo = fopen("/proc/meminfo", "r");
+	char path[PATH_MAX];
+	proc_root_path(path, sizeof(path), "/proc/meminfo");
+	FILE* meminfo = fopen(path, "r");
 	if (!meminfo) return 0;
 	while (fgets(line, sizeof(line), meminfo)) {
 		unsigned idx;
@@ -53,7 +57,9 @@ done:
 
 int check_flag(const char* path)
 {
-	FILE* fp = fopen(path, "r");
+	char buffer[PATH_MAX];
+	proc_root_path(buffer, sizeof(buffer), "%s", path);
+	FILE* fp = fopen(buffer, "r");
 	if (!fp) return 0;
 	const int value = fgetc(fp);
 	fclose(fp);
@@ -25,7 +25,7 @@ typedef struct {
 	unsigned    value;  /* loaded value                     */
 } MEMINFO;
 
-/* Parses /proc/meminfo, looking for values for the keys defined in @wanted.
+/* Parses /proc/meminfo (under SP_PROC_ROOT directory if set), looking for values for the keys defined in @wanted.
  *
  *    @wanted       What keys to look for, eg. "MemTotal:", "Cached:".
  *    @wanted_cnt   How many items @wanted contains.
@@ -36,7 +36,8 @@ unsigned parse_proc_meminfo(MEMINFO* wanted, unsigned wanted_cnt);
 
 /* Opens specified flag file, and return true if it set on.
  * parameters:
- *    path - path to file to handle.
+ *    path - path to file to handle, /proc and /sys paths are read
+ *           under SP_PROC_ROOT directory if set.
  * returns:
  *    0 error opening file or flag not set.
  *    1 flag is available and set on.
@@ -0,0 +1,195 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/* Redirects the /proc and /sys file accesses of the linked libraries
+ * (libsp-measure) to the configured proc root directory.
+ *
+ * The wrappers only rewrite the path and call the next definition of
+ * the function, so without the root directory set they have no effect
+ * on the behaviour.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "proc-root.h"
+
+unsigned long proc_root_calls = 0;
+
+/* the fortified open variants used with _FORTIFY_SOURCE, declared only
+ * by the fortified headers */
+extern int __open_2(const char* path, int flags);
+extern int __open64_2(const char* path, int flags);
+
+/**
+ * Private API
+ */
+
+/**
+ * Resolves the next definition of the wrapped function.
+ */
+#define NEXT(name) \
+	static __typeof__(name)* next_##name; \
+	if (!next_##name) next_##name = (__typeof__(name)*)dlsym(RTLD_NEXT, #name)
+
+/**
+ * Rewrites the path if it should be read from the root directory.
+ *
+ * @param[in] path     the original path.
+ * @param[out] buffer  the buffer for the rewritten path (PATH_MAX bytes).
+ * @return             the path to use.
+ */
+static const char*
+rewrite(const char* path, char* buffer)
+{
+	proc_root_calls++;
+	if (!proc_root_match(path)) return path;
+	snprintf(buffer, PATH_MAX, "%s%s", proc_root_get(), path);
+	return buffer;
+}
+
+/**
+ * Public API
+ *
+ * The wrapped standard library functions. The open mode argument is
+ * read only with the flags that require it, as glibc does.
+ */
+
+int
+open(const char* path, int flags, ...)
+{
+	char buffer[PATH_MAX];
+	mode_t mode = 0;
+	NEXT(open);
+	if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+		va_list ap;
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	return next_open(rewrite(path, buffer), flags, mode);
+}
+
+
+int
+open64(const char* path, int flags, ...)
+{
+	char buffer[PATH_MAX];
+	mode_t mode = 0;
+	NEXT(open64);
+	if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+		va_list ap;
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	return next_open64(rewrite(path, buffer), flags, mode);
+}
+
+
+int
+openat(int dirfd, const char* path, int flags, ...)
+{
+	char buffer[PATH_MAX];
+	mode_t mode = 0;
+	NEXT(openat);
+	if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+		va_list ap;
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	/* only absolute paths are rewritten, so dirfd is not affected */
+	return next_openat(dirfd, rewrite(path, buffer), flags, mode);
+}
+
+
+int
+openat64(int dirfd, const char* path, int flags, ...)
+{
+	char buffer[PATH_MAX];
+	mode_t mode = 0;
+	NEXT(openat64);
+	if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+		va_list ap;
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+	return next_openat64(dirfd, rewrite(path, buffer), flags, mode);
+}
+
+
+int
+__open_2(const char* path, int flags)
+{
+	char buffer[PATH_MAX];
+	NEXT(__open_2);
+	return next___open_2(rewrite(path, buffer), flags);
+}
+
+
+int
+__open64_2(const char* path, int flags)
+{
+	char buffer[PATH_MAX];
+	NEXT(__open64_2);
+	return next___open64_2(rewrite(path, buffer), flags);
+}
+
+
+FILE*
+fopen(const char* path, const char* mode)
+{
+	char buffer[PATH_MAX];
+	NEXT(fopen);
+	return next_fopen(rewrite(path, buffer), mode);
+}
+
+
+FILE*
+fopen64(const char* path, const char* mode)
+{
+	char buffer[PATH_MAX];
+	NEXT(fopen64);
+	return next_fopen64(rewrite(path, buffer), mode);
+}
+
+
+DIR*
+opendir(const char* path)
+{
+	char buffer[PATH_MAX];
+	NEXT(opendir);
+	return next_opendir(rewrite(path, buffer));
+}
+
+
+int
+access(const char* path, int mode)
+{
+	char buffer[PATH_MAX];
+	NEXT(access);
+	return next_access(rewrite(path, buffer), mode);
+}
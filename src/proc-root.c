@@ -0,0 +1,170 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "proc-root.h"
+
+/**
+ * Private API
+ */
+
+/* the root directory, NULL until initialized */
+static char* proc_root = NULL;
+
+/* the capture archive directory and its index, NULL if not used */
+static char* archive = NULL;
+static FILE* archive_index = NULL;
+/* capture time of the current archive snapshot (ms since the epoch) */
+static long long snapshot_time = 0;
+
+/**
+ * Checks if the path starts with the specified directory.
+ */
+static bool
+path_in_dir(const char* path, const char* dir)
+{
+	size_t len = strlen(dir);
+	return !strncmp(path, dir, len) && (path[len] == '/' || path[len] == '\0');
+}
+
+/**
+ * Releases the capture archive.
+ */
+static void
+archive_close(void)
+{
+	if (archive_index) fclose(archive_index);
+	archive_index = NULL;
+	free(archive);
+	archive = NULL;
+}
+
+/**
+ * Public API
+ *
+ * See header for specifications.
+ */
+
+int
+proc_root_set(const char* root)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	if (root && *root && (stat(root, &st) != 0 || !S_ISDIR(st.st_mode))) return -1;
+	archive_close();
+	free(proc_root);
+	proc_root = strdup(root ? root : "");
+	if (!proc_root) return -1;
+
+	/* strip the trailing slashes, so "/" means the real root */
+	size_t len = strlen(proc_root);
+	while (len && proc_root[len - 1] == '/') proc_root[--len] = '\0';
+
+	/* a capture archive is used one snapshot at time, starting from the first */
+	snprintf(path, sizeof(path), "%s/" PROC_ROOT_INDEX, proc_root);
+	if (len && stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+		FILE* index = fopen(path, "r");
+		if (!index) return -1;
+		archive = proc_root;
+		archive_index = index;
+		proc_root = NULL;
+		if (proc_root_next() != 0) {
+			archive_close();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+bool
+proc_root_is_archive(void)
+{
+	return archive != NULL;
+}
+
+
+int
+proc_root_next(void)
+{
+	char name[256], path[PATH_MAX];
+	double time;
+	if (!archive_index) return -1;
+	while (fscanf(archive_index, "%255s %lf", name, &time) == 2) {
+		snprintf(path, sizeof(path), "%s/%s", archive, name);
+		char* root = strdup(path);
+		if (!root) return -1;
+		free(proc_root);
+		proc_root = root;
+		snapshot_time = (long long)(time * 1000);
+		return 0;
+	}
+	return -1;
+}
+
+
+int
+proc_root_time(void)
+{
+	struct tm tm;
+	time_t secs = snapshot_time / 1000;
+	if (!archive || !localtime_r(&secs, &tm)) return -1;
+	return ((tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec) * 1000 + snapshot_time % 1000;
+}
+
+
+const char*
+proc_root_get(void)
+{
+	if (!proc_root && proc_root_set(getenv(PROC_ROOT_ENV)) != 0) {
+		fprintf(stderr, "Warning: %s=%s is not a directory, using /proc.\n",
+				PROC_ROOT_ENV, getenv(PROC_ROOT_ENV));
+		proc_root_set(NULL);
+	}
+	return proc_root ? proc_root : "";
+}
+
+
+bool
+proc_root_match(const char* path)
+{
+	if (!*proc_root_get() || !path) return false;
+	if (path_in_dir(path, "/proc/self") || path_in_dir(path, "/proc/thread-self")) return false;
+	return path_in_dir(path, "/proc") || path_in_dir(path, "/sys");
+}
+
+
+int
+proc_root_path(char* buffer, size_t size, const char* format, ...)
+{
+	char path[PATH_MAX];
+	va_list ap;
+	va_start(ap, format);
+	vsnprintf(path, sizeof(path), format, ap);
+	va_end(ap);
+	if (proc_root_match(path)) return snprintf(buffer, size, "%s%s", proc_root, path);
+	return snprintf(buffer, size, "%s", path);
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is a part of sp-memusage.
+ *
+ * Copyright (C) 2012 by Nokia Corporation
+ *
+ * Contact: Eero Tamminen <eero.tamminen@nokia.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+/** @file proc-root.h
+ * Configurable root directory for the /proc and /sys files.
+ *
+ * The collectors can be pointed to a synthetic or captured copy of
+ * /proc and /sys trees, located at <root>/proc and <root>/sys. The root
+ * is set either with proc_root_set() or with SP_PROC_ROOT environment
+ * variable.
+ *
+ * The files of the process itself (/proc/self/) are always read from
+ * the real /proc.
+ *
+ * If the root directory contains an index file, it is a capture archive
+ * written by mem-proc-capture. The archive contains a root directory for
+ * every captured snapshot, listed in the index with the capture time.
+ * The snapshots are used one at a time, starting from the first one.
+ */
+#ifndef PROC_ROOT_H
+#define PROC_ROOT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* environment variable for setting the root directory */
+#define PROC_ROOT_ENV       "SP_PROC_ROOT"
+
+/* capture archive index, each line has a snapshot directory name and
+ * capture time in seconds since the epoch */
+#define PROC_ROOT_INDEX     "index"
+
+/* number of the wrapped open(), fopen(), opendir() and access() calls,
+ * maintained by proc-root-wrap.c when it is linked in */
+extern unsigned long proc_root_calls;
+
+/**
+ * Sets the root directory.
+ *
+ * @param[in] root   the root directory, NULL or empty string to use the
+ *                   real /proc and /sys.
+ * @return           0 for success, -1 if the root is not a directory
+ *                   or it is an empty capture archive.
+ */
+int proc_root_set(const char* root);
+
+/**
+ * Checks if the root directory is a capture archive.
+ *
+ * @return   true if capture archive snapshots are used.
+ */
+bool proc_root_is_archive(void);
+
+/**
+ * Switches to the next capture archive snapshot.
+ *
+ * @return   0 for success, -1 if there are no more snapshots.
+ */
+int proc_root_next(void);
+
+/**
+ * Gets capture time of the current archive snapshot.
+ *
+ * @return   the local time of day in milliseconds, as in the
+ *           libsp-measure timestamps, or -1 if archive is not used.
+ */
+int proc_root_time(void);
+
+/**
+ * Gets the root directory.
+ *
+ * @return   the root directory, or the current snapshot directory of a
+ *           capture archive, or empty string if not set.
+ */
+const char* proc_root_get(void);
+
+/**
+ * Checks if the path should be read from the root directory.
+ *
+ * @param[in] path   the absolute path.
+ * @return           true for /proc and /sys paths, when root is set.
+ */
+bool proc_root_match(const char* path);
+
+/**
+ * Formats path of /proc or /sys file.
+ *
+ * The path is prefixed with the root directory if necessary.
+ * @param[out] buffer  the output buffer.
+ * @param[in] size     the output buffer size.
+ * @param[in] format   the path format string.
+ * @return             the formatted path length, as with snprintf().
+ */
+int proc_root_path(char* buffer, size_t size, const char* format, ...)
+		__attribute__((format(printf, 3, 4)));
+
+#endif
@@ -44,7 +44,7 @@
 
 #include <stdio.h>
 
-enum {
+typedef enum {
 	SP_REPORT_ALIGN_LEFT = 0,
 	SP_REPORT_ALIGN_RIGHT = 1,
 	SP_REPORT_ALIGN_CENTER = 2
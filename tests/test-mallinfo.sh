@@ -0,0 +1,109 @@
+#!/bin/sh -e
+# usage: test-mallinfo.sh [counters|profile|trim|leaks|threads]
+# MALLINFO_LIB selects the tested library, for example in the source tree
+dir=/tmp/mallinfo-test.$$
+mallinfo=${MALLINFO_LIB:-/usr/lib/mallinfo.so}
+
+exit_cleanup ()
+{
+	rm -rf $dir
+}
+trap exit_cleanup EXIT
+
+# allocates 10000 strings of 2000 bytes, kept until the exit
+workload ()
+{
+	MALLINFO="dir=$dir,$1" LD_PRELOAD=$mallinfo awk 'BEGIN { for (i = 0; i < 10000; i++) a[i] = sprintf("%2000d", i) }'
+}
+
+# frees every other of 5000 strings of 8000 bytes, which leaves a page
+# in every free chunk, and waits a second for the trimming reports
+fragment ()
+{
+	MALLINFO="dir=$dir,interval=100,$1" LD_PRELOAD=$mallinfo awk 'BEGIN {
+		for (i = 0; i < 5000; i++) a[i] = sprintf("%8000d", i)
+		for (i = 0; i < 5000; i += 2) delete a[i]
+		system("sleep 1") }' 2> $dir/stderr
+}
+
+# prints the named column of the last CSV record
+column ()
+{
+	awk -F, -v name=$1 'NR == 1 { for (i = 1; i <= NF; i++) if ($i == name) col = i } END { print $col }' $2
+}
+
+mkdir $dir
+
+case "$1" in
+counters)
+	workload counters=1
+	mallinfo-convert -o $dir/mallinfo.csv $dir/mallinfo-*.trace
+	head -n 1 $dir/mallinfo.csv | grep -q ',sbrk,allocs,frees,reallocs,allocbytes,freebytes,alloc/s,free/s,le16,.*,le2k,.*,gt256k$'
+	# the strings are counted in the exit record
+	[ $(column allocs $dir/mallinfo.csv) -ge 10000 ]
+	[ $(column allocbytes $dir/mallinfo.csv) -ge 20000000 ]
+	[ $(column le2k $dir/mallinfo.csv) -ge 10000 ]
+	[ $(column frees $dir/mallinfo.csv) -lt 1000 ]
+	;;
+profile)
+	workload profile=65536
+	heap=$(ls $dir/mallinfo-*.0001.heap)
+	grep -q '^heap profile: *[0-9]*: *[0-9]* \[ *[0-9]*: *[0-9]*\] @ heap_v2/65536$' $heap
+	grep -q '^[0-9]*: [0-9]* \[[0-9]*: [0-9]*\] @ 0x[0-9a-f]*' $heap
+	grep -q '^MAPPED_LIBRARIES:$' $heap
+	# the in-use samples scaled back as pprof does estimate the 20 MB of
+	# strings, the sampling error is a few percent
+	estimate=$(awk 'NR > 1 && $1 ~ /^[1-9][0-9]*:$/ { size = $2 / $1; total += $2 / (1 - exp(-size / 65536)) }
+		/^MAPPED_LIBRARIES:/ { exit }
+		END { print int(total / 1000000) }' $heap)
+	[ $estimate -ge 15 ]
+	[ $estimate -le 27 ]
+	;;
+trim)
+	# the 20 MB of free heap is trimmed at the first report
+	fragment trim=4M,trim_hold=0,trim_interval=0
+	grep -q '^mallinfo: trimmed at 0\.[0-9]*, free heap [0-9]\{5\} kB, .* ([1-9][0-9]* kB returned)$' $dir/stderr
+	# but not before it has been free for the hold time
+	fragment trim=4M,trim_hold=10
+	if grep -q 'trimmed at' $dir/stderr; then exit 1; fi
+	;;
+leaks)
+	workload leaks=1k
+	leaks=$(ls $dir/mallinfo-*.0001.leaks)
+	grep -q '^# live blocks of 1024 bytes or more at [0-9.]* s, 0 blocks not tracked$' $leaks
+	# bytes, blocks and the bytes younger than a second of the total and
+	# of the call site allocating the strings
+	set -- $(awk '$9 == "total" { print $1, $2, $3 }' $leaks)
+	[ $1 -ge 20000000 ]
+	[ $2 -ge 10000 ]
+	[ $3 -eq $1 ]
+	[ $(awk '$1 ~ /^[0-9]+$/ && $9 != "total" && $2 >= 10000 && $3 == $1 { n++ } END { print n + 0 }' $leaks) -eq 1 ]
+	# the smaller blocks are not tracked
+	rm $dir/*
+	workload leaks=4k
+	[ $(awk '$9 == "total" { print $2 }' $dir/mallinfo-*.0001.leaks) -lt 1000 ]
+	;;
+threads)
+	workload counters=1,threads=1
+	trace=$(ls $dir/mallinfo-*.trace)
+	mallinfo-convert -o $dir/mallinfo.csv $trace
+	mallinfo-convert -t -o $dir/threads.csv $trace
+	head -n 1 $dir/threads.csv | grep -q '^time,thread,tid,allocs,frees,reallocs,allocbytes,freebytes,remotefrees,allocns,freens,alloc/s,free/s,remote/s,ns/alloc,ns/free,alloc%,free%$'
+	# awk has only the main thread, the process ID in the trace name,
+	# and its counters are the totals
+	pid=${trace##*/mallinfo-}
+	[ $(column tid $dir/threads.csv) -eq ${pid%.trace} ]
+	[ $(awk -F, 'NR > 1 { print $1 }' $dir/threads.csv | uniq -d | wc -l) -eq 0 ]
+	for name in allocs frees allocbytes freebytes; do
+		[ $(column $name $dir/threads.csv) -eq $(column $name $dir/mallinfo.csv) ]
+	done
+	[ $(column remotefrees $dir/threads.csv) -eq 0 ]
+	;;
+*)
+	MALLINFO="dir=$dir" LD_PRELOAD=$mallinfo /bin/true
+	mallinfo-convert -o $dir/mallinfo.csv $dir/mallinfo-*.trace
+	# the header and the records taken at the start and at the exit
+	head -n 1 $dir/mallinfo.csv | grep -q '^time,arena,ordblks,smblks,hblks,hblkhd,usmblks,fsmblks,uordblks,fordblks,keepcost,total,sbrk$'
+	[ $(wc -l < $dir/mallinfo.csv) -eq 3 ]
+	;;
+esac
@@ -1,15 +1,206 @@
 #!/bin/sh -e
+# usage: test-mem-cpu-monitor.sh [shm|leak|tree|replay|proc-root|columns|io|vmstat|numa]
 log=/tmp/mem-cpu-monitor.log
+record=/tmp/mem-cpu-monitor.rec
+shm=mem-cpu-monitor-test.$$
+root=/tmp/mem-cpu-monitor-fixture.$$
+
+# the synthetic /proc generator is installed with the tests
+proc_fixture=$(dirname $0)/proc-fixture
+[ -x $proc_fixture ] || proc_fixture=$(dirname $0)/../bench/proc-fixture
 
 exit_cleanup ()
 {
-	rm -f $log
+	# a failed check leaves the monitor running
+	[ -z "$pid" ] || kill $pid 2>/dev/null || true
+	rm -f $log $log.csv $log.replay $log.env $record
+	rm -rf $root
 }
 trap exit_cleanup EXIT
 
-mem-cpu-monitor -i 1 --self > $log &
-pid=$!
-sleep 4
-kill -TERM $pid
-# error if no time output in log file
-grep -q '^[0-9]\+:[0-9]\+:[0-9]\+ ' $log
+# time lines of the report
+count_lines ()
+{
+	grep -c '^[0-9]\+:[0-9]\+:[0-9]\+' $1 || true
+}
+
+# rewrites the fixture file in place with the awk program, the monitor
+# keeps some files open
+fixture_update ()
+{
+	awk "$1" $root/$2 > $root/update
+	cat $root/update > $root/$2
+}
+
+# generates the fixture with the given options and prints the pid of
+# the process named with the first argument in it
+fixture_pid ()
+{
+	name=$1
+	shift
+	[ -d $root ] || $proc_fixture "$@" $root
+	grep -l "^$name\$" $root/proc/*/comm | cut -d/ -f5
+}
+
+case "$1" in
+shm)
+	mem-cpu-monitor -i 1 --self --shm=$shm > $log &
+	pid=$!
+	sleep 3
+	# the segment header: magic "MCSH", version, size, sequence and
+	# the writer pid, the sequence is even when no write is in progress
+	set -- $(od -A n -t u4 -N 20 /dev/shm/$shm)
+	[ $1 -eq 1296257864 ]
+	[ $2 -eq 2 ]
+	[ $4 -gt 0 ]
+	[ $(($4 % 2)) -eq 0 ]
+	[ $5 -eq $pid ]
+	# the segment of a running monitor is not taken over
+	if mem-cpu-monitor -i 1 --self --shm=$shm > /dev/null 2>&1; then exit 1; fi
+	kill -TERM $pid
+	wait $pid || true
+	# and it's removed when the monitor exits
+	[ ! -e /dev/shm/$shm ]
+	;;
+leak)
+	fpid=$(fixture_pid leaky-0 -p 2 -n leaky)
+	# the file descriptor count of the first process grows steadily
+	(
+		fd=100
+		while [ $fd -lt 132 ]; do
+			ln -s /dev/null $root/proc/$fpid/fd/$fd
+			fd=$(($fd + 1))
+			sleep 0.25
+		done
+	) &
+	timeout -s INT 8 mem-cpu-monitor --proc-root=$root -n leaky -i 1 --leak-trend=0.002 \
+		--columns=fds > $log 2>&1 || [ $? -eq 124 ]
+	wait
+	grep -q "PID $fpid (leaky-0) file descriptors grows" $log
+	# and tagged in the leak column
+	grep -q ' F ' $log
+	# while the other one doesn't grow
+	if grep -q 'leaky-1) .* grows' $log; then exit 1; fi
+	;;
+tree)
+	# init is the parent of the three synthetic processes
+	fpid=$(fixture_pid init -p 3 -n synth)
+	timeout -s INT 3 mem-cpu-monitor --proc-root=$root -n init -i 1 \
+		--tree-details=$log.csv > $log || [ $? -eq 124 ]
+	grep -q 'procs:tree-clean:tree-dirty:  tree-PSS:tree-CPU-%:' $log
+	# the tree columns of the first sample and the sum of its details
+	set -- $(awk '/^[0-9]+:[0-9]+:[0-9]+ / { print $11, $14; exit }' $log)
+	[ $1 -eq 4 ]
+	[ $(awk -F, -v pid=$fpid 'NR == 2 { time = $1 } $1 == time && $2 == pid { n++ }
+		END { print n }' $log.csv) -eq 4 ]
+	[ $(awk -F, 'NR == 2 { time = $1 } $1 == time { pss += $8 } END { print pss }' $log.csv) -eq $2 ]
+	;;
+replay)
+	# SIGINT stops the monitor cleanly, so the recording is complete
+	timeout -s INT 4 mem-cpu-monitor -i 1 --self --record=$record > $log || [ $? -eq 124 ]
+	samples=$(count_lines $log)
+	[ $samples -ge 3 ]
+	# every recorded sample is replayed
+	mem-cpu-monitor --replay=$record > $log.replay
+	[ $(count_lines $log.replay) -eq $samples ]
+	# and aggregated into fewer lines with a longer interval
+	mem-cpu-monitor --replay=$record -i 2 > $log.replay
+	[ $(count_lines $log.replay) -lt $samples ]
+	;;
+proc-root)
+	fpid=$(fixture_pid synth-0 -p 5 -n synth)
+	timeout -s INT 3 mem-cpu-monitor --proc-root=$root -n synth -i 1 > $log || [ $? -eq 124 ]
+	# the system and process data come from the fixture
+	total=$(awk '/^MemTotal:/ { print $2 }' $root/proc/meminfo)
+	grep -q "^System: .* total memory: $total kB RAM" $log
+	grep -q "|PID $fpid synth-0 " $log
+	[ $(grep -o '|PID [0-9]* synth-[0-4] ' $log | wc -l) -eq 5 ]
+	[ $(count_lines $log) -ge 2 ]
+	# also when the root is given in the environment
+	SP_PROC_ROOT=$root timeout -s INT 2 mem-cpu-monitor -n synth -i 1 > $log.env || [ $? -eq 124 ]
+	[ "$(head -n 3 $log)" = "$(head -n 3 $log.env)" ]
+	;;
+columns)
+	mem-cpu-monitor -i 1 --self --columns=rss,pss,fds > $log &
+	pid=$!
+	sleep 3
+	kill -TERM $pid
+	# only the selected process columns in the header
+	grep -q 'RSS:.*PSS:.*fds:' $log
+	if grep -q 'clean:' $log; then exit 1; fi
+	grep -q '^[0-9]\+:[0-9]\+:[0-9]\+ ' $log
+	;;
+io)
+	fpid=$(fixture_pid synth-0 -p 1 -n synth)
+	# 2 MB read with 100 read calls between the second and third sample
+	(
+		sleep 1.5
+		fixture_update '$1 == "read_bytes:" { $2 += 2097152 } $1 == "syscr:" { $2 += 100 } { print }' \
+			proc/$fpid/io
+		fixture_update '$3 == "sda" { $4 += 100; $6 += 4096 } { print }' proc/diskstats
+		fixture_update '$1 == "pgpgin" { $2 += 2048 } { print }' proc/vmstat
+	) &
+	timeout -s INT 4 mem-cpu-monitor --proc-root=$root -n synth -i 1 --system-io \
+		--columns=io,syscio > $log || [ $? -eq 124 ]
+	wait
+	grep -q '| pgin/s: pgout/s: rd-kB/s: wr-kB/s: rd/s: wr/s:| rd-kB/s: wr-kB/s: rdsc/s: wrsc/s:$' $log
+	# the system page-in, disk and process read rates, allowing for the
+	# sampling interval jitter
+	[ $(awk 'function near(value, expected) { return value > expected * 0.9 && value < expected * 1.1 }
+		/^[0-9]+:[0-9]+:[0-9]+ / && near($7, 2048) && near($9, 2048) && near($11, 100) &&
+			near($13, 2048) && near($15, 100) && $8 == 0 && $14 == 0 { n++ }
+		END { print n + 0 }' $log) -eq 1 ]
+	;;
+vmstat)
+	fpid=$(fixture_pid synth-0 -p 1 -n synth)
+	# a per-zone counter summed with the global one
+	echo "pgscan_kswapd_normal 100" >> $root/proc/vmstat
+	(
+		sleep 1.5
+		fixture_update '$1 == "pgfault" { $2 += 1000 } $1 == "pgmajfault" { $2 += 50 }
+			$1 == "pswpin" { $2 += 20 } $1 ~ /^pgscan_kswapd/ { $2 += 200 }
+			$1 == "pgsteal_direct" { $2 += 30 } $1 == "compact_stall" { $2 += 50 }
+			$1 == "oom_kill" { $2 += 100 } $1 ~ /^workingset_refault/ { $2 += 30 } { print }' proc/vmstat
+	) &
+	timeout -s INT 4 mem-cpu-monitor --proc-root=$root -n synth -i 1 --vmstat > $log || [ $? -eq 124 ]
+	wait
+	grep -q '|   flt:majflt: swpin:swpout:scan-k:scan-d:steal-k:steal-d:compact:oom:refault:|' $log
+	[ $(awk 'function near(value, expected) { return value > expected * 0.9 && value < expected * 1.1 }
+		/^[0-9]+:[0-9]+:[0-9]+ / && near($7, 1000) && near($8, 50) && near($9, 20) && $10 == 0 &&
+			near($11, 400) && $12 == 0 && $13 == 0 && near($14, 30) && near($15, 50) &&
+			near($16, 100) && near($17, 60) { n++ }
+		END { print n + 0 }' $log) -eq 1 ]
+	;;
+numa)
+	fpid=$(fixture_pid synth-0 -p 1 -n synth)
+	(
+		sleep 1.5
+		fixture_update '$1 == "numa_hit" { $2 += 1000 } $1 ~ /^numa_(miss|foreign)$/ { $2 += 100 }
+			{ print }' proc/vmstat
+	) &
+	timeout -s INT 4 mem-cpu-monitor --proc-root=$root -n synth -i 1 --numa --columns=numa > $log || [ $? -eq 124 ]
+	wait
+	grep -q '| N0-used: N0-free: N1-used: N1-free:    hit:  miss:foreign:|  *N0-kB:   N1-kB:$' $log
+	# the node memory from sysfs and the process node memory summed from
+	# the resident pages of its numa_maps
+	node_mem='$3 == "MemUsed:" { used = $4 } $3 == "MemFree:" { free = $4 } END { print used, free }'
+	expected="$(awk "$node_mem" $root/sys/devices/system/node/node0/meminfo)"
+	expected="$expected $(awk "$node_mem" $root/sys/devices/system/node/node1/meminfo)"
+	expected="$expected $(awk '{ for (i = 1; i <= NF; i++) if ($i ~ /^N[01]=/) {
+			split(substr($i, 2), node, "="); kb[node[1]] += node[2] * 4 } }
+		END { print kb[0], kb[1] }' $root/proc/$fpid/numa_maps)"
+	[ "$(awk '/^[0-9]+:[0-9]+:[0-9]+ / { print $7, $8, $9, $10, $14, $15; exit }' $log)" = "$expected" ]
+	# and the allocation rates
+	[ $(awk 'function near(value, expected) { return value > expected * 0.9 && value < expected * 1.1 }
+		/^[0-9]+:[0-9]+:[0-9]+ / && near($11, 1000) && near($12, 100) && near($13, 100) { n++ }
+		END { print n + 0 }' $log) -eq 1 ]
+	;;
+*)
+	mem-cpu-monitor -i 1 --self > $log &
+	pid=$!
+	sleep 4
+	kill -TERM $pid
+	# error if no time output in log file
+	grep -q '^[0-9]\+:[0-9]\+:[0-9]\+ ' $log
+	;;
+esac